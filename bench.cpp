@@ -0,0 +1,380 @@
+#include <QCoreApplication>
+#include <QCommandLineParser>
+#include <QDateTime>
+#include <QElapsedTimer>
+#include <QFile>
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QSysInfo>
+#include <QTextStream>
+#include <QThread>
+#include <algorithm>
+#include <memory>
+#include <vector>
+#include "simplechatnode.h"
+
+// Microbenchmarks for the node engine's hot paths. Each benchmark is timed in
+// batches sized to take at least a millisecond; the median of the samples is
+// the headline number. Results go to stdout (or --output) as JSON so runs of
+// different releases can be compared by script.
+
+namespace {
+
+// Results are folded in here so the compiler cannot drop the work
+volatile quint64 g_sink = 0;
+
+// Swallows everything the node sends
+class NullTransport : public DatagramTransport
+{
+public:
+    bool bind(quint16, bool) override { return true; }
+    void close() override {}
+    qint64 writeDatagram(const QByteArray& data, const QHostAddress&, quint16) override { return data.size(); }
+    QHostAddress localAddress() const override { return QHostAddress::LocalHost; }
+};
+
+class Harness
+{
+public:
+    Harness(const QString& filter, int samples) : m_filter(filter), m_samples(samples) {}
+
+    template <typename Op>
+    void run(const QString& name, Op op)
+    {
+        if (!m_filter.isEmpty() && !name.contains(m_filter)) {
+            return;
+        }
+
+        // Calibrate: grow the batch until it takes at least MIN_BATCH_NS
+        qint64 batch = 1;
+        for (;;) {
+            QElapsedTimer timer;
+            timer.start();
+            for (qint64 i = 0; i < batch; ++i) {
+                op();
+            }
+            if (timer.nsecsElapsed() >= MIN_BATCH_NS || batch >= (qint64(1) << 30)) {
+                break;
+            }
+            batch *= 2;
+        }
+
+        std::vector<double> perOp;
+        perOp.reserve(size_t(m_samples));
+        for (int s = 0; s < m_samples; ++s) {
+            QElapsedTimer timer;
+            timer.start();
+            for (qint64 i = 0; i < batch; ++i) {
+                op();
+            }
+            perOp.push_back(double(timer.nsecsElapsed()) / double(batch));
+        }
+        std::sort(perOp.begin(), perOp.end());
+        double mean = 0;
+        for (double value : perOp) {
+            mean += value;
+        }
+        mean /= double(perOp.size());
+        const double median = perOp[perOp.size() / 2];
+
+        QJsonObject result;
+        result["name"] = name;
+        result["iterations"] = double(batch) * m_samples;
+        result["samples"] = m_samples;
+        result["ns_per_op"] = QJsonObject{
+            {"median", median},
+            {"min", perOp.front()},
+            {"mean", mean},
+            {"max", perOp.back()},
+        };
+        result["ops_per_sec"] = median > 0 ? 1e9 / median : 0.0;
+        m_results.append(result);
+
+        QTextStream(stderr) << QString("%1 %2 ns/op").arg(name, -56).arg(median, 12, 'f', 1) << Qt::endl;
+    }
+
+    QJsonArray results() const { return m_results; }
+
+private:
+    static const qint64 MIN_BATCH_NS = 1000000;
+
+    QString m_filter;
+    int m_samples;
+    QJsonArray m_results;
+};
+
+} // namespace
+
+// Friend of SimpleChatNode: drives the private hot paths directly
+class NodeBench
+{
+public:
+    static void wireFormat(Harness& harness);
+    static void routing(Harness& harness);
+    static void antiEntropy(Harness& harness);
+    static void peers(Harness& harness);
+
+private:
+    static std::unique_ptr<SimpleChatNode> makeNode(const QString& name = "Bench")
+    {
+        std::unique_ptr<SimpleChatNode> node(new SimpleChatNode(name, 9000));
+        node->setLogLevels("all=off");
+        // Time the protocol work, not pacing: with no rate limits nothing is queued
+        SendScheduler::Limits unlimited;
+        unlimited.peerBytesPerSec = 0;
+        unlimited.nodeBytesPerSec = 0;
+        node->setSendLimits(unlimited);
+        node->setTransport(new NullTransport);
+        node->start();
+        return node;
+    }
+
+    static void fillStore(SimpleChatNode* node, int origins, int perOrigin)
+    {
+        for (int o = 0; o < origins; ++o) {
+            MessageInfo info;
+            info.origin = QString("Origin%1").arg(o);
+            info.destination = "-1";
+            info.chatText = QString(64, QLatin1Char('x'));
+            info.timestamp = QDateTime::fromMSecsSinceEpoch(0);
+            for (int seq = 1; seq <= perOrigin; ++seq) {
+                info.sequence = seq;
+                node->storeMessage(info);
+            }
+        }
+    }
+};
+
+void NodeBench::wireFormat(Harness& harness)
+{
+    std::unique_ptr<SimpleChatNode> node = makeNode();
+    const QString text(64, QLatin1Char('x'));
+
+    QVariantMap chat;
+    chat["Type"] = "message";
+    chat["Origin"] = "Client1";
+    chat["Destination"] = "-1";
+    chat["Sequence"] = 4711;
+    chat["ChatText"] = text;
+    chat["Timestamp"] = QDateTime::currentMSecsSinceEpoch();
+    chat["LastIP"] = "192.168.1.20";
+    chat["LastPort"] = 9001;
+
+    QVariantMap privateMsg = chat;
+    privateMsg.remove("Destination");
+    privateMsg["Type"] = "private";
+    privateMsg["Dest"] = "Client7";
+    privateMsg["HopLimit"] = 10u;
+
+    QVariantMap ack;
+    ack["Type"] = "ack";
+    ack["Origin"] = "Client2";
+    ack["AckOrigin"] = "Client1";
+    ack["AckSequence"] = 4711;
+
+    QVariantMap ackBatch;
+    ackBatch["Type"] = "ack_batch";
+    ackBatch["Origin"] = "Client2";
+    QVariantList acks;
+    for (int i = 0; i < 8; ++i) {
+        acks.append(QVariant(QVariantList{QString("Origin%1").arg(i), 4700 + i, 4711 + i, qulonglong(0x5555)}));
+    }
+    ackBatch["Acks"] = acks;
+
+    QVariantMap routeUpdate;
+    routeUpdate["Type"] = "route_update";
+    routeUpdate["Origin"] = "Client1";
+    routeUpdate["LastIP"] = "192.168.1.20";
+    routeUpdate["LastPort"] = 9001;
+    QVariantList routes;
+    for (int i = 0; i < 64; ++i) {
+        routes.append(QVariant(QVariantList{QString("Node%1").arg(i), 2 * i, 1 + i % 8}));
+    }
+    routeUpdate["Routes"] = routes;
+
+    fillStore(node.get(), 100, 10);
+    const QVariantMap vectorClock = node->buildVectorClockMessage(0);
+
+    QVariantMap syncBatch;
+    syncBatch["Type"] = "sync_batch";
+    syncBatch["Origin"] = "Client1";
+    QVariantList batch;
+    for (int i = 0; i < 16; ++i) {
+        batch.append(QVariant(QVariantList{QString("Origin%1").arg(i % 4), i + 1, "-1", text}));
+    }
+    syncBatch["SyncBatch"] = batch;
+
+    const QList<QPair<QString, QVariantMap>> messages = {
+        {"message", chat},
+        {"private", privateMsg},
+        {"ack", ack},
+        {"ack_batch_8", ackBatch},
+        {"route_update_64", routeUpdate},
+        {"vector_clock_100", vectorClock},
+        {"sync_batch_16", syncBatch},
+    };
+    for (const auto& entry : messages) {
+        for (bool compact : {true, false}) {
+            const QString format = compact ? "compact" : "legacy";
+            const QVariantMap& message = entry.second;
+            harness.run(QString("wire/serialize/%1/%2").arg(format, entry.first), [&]() {
+                g_sink += quint64(node->serializeMessage(message, compact).size());
+            });
+            const QByteArray bytes = node->serializeMessage(message, compact);
+            harness.run(QString("wire/deserialize/%1/%2").arg(format, entry.first), [&]() {
+                g_sink += quint64(node->deserializeMessage(bytes.constData(), int(bytes.size())).size());
+            });
+        }
+    }
+}
+
+void NodeBench::routing(Harness& harness)
+{
+    for (int size : {100, 1000, 10000}) {
+        std::unique_ptr<SimpleChatNode> node = makeNode();
+        const QHostAddress nextHop("10.0.0.2");
+        QVector<NodeId> destinations;
+        QVector<int> sequences;
+        for (int i = 0; i < size; ++i) {
+            destinations.append(node->m_nodeIds.intern(QString("Node%1").arg(i)));
+            sequences.append(2);
+            node->updateRoutingTable(destinations.last(), nextHop, 9001, 2, 1 + i % 8);
+        }
+
+        // Every call carries a newer sequence, so each one replaces the route
+        int next = 0;
+        harness.run(QString("routing/updateRoutingTable/%1").arg(size), [&]() {
+            const int i = next;
+            next = (next + 1) % size;
+            sequences[i] += 2;
+            node->updateRoutingTable(destinations[i], nextHop, 9001, sequences[i], 1 + i % 8);
+        });
+    }
+
+    std::unique_ptr<SimpleChatNode> node = makeNode();
+    RouteEntry oldRoute;
+    oldRoute.nextHop = QHostAddress("10.0.0.2");
+    oldRoute.nextPort = 9001;
+    oldRoute.sequenceNumber = 10;
+    oldRoute.hopCount = 3;
+    oldRoute.isDirect = false;
+    oldRoute.publicPort = 0;
+    RouteEntry newRoute = oldRoute;
+    newRoute.hopCount = 2;
+    harness.run("routing/isBetterRoute", [&]() {
+        g_sink += node->isBetterRoute(oldRoute, newRoute) ? 1 : 0;
+    });
+}
+
+void NodeBench::antiEntropy(Harness& harness)
+{
+    struct StoreShape {
+        int origins;
+        int perOrigin;
+    };
+    for (const StoreShape& shape : {StoreShape{10, 1000}, StoreShape{100, 1000}, StoreShape{1000, 100}}) {
+        std::unique_ptr<SimpleChatNode> node = makeNode();
+        fillStore(node.get(), shape.origins, shape.perOrigin);
+        const QString suffix = QString("%1x%2").arg(shape.origins).arg(shape.perOrigin);
+
+        harness.run(QString("antientropy/getMyVectorClock/%1").arg(suffix), [&]() {
+            g_sink += quint64(node->getMyVectorClock().sequences.size());
+        });
+        harness.run(QString("antientropy/buildVectorClockMessage/%1").arg(suffix), [&]() {
+            g_sink += quint64(node->buildVectorClockMessage(0).size());
+        });
+
+        // A peer that has nothing: each call pushes one round's budget
+        const NodeId peerId = node->m_nodeIds.intern("EmptyPeer");
+        const QHostAddress peerAddress("10.0.0.3");
+        const VectorClock emptyClock;
+        for (bool batched : {true, false}) {
+            harness.run(QString("antientropy/sendMissingMessages/%1/%2")
+                            .arg(batched ? "batch" : "single", suffix), [&]() {
+                auto& sync = node->m_peerSync[peerId];
+                sync.supportsDigest = batched;
+                sync.syncBudget = SimpleChatNode::SYNC_BUDGET_PER_ROUND;
+                node->sendMissingMessages(peerId, emptyClock, peerAddress, 9003);
+            });
+        }
+    }
+}
+
+void NodeBench::peers(Harness& harness)
+{
+    for (int size : {100, 1000, 10000, 100000}) {
+        std::unique_ptr<SimpleChatNode> node = makeNode();
+        QVector<QPair<QHostAddress, quint16>> endpoints;
+        for (int i = 0; i < size; ++i) {
+            PeerInfo info;
+            info.address = QHostAddress(quint32(0x0A000001u + quint32(i / 16)));
+            info.port = quint16(9000 + i % 16);
+            info.lastSeenMs = 0;
+            info.peerId = QString("Peer%1").arg(i);
+            info.nodeId = node->m_nodeIds.intern(info.peerId);
+            node->m_peers.insert(info);
+            endpoints.append(qMakePair(info.address, info.port));
+        }
+
+        // Stride through the table so consecutive touches hit different peers
+        int next = 0;
+        harness.run(QString("peers/updatePeerLastSeen/%1").arg(size), [&]() {
+            const auto& endpoint = endpoints[next];
+            next = (next + 7919) % size;
+            node->updatePeerLastSeen(endpoint.first, endpoint.second);
+        });
+    }
+}
+
+int main(int argc, char *argv[])
+{
+    QCoreApplication app(argc, argv);
+    app.setApplicationName("simplechat_bench");
+    app.setApplicationVersion("3.0");
+
+    QCommandLineParser parser;
+    parser.setApplicationDescription("SimpleChat - protocol hot path microbenchmarks (JSON output)");
+    parser.addHelpOption();
+    parser.addVersionOption();
+
+    QCommandLineOption filterOption(QStringList() << "f" << "filter",
+                                    "Only run benchmarks whose name contains this text", "text");
+    parser.addOption(filterOption);
+    QCommandLineOption samplesOption(QStringList() << "s" << "samples",
+                                     "Timed samples per benchmark", "count", "15");
+    parser.addOption(samplesOption);
+    QCommandLineOption outputOption(QStringList() << "o" << "output",
+                                    "Write the JSON report here instead of stdout", "file");
+    parser.addOption(outputOption);
+
+    parser.process(app);
+
+    Harness harness(parser.value(filterOption), qBound(3, parser.value(samplesOption).toInt(), 1000));
+    NodeBench::wireFormat(harness);
+    NodeBench::routing(harness);
+    NodeBench::antiEntropy(harness);
+    NodeBench::peers(harness);
+
+    QJsonObject report;
+    report["suite"] = "simplechat_bench";
+    report["version"] = app.applicationVersion();
+    report["qt"] = QString(qVersion());
+    report["cpu"] = QSysInfo::currentCpuArchitecture();
+    report["cores"] = QThread::idealThreadCount();
+    report["timestamp"] = QDateTime::currentDateTimeUtc().toString(Qt::ISODate);
+    report["results"] = harness.results();
+    const QByteArray json = QJsonDocument(report).toJson(QJsonDocument::Indented);
+
+    if (parser.isSet(outputOption)) {
+        QFile file(parser.value(outputOption));
+        if (!file.open(QIODevice::WriteOnly | QIODevice::Truncate)) {
+            QTextStream(stderr) << "Cannot write " << file.fileName() << ": " << file.errorString() << Qt::endl;
+            return 1;
+        }
+        file.write(json);
+    } else {
+        QTextStream(stdout) << json;
+    }
+    return 0;
+}
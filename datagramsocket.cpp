@@ -0,0 +1,354 @@
+#include "datagramsocket.h"
+#include <QtNetwork/QUdpSocket>
+#include <QSocketNotifier>
+
+#ifdef Q_OS_LINUX
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <cerrno>
+#include <cstring>
+#endif
+
+DatagramSocket::DatagramSocket(QObject *parent)
+    : DatagramTransport(parent)
+    , m_fd(-1)
+    , m_ipv6(false)
+    , m_notifier(nullptr)
+    , m_udpSocket(nullptr)
+{
+}
+
+DatagramSocket::~DatagramSocket()
+{
+    close();
+}
+
+bool DatagramSocket::bind(quint16 port, bool reusePort)
+{
+    if (bindNative(port, reusePort)) {
+        return true;
+    }
+    if (reusePort) {
+        if (m_errorString.isEmpty()) {
+            m_errorString = "SO_REUSEPORT is not supported on this platform";
+        }
+        return false;
+    }
+    return bindFallback(port);
+}
+
+void DatagramSocket::close()
+{
+    if (m_notifier) {
+        m_notifier->setEnabled(false);
+        delete m_notifier;
+        m_notifier = nullptr;
+    }
+#ifdef Q_OS_LINUX
+    if (m_fd >= 0) {
+        ::close(m_fd);
+        m_fd = -1;
+    }
+#endif
+    if (m_udpSocket) {
+        m_udpSocket->close();
+    }
+}
+
+QHostAddress DatagramSocket::localAddress() const
+{
+    if (m_udpSocket) {
+        return m_udpSocket->localAddress();
+    }
+    // The native socket is always bound to the wildcard address
+    return m_ipv6 ? QHostAddress(QHostAddress::Any) : QHostAddress(QHostAddress::AnyIPv4);
+}
+
+bool DatagramSocket::bindFallback(quint16 port)
+{
+    m_udpSocket = new QUdpSocket(this);
+    if (!m_udpSocket->bind(QHostAddress::Any, port)) {
+        m_errorString = m_udpSocket->errorString();
+        return false;
+    }
+    connect(m_udpSocket, &QUdpSocket::readyRead, this, &DatagramSocket::drainFallback);
+    return true;
+}
+
+void DatagramSocket::drainFallback()
+{
+    while (m_udpSocket->hasPendingDatagrams()) {
+        qint64 size = m_udpSocket->pendingDatagramSize();
+        if (size < 0) {
+            break;
+        }
+        // Grow-only buffer shared by every datagram
+        if (m_fallbackBuffer.size() < size) {
+            m_fallbackBuffer.resize(size);
+        }
+
+        QHostAddress senderAddr;
+        quint16 senderPort;
+        qint64 read = m_udpSocket->readDatagram(m_fallbackBuffer.data(), size, &senderAddr, &senderPort);
+        if (read < 0) {
+            break;
+        }
+        if (m_handler) {
+            m_handler(m_fallbackBuffer.data(), int(read), senderAddr, senderPort);
+        }
+    }
+}
+
+#ifdef Q_OS_LINUX
+
+namespace {
+
+// Qt reports IPv4 peers of a dual-stack socket as plain IPv4 addresses, so
+// convert v4-mapped addresses the same way to keep peer comparisons stable
+QHostAddress fromSockaddr(const sockaddr_storage& storage, quint16* port)
+{
+    if (storage.ss_family == AF_INET) {
+        const sockaddr_in* in4 = reinterpret_cast<const sockaddr_in*>(&storage);
+        *port = ntohs(in4->sin_port);
+        return QHostAddress(ntohl(in4->sin_addr.s_addr));
+    }
+    const sockaddr_in6* in6 = reinterpret_cast<const sockaddr_in6*>(&storage);
+    *port = ntohs(in6->sin6_port);
+    QHostAddress addr(reinterpret_cast<const quint8*>(in6->sin6_addr.s6_addr));
+    bool isV4 = false;
+    quint32 ipv4 = addr.toIPv4Address(&isV4);
+    return isV4 ? QHostAddress(ipv4) : addr;
+}
+
+socklen_t toSockaddr(const QHostAddress& addr, quint16 port, bool ipv6, sockaddr_storage* storage)
+{
+    memset(storage, 0, sizeof(*storage));
+    bool isV4 = false;
+    quint32 ipv4 = addr.toIPv4Address(&isV4);
+    if (!ipv6) {
+        sockaddr_in* in4 = reinterpret_cast<sockaddr_in*>(storage);
+        in4->sin_family = AF_INET;
+        in4->sin_port = htons(port);
+        in4->sin_addr.s_addr = htonl(ipv4);
+        return isV4 ? sizeof(sockaddr_in) : 0;
+    }
+    sockaddr_in6* in6 = reinterpret_cast<sockaddr_in6*>(storage);
+    in6->sin6_family = AF_INET6;
+    in6->sin6_port = htons(port);
+    if (isV4) {
+        // IPv4 destinations go out as v4-mapped addresses on the dual-stack socket
+        in6->sin6_addr.s6_addr[10] = 0xff;
+        in6->sin6_addr.s6_addr[11] = 0xff;
+        quint32 be = htonl(ipv4);
+        memcpy(&in6->sin6_addr.s6_addr[12], &be, 4);
+    } else {
+        Q_IPV6ADDR ip = addr.toIPv6Address();
+        memcpy(in6->sin6_addr.s6_addr, ip.c, 16);
+        in6->sin6_scope_id = addr.scopeId().toUInt();
+    }
+    return sizeof(sockaddr_in6);
+}
+
+} // namespace
+
+bool DatagramSocket::bindNative(quint16 port, bool reusePort)
+{
+    const int on = 1;
+    m_ipv6 = true;
+    int fd = ::socket(AF_INET6, SOCK_DGRAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (fd >= 0) {
+        int off = 0;
+        setsockopt(fd, IPPROTO_IPV6, IPV6_V6ONLY, &off, sizeof(off));
+        if (reusePort) {
+            setsockopt(fd, SOL_SOCKET, SO_REUSEPORT, &on, sizeof(on));
+        }
+        sockaddr_in6 addr;
+        memset(&addr, 0, sizeof(addr));
+        addr.sin6_family = AF_INET6;
+        addr.sin6_port = htons(port);
+        addr.sin6_addr = in6addr_any;
+        if (::bind(fd, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) != 0) {
+            m_errorString = QString::fromLocal8Bit(strerror(errno));
+            ::close(fd);
+            return false;
+        }
+    } else {
+        // No IPv6 support on this host
+        m_ipv6 = false;
+        fd = ::socket(AF_INET, SOCK_DGRAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+        if (fd < 0) {
+            m_errorString = QString::fromLocal8Bit(strerror(errno));
+            return false;
+        }
+        if (reusePort) {
+            setsockopt(fd, SOL_SOCKET, SO_REUSEPORT, &on, sizeof(on));
+        }
+        sockaddr_in addr;
+        memset(&addr, 0, sizeof(addr));
+        addr.sin_family = AF_INET;
+        addr.sin_port = htons(port);
+        addr.sin_addr.s_addr = htonl(INADDR_ANY);
+        if (::bind(fd, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) != 0) {
+            m_errorString = QString::fromLocal8Bit(strerror(errno));
+            ::close(fd);
+            return false;
+        }
+    }
+
+    m_fd = fd;
+    // Uninitialized so untouched slots never become resident memory
+    m_slab = QByteArray(RECV_BATCH_SIZE * RECV_SLOT_SIZE, Qt::Uninitialized);
+    m_overflow = QByteArray(RECV_BATCH_SIZE * MAX_DATAGRAM_SIZE, Qt::Uninitialized);
+    m_notifier = new QSocketNotifier(m_fd, QSocketNotifier::Read, this);
+    connect(m_notifier, &QSocketNotifier::activated, this, &DatagramSocket::drainNative);
+    return true;
+}
+
+void DatagramSocket::drainNative()
+{
+    mmsghdr msgs[RECV_BATCH_SIZE];
+    iovec iovs[RECV_BATCH_SIZE][2];
+    sockaddr_storage senders[RECV_BATCH_SIZE];
+    char* slab = m_slab.data();
+    char* overflow = m_overflow.data();
+
+    // Every slot continues into its own overflow region, behind room for a copy of its head
+    for (int i = 0; i < RECV_BATCH_SIZE; ++i) {
+        iovs[i][0].iov_base = slab + i * RECV_SLOT_SIZE;
+        iovs[i][0].iov_len = RECV_SLOT_SIZE;
+        iovs[i][1].iov_base = overflow + i * MAX_DATAGRAM_SIZE + RECV_SLOT_SIZE;
+        iovs[i][1].iov_len = MAX_DATAGRAM_SIZE - RECV_SLOT_SIZE;
+        memset(&msgs[i], 0, sizeof(mmsghdr));
+        msgs[i].msg_hdr.msg_iov = iovs[i];
+        msgs[i].msg_hdr.msg_iovlen = 2;
+        msgs[i].msg_hdr.msg_name = &senders[i];
+        msgs[i].msg_hdr.msg_namelen = sizeof(sockaddr_storage);
+    }
+
+    // Keep draining full batches; a short batch means the queue is empty
+    while (m_fd >= 0) {
+        int count = ::recvmmsg(m_fd, msgs, RECV_BATCH_SIZE, MSG_DONTWAIT, nullptr);
+        if (count <= 0) {
+            break;
+        }
+        for (int i = 0; i < count; ++i) {
+            quint16 senderPort = 0;
+            QHostAddress senderAddr = fromSockaddr(senders[i], &senderPort);
+            const int size = int(msgs[i].msg_len);
+            char* data = slab + i * RECV_SLOT_SIZE;
+            const bool intact = !(msgs[i].msg_hdr.msg_flags & MSG_TRUNC);
+            if (intact && size > RECV_SLOT_SIZE) {
+                // Join the head to the tail that spilled into this slot's region
+                char* region = overflow + i * MAX_DATAGRAM_SIZE;
+                memcpy(region, data, RECV_SLOT_SIZE);
+                data = region;
+            }
+            if (!intact) {
+                ++m_droppedDatagrams;
+            } else if (m_handler) {
+                m_handler(data, size, senderAddr, senderPort);
+            }
+            // recvmmsg overwrites these on return; reset for the next batch
+            msgs[i].msg_hdr.msg_namelen = sizeof(sockaddr_storage);
+            msgs[i].msg_hdr.msg_flags = 0;
+        }
+        if (count < RECV_BATCH_SIZE) {
+            break;
+        }
+    }
+}
+
+qint64 DatagramSocket::writeDatagram(const QByteArray& data, const QHostAddress& addr, quint16 port)
+{
+    if (m_udpSocket) {
+        return m_udpSocket->writeDatagram(data, addr, port);
+    }
+    if (m_fd < 0) {
+        return -1;
+    }
+    sockaddr_storage dest;
+    socklen_t destLen = toSockaddr(addr, port, m_ipv6, &dest);
+    if (destLen == 0) {
+        return -1;
+    }
+    return ::sendto(m_fd, data.constData(), size_t(data.size()), 0,
+                    reinterpret_cast<const sockaddr*>(&dest), destLen);
+}
+
+QVector<qint64> DatagramSocket::writeDatagrams(const QByteArray& data, const QVector<Destination>& destinations)
+{
+    QVector<qint64> results(destinations.size(), -1);
+    if (m_udpSocket || m_fd < 0) {
+        for (int i = 0; i < destinations.size(); ++i) {
+            results[i] = writeDatagram(data, destinations[i].address, destinations[i].port);
+        }
+        return results;
+    }
+
+    mmsghdr msgs[SEND_BATCH_SIZE];
+    sockaddr_storage addrs[SEND_BATCH_SIZE];
+    int indexes[SEND_BATCH_SIZE];  // msgs slot -> destination index
+    iovec iov;
+    iov.iov_base = const_cast<char*>(data.constData());
+    iov.iov_len = size_t(data.size());
+
+    int next = 0;
+    while (next < destinations.size()) {
+        // Fill a batch, skipping destinations the socket family cannot reach
+        int count = 0;
+        while (count < SEND_BATCH_SIZE && next < destinations.size()) {
+            const Destination& dest = destinations[next];
+            socklen_t len = toSockaddr(dest.address, dest.port, m_ipv6, &addrs[count]);
+            if (len != 0) {
+                memset(&msgs[count], 0, sizeof(mmsghdr));
+                msgs[count].msg_hdr.msg_iov = &iov;
+                msgs[count].msg_hdr.msg_iovlen = 1;
+                msgs[count].msg_hdr.msg_name = &addrs[count];
+                msgs[count].msg_hdr.msg_namelen = len;
+                indexes[count] = next;
+                ++count;
+            }
+            ++next;
+        }
+
+        // sendmmsg stops at the first failing message; record it and resume after it
+        int offset = 0;
+        while (offset < count) {
+            int sent = ::sendmmsg(m_fd, msgs + offset, unsigned(count - offset), 0);
+            if (sent <= 0) {
+                ++offset;  // results[] already holds -1 for this destination
+                continue;
+            }
+            for (int i = 0; i < sent; ++i) {
+                results[indexes[offset + i]] = qint64(msgs[offset + i].msg_len);
+            }
+            offset += sent;
+        }
+    }
+    return results;
+}
+
+#else
+
+bool DatagramSocket::bindNative(quint16, bool)
+{
+    return false;
+}
+
+void DatagramSocket::drainNative()
+{
+}
+
+qint64 DatagramSocket::writeDatagram(const QByteArray& data, const QHostAddress& addr, quint16 port)
+{
+    return m_udpSocket ? m_udpSocket->writeDatagram(data, addr, port) : -1;
+}
+
+QVector<qint64> DatagramSocket::writeDatagrams(const QByteArray& data, const QVector<Destination>& destinations)
+{
+    return DatagramTransport::writeDatagrams(data, destinations);
+}
+
+#endif
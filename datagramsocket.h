@@ -0,0 +1,71 @@
+#ifndef SIMPLECHAT_DATAGRAMSOCKET_H
+#define SIMPLECHAT_DATAGRAMSOCKET_H
+
+#include "datagramtransport.h"
+
+class QUdpSocket;
+class QSocketNotifier;
+
+// UDP socket used by the node engine.
+//
+// On Linux the socket is a native dual-stack descriptor drained with
+// recvmmsg(): up to RECV_BATCH_SIZE datagrams per syscall land in a slab of
+// RECV_SLOT_SIZE slots, and the receive handler is called with views into
+// that slab (valid only for the duration of the call; a handler may patch a
+// datagram in place before sending it on). The rare longer datagram (stats,
+// a long chat line) spills its tail into an overflow region of its slot and
+// is reassembled there; the regions are only address space until a long
+// datagram first lands in them. Only datagrams too long for UDP (never sent
+// by a node) are dropped and counted. Elsewhere,
+// or if the native socket cannot be created, it falls back to QUdpSocket
+// with a single reusable receive buffer.
+class DatagramSocket : public DatagramTransport
+{
+    Q_OBJECT
+
+public:
+    explicit DatagramSocket(QObject *parent = nullptr);
+    ~DatagramSocket();
+
+    // With reusePort, the socket is bound with SO_REUSEPORT so several sockets
+    // (one per receive worker) can share the port; the kernel then spreads
+    // senders across them by address hash. Only the native backend supports it.
+    bool bind(quint16 port, bool reusePort = false) override;
+    void close() override;
+
+    qint64 writeDatagram(const QByteArray& data, const QHostAddress& addr, quint16 port) override;
+
+    // SEND_BATCH_SIZE destinations per sendmmsg() call on Linux
+    QVector<qint64> writeDatagrams(const QByteArray& data, const QVector<Destination>& destinations) override;
+
+    QHostAddress localAddress() const override;
+
+    // True when the recvmmsg backend is active
+    bool isBatched() const override { return m_fd >= 0; }
+
+    static const int RECV_BATCH_SIZE = 32;
+    static const int RECV_SLOT_SIZE = 2048;  // A full Ethernet MTU, so any sync_batch
+    static const int MAX_DATAGRAM_SIZE = 65536;
+    static const int SEND_BATCH_SIZE = 64;
+
+private slots:
+    void drainNative();
+    void drainFallback();
+
+private:
+    bool bindNative(quint16 port, bool reusePort);
+    bool bindFallback(quint16 port);
+
+    // Native (recvmmsg) backend
+    int m_fd;
+    bool m_ipv6;                  // Descriptor is AF_INET6 (dual-stack)
+    QSocketNotifier* m_notifier;
+    QByteArray m_slab;            // RECV_BATCH_SIZE * RECV_SLOT_SIZE receive slots
+    QByteArray m_overflow;        // RECV_BATCH_SIZE * MAX_DATAGRAM_SIZE: per slot, head copy + spilled tail
+
+    // QUdpSocket fallback
+    QUdpSocket* m_udpSocket;
+    QByteArray m_fallbackBuffer;
+};
+
+#endif // SIMPLECHAT_DATAGRAMSOCKET_H
@@ -0,0 +1,10 @@
+#include "datagramtransport.h"
+
+QVector<qint64> DatagramTransport::writeDatagrams(const QByteArray& data, const QVector<Destination>& destinations)
+{
+    QVector<qint64> results(destinations.size(), -1);
+    for (int i = 0; i < destinations.size(); ++i) {
+        results[i] = writeDatagram(data, destinations[i].address, destinations[i].port);
+    }
+    return results;
+}
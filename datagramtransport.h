@@ -0,0 +1,57 @@
+#ifndef SIMPLECHAT_DATAGRAMTRANSPORT_H
+#define SIMPLECHAT_DATAGRAMTRANSPORT_H
+
+#include <QObject>
+#include <QByteArray>
+#include <QString>
+#include <QVector>
+#include <QtNetwork/QHostAddress>
+#include <functional>
+
+// What the node engine needs from the network: one bound datagram endpoint.
+// DatagramSocket is the real UDP implementation; the simulator provides a
+// virtual one so many nodes can share a process.
+class DatagramTransport : public QObject
+{
+    Q_OBJECT
+
+public:
+    // data is only valid for the duration of the call; a handler may patch a
+    // datagram in place before sending it on
+    using ReceiveHandler = std::function<void(char* data, int size,
+                                              const QHostAddress& sender, quint16 senderPort)>;
+
+    struct Destination {
+        QHostAddress address;
+        quint16 port;
+    };
+
+    explicit DatagramTransport(QObject *parent = nullptr) : QObject(parent) {}
+
+    virtual bool bind(quint16 port, bool reusePort = false) = 0;
+    virtual void close() = 0;
+
+    void setReceiveHandler(ReceiveHandler handler) { m_handler = std::move(handler); }
+
+    virtual qint64 writeDatagram(const QByteArray& data, const QHostAddress& addr, quint16 port) = 0;
+
+    // Sends the same payload to every destination. Returns one result per
+    // destination, in order: bytes written, or -1 if that destination failed.
+    virtual QVector<qint64> writeDatagrams(const QByteArray& data, const QVector<Destination>& destinations);
+
+    virtual QHostAddress localAddress() const = 0;
+    QString errorString() const { return m_errorString; }
+
+    // True when the transport drains several datagrams per wakeup
+    virtual bool isBatched() const { return false; }
+
+    // Datagrams that arrived but could not be handed to the receive handler
+    quint64 droppedDatagrams() const { return m_droppedDatagrams; }
+
+protected:
+    ReceiveHandler m_handler;
+    QString m_errorString;
+    quint64 m_droppedDatagrams = 0;
+};
+
+#endif // SIMPLECHAT_DATAGRAMTRANSPORT_H
@@ -0,0 +1,39 @@
+#include "logbuffer.h"
+
+LogBuffer::LogBuffer(int capacity)
+    : m_lines(qMax(capacity, 1))
+    , m_head(0)
+    , m_count(0)
+    , m_dropped(0)
+{
+}
+
+void LogBuffer::push(const QString& line)
+{
+    const int capacity = m_lines.size();
+    if (m_count == capacity) {
+        // Full: overwrite the oldest line
+        m_lines[m_head] = line;
+        m_head = (m_head + 1) % capacity;
+        ++m_dropped;
+        return;
+    }
+    m_lines[(m_head + m_count) % capacity] = line;
+    ++m_count;
+}
+
+QStringList LogBuffer::takeAll()
+{
+    QStringList lines;
+    lines.reserve(m_count);
+    const int capacity = m_lines.size();
+    for (int i = 0; i < m_count; ++i) {
+        QString& line = m_lines[(m_head + i) % capacity];
+        lines.append(line);
+        line.clear();
+    }
+    m_head = 0;
+    m_count = 0;
+    m_dropped = 0;
+    return lines;
+}
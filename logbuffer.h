@@ -0,0 +1,32 @@
+#ifndef SIMPLECHAT_LOGBUFFER_H
+#define SIMPLECHAT_LOGBUFFER_H
+
+#include <QString>
+#include <QStringList>
+#include <QVector>
+
+// Bounded ring buffer of pending chat-log lines. When the view falls behind,
+// the oldest unflushed lines are overwritten and counted as dropped instead
+// of growing without limit.
+class LogBuffer
+{
+public:
+    explicit LogBuffer(int capacity);
+
+    void push(const QString& line);
+
+    // Removes and returns every buffered line, oldest first
+    QStringList takeAll();
+
+    // Lines overwritten since the last takeAll()
+    int dropped() const { return m_dropped; }
+    bool isEmpty() const { return m_count == 0; }
+
+private:
+    QVector<QString> m_lines;
+    int m_head;      // Index of the oldest line
+    int m_count;
+    int m_dropped;
+};
+
+#endif // SIMPLECHAT_LOGBUFFER_H
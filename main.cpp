@@ -1,15 +1,56 @@
 #include <QApplication>
+#include <QCoreApplication>
 #include <QCommandLineParser>
 #include <QDebug>
-#include "simplechatp2p.h"
+#include <QTextStream>
 #include <QtNetwork/QUdpSocket>
-#include <QVariantMap>
+#include <functional>
+#include <memory>
+#include "simplechatp2p.h"
+#include "simplechatnode.h"
+#include "wireformat.h"
+
+// --stats: ask the node on a local port for its metrics snapshot and print it
+static int queryStats(quint16 port)
+{
+    QUdpSocket socket;
+    if (!socket.bind(QHostAddress::LocalHost, 0)) {
+        qCritical() << "Cannot bind a query socket:" << socket.errorString();
+        return 1;
+    }
+    QVariantMap request;
+    request["Type"] = "stats";
+    socket.writeDatagram(WireFormat::encodeLegacy(request), QHostAddress::LocalHost, port);
+    
+    while (socket.waitForReadyRead(2000)) {
+        QByteArray data(int(socket.pendingDatagramSize()), Qt::Uninitialized);
+        socket.readDatagram(data.data(), data.size());
+        const QVariantMap response = WireFormat::decode(data);
+        if (response.value("Type").toString() == "stats_response") {
+            QTextStream(stdout) << response.value("Stats").toString();
+            return 0;
+        }
+    }
+    qCritical() << "No stats response from port" << port;
+    return 1;
+}
 
 int main(int argc, char *argv[])
 {
-    QApplication app(argc, argv);
-    app.setApplicationName("SimpleChatP2P");
-    app.setApplicationVersion("3.0");  // Updated version for DSDV
+    // Headless nodes must not construct a QApplication, so look for the flag
+    // before the parser (which needs an application instance) is available
+    bool headless = false;
+    for (int i = 1; i < argc; ++i) {
+        const QByteArray arg(argv[i]);
+        if (arg == "--headless" || arg == "-H" || arg == "--stats") {
+            headless = true;
+        }
+    }
+
+    std::unique_ptr<QCoreApplication> app(headless ? new QCoreApplication(argc, argv)
+                                                   : new QApplication(argc, argv));
+    app->setApplicationName("SimpleChatP2P");
+    app->setApplicationVersion("3.0");  // Updated version for DSDV
 
     QCommandLineParser parser;
     parser.setApplicationDescription("SimpleChat - UDP P2P/Broadcast Messaging with DSDV Routing");
@@ -36,14 +77,72 @@ int main(int argc, char *argv[])
     QCommandLineOption noForwardOption(QStringList() << "n" << "noforward",
                                        "No-forward mode (rendezvous server)");
     parser.addOption(noForwardOption);
-    
+
     // Add connect option for easier NAT traversal testing
     QCommandLineOption connectOption(QStringList() << "C" << "connect",
                                      "Connect to rendezvous server at this port on localhost",
                                      "port");
     parser.addOption(connectOption);
 
-    parser.process(app);
+    // Run the node engine without any widgets (relay/rendezvous deployments)
+    QCommandLineOption headlessOption(QStringList() << "H" << "headless",
+                                      "Run without a GUI; log output goes to stderr");
+    parser.addOption(headlessOption);
+
+    // Keep messages and sequence numbers across restarts
+    QCommandLineOption dataDirOption(QStringList() << "d" << "data-dir",
+                                     "Directory for the persistent message log (disabled if unset)",
+                                     "dir");
+    parser.addOption(dataDirOption);
+
+    // Per-category log thresholds, e.g. "forwarding=off,retransmission=info"
+    QCommandLineOption logLevelOption(QStringList() << "L" << "log-level",
+                                      "Log thresholds per category (general, peers, routing, forwarding, "
+                                      "retransmission, sync, nat or all) = debug|info|warning|off, comma-separated",
+                                      "spec");
+    parser.addOption(logLevelOption);
+
+    // Spread receive work over several cores (busy rendezvous nodes)
+    QCommandLineOption workersOption(QStringList() << "w" << "workers",
+                                     "Receive on this many SO_REUSEPORT sockets, one thread each (headless only)",
+                                     "count", "1");
+    parser.addOption(workersOption);
+
+    // Outbound pacing
+    QCommandLineOption peerRateOption("peer-rate",
+                                      "Send at most this many KB/s to any one endpoint, 0 = unlimited",
+                                      "KB/s", "1024");
+    parser.addOption(peerRateOption);
+    QCommandLineOption nodeRateOption("node-rate",
+                                      "Send at most this many KB/s in total, 0 = unlimited",
+                                      "KB/s", "8192");
+    parser.addOption(nodeRateOption);
+
+    // Metrics: periodic dump (headless) and a one-shot query of a running node
+    QCommandLineOption metricsFileOption(QStringList() << "M" << "metrics-file",
+                                         "Rewrite this file with the node's metrics periodically (headless only)",
+                                         "file");
+    parser.addOption(metricsFileOption);
+    QCommandLineOption metricsIntervalOption("metrics-interval",
+                                             "Seconds between metrics dumps",
+                                             "seconds", "10");
+    parser.addOption(metricsIntervalOption);
+    QCommandLineOption statsOption("stats",
+                                   "Print the metrics of the node listening on this local port and exit",
+                                   "port");
+    parser.addOption(statsOption);
+
+    parser.process(*app);
+
+    if (parser.isSet(statsOption)) {
+        bool statsOk = false;
+        const int statsPort = parser.value(statsOption).toInt(&statsOk);
+        if (!statsOk || statsPort <= 0 || statsPort > 65535) {
+            qCritical() << "Invalid --stats value";
+            return 1;
+        }
+        return queryStats(quint16(statsPort));
+    }
 
     const QString clientId = parser.value(clientIdOption);
     bool ok = false;
@@ -52,11 +151,94 @@ int main(int argc, char *argv[])
         qCritical() << "Invalid --port value";
         return 1;
     }
-    
+
+    int receiveWorkers = parser.value(workersOption).toInt(&ok);
+    if (!ok || receiveWorkers < 1 || receiveWorkers > 64) {
+        qCritical() << "Invalid --workers value";
+        return 1;
+    }
+    if (receiveWorkers > 1 && !headless) {
+        qWarning() << "--workers is only used with --headless";
+    }
+
+    const int peerRate = parser.value(peerRateOption).toInt(&ok);
+    if (!ok || peerRate < 0) {
+        qCritical() << "Invalid --peer-rate value";
+        return 1;
+    }
+    const int nodeRate = parser.value(nodeRateOption).toInt(&ok);
+    if (!ok || nodeRate < 0) {
+        qCritical() << "Invalid --node-rate value";
+        return 1;
+    }
+    SendScheduler::Limits sendLimits;
+    sendLimits.peerBytesPerSec = qint64(peerRate) * 1024;
+    sendLimits.nodeBytesPerSec = qint64(nodeRate) * 1024;
+
+    const int metricsInterval = parser.value(metricsIntervalOption).toInt(&ok);
+    if (!ok || metricsInterval < 1) {
+        qCritical() << "Invalid --metrics-interval value";
+        return 1;
+    }
+    if (parser.isSet(metricsFileOption) && !headless) {
+        qWarning() << "--metrics-file is only used with --headless";
+    }
+
     bool noForwardMode = parser.isSet(noForwardOption);
+    const QString dataDir = parser.value(dataDirOption);
+
+    // Works on the headless node and on the window (which forwards to its node)
+    auto applyLogLevels = [&](auto* target) {
+        if (parser.isSet(logLevelOption) && !target->setLogLevels(parser.value(logLevelOption))) {
+            qCritical() << "Invalid --log-level value";
+            return false;
+        }
+        return true;
+    };
+
+    std::unique_ptr<SimpleChatP2P> window;
+    std::unique_ptr<SimpleChatNode> headlessNode;
+    std::function<void(const QHostAddress&, quint16)> sendDiscovery;
 
-    SimpleChatP2P window(clientId, listenPort, nullptr, noForwardMode);
-    window.show();
+    if (headless) {
+        headlessNode.reset(new SimpleChatNode(clientId, listenPort, noForwardMode));
+        SimpleChatNode* node = headlessNode.get();
+        node->setDataDirectory(dataDir);
+        node->setReceiveWorkers(receiveWorkers);
+        node->setSendLimits(sendLimits);
+        if (parser.isSet(metricsFileOption)) {
+            node->setMetricsDump(parser.value(metricsFileOption), metricsInterval * 1000);
+        }
+        if (!applyLogLevels(node)) {
+            return 1;
+        }
+        QObject::connect(node, &SimpleChatNode::logMessage, [](const QString& text) {
+            qInfo().noquote() << text;
+        });
+        QObject::connect(node, &SimpleChatNode::messageDelivered,
+                         [](const QString& origin, const QString& destination,
+                            const QString& chatText, bool isPrivate) {
+            const QString prefix = isPrivate ? QString("Private from ") : QString();
+            qInfo().noquote() << QString("← %1%2 → %3: %4")
+                                 .arg(prefix, origin, destination, chatText);
+        });
+        if (!node->start()) {
+            return 1;
+        }
+        sendDiscovery = [node](const QHostAddress& addr, quint16 port) {
+            node->sendDiscovery(addr, port);
+        };
+    } else {
+        window.reset(new SimpleChatP2P(clientId, listenPort, nullptr, noForwardMode, dataDir, sendLimits));
+        window->show();
+        if (!applyLogLevels(window.get())) {
+            return 1;
+        }
+        SimpleChatP2P* view = window.get();
+        sendDiscovery = [view](const QHostAddress& addr, quint16 port) {
+            view->sendDiscovery(addr, port);
+        };
+    }
 
     // Handle connect option for NAT traversal testing
     if (parser.isSet(connectOption)) {
@@ -64,65 +246,23 @@ int main(int argc, char *argv[])
         int rendezvousPort = parser.value(connectOption).toInt(&connectOk);
         if (connectOk && rendezvousPort > 0 && rendezvousPort <= 65535) {
             // Send initial discovery to rendezvous server
-            QUdpSocket udp;
-            QVariantMap discovery;
-            discovery["Type"] = "discovery";
-            discovery["Origin"] = clientId;
-            discovery["Port"] = listenPort;
-
-            // Serialize similarly to SimpleChatP2P::serializeMessage
-            QByteArray payload;
-            {
-                QByteArray data;
-                QDataStream stream(&data, QIODevice::WriteOnly);
-                stream.setVersion(QDataStream::Qt_6_0);
-                stream << quint32(0xCAFEBABE);
-                stream << discovery;
-                QDataStream sizeStream(&payload, QIODevice::WriteOnly);
-                sizeStream.setVersion(QDataStream::Qt_6_0);
-                sizeStream << quint32(data.size());
-                payload.append(data);
-            }
-            
-            udp.writeDatagram(payload, QHostAddress::LocalHost, rendezvousPort);
+            sendDiscovery(QHostAddress::LocalHost, rendezvousPort);
             qDebug() << "Sent discovery to rendezvous server at port" << rendezvousPort;
         }
     }
 
     // Prime with optional peers to accelerate discovery
     const QStringList peers = parser.values(peerOption);
-    if (!peers.isEmpty()) {
-        QUdpSocket udp;
-        QVariantMap discovery;
-        discovery["Type"] = "discovery";
-        discovery["Origin"] = clientId;
-        discovery["Port"] = listenPort;
-
-        // Serialize similarly to SimpleChatP2P::serializeMessage
-        QByteArray payload;
-        {
-            QByteArray data;
-            QDataStream stream(&data, QIODevice::WriteOnly);
-            stream.setVersion(QDataStream::Qt_6_0);
-            stream << quint32(0xCAFEBABE);
-            stream << discovery;
-            QDataStream sizeStream(&payload, QIODevice::WriteOnly);
-            sizeStream.setVersion(QDataStream::Qt_6_0);
-            sizeStream << quint32(data.size());
-            payload.append(data);
-        }
-
-        for (const QString &peer : peers) {
-            const QStringList parts = peer.split(":");
-            if (parts.size() != 2) continue;
-            QHostAddress addr(parts[0]);
-            bool okPort = false;
-            quint16 p = parts[1].toUShort(&okPort);
-            if (!addr.isNull() && okPort) {
-                udp.writeDatagram(payload, addr, p);
-            }
+    for (const QString &peer : peers) {
+        const QStringList parts = peer.split(":");
+        if (parts.size() != 2) continue;
+        QHostAddress addr(parts[0]);
+        bool okPort = false;
+        quint16 p = parts[1].toUShort(&okPort);
+        if (!addr.isNull() && okPort) {
+            sendDiscovery(addr, p);
         }
     }
 
-    return app.exec();
-}
\ No newline at end of file
+    return app->exec();
+}
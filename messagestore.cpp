@@ -0,0 +1,136 @@
+#include "messagestore.h"
+#include <cstring>
+#include <limits>
+
+void MessageStore::store(const MessageInfo& info)
+{
+    if (info.sequence < 1) {
+        return;
+    }
+
+    const NodeId originId = m_nodeIds.intern(info.origin);
+    OriginLog& log = m_origins[originId];
+
+    int segmentIndex = (info.sequence - 1) / SEGMENT_SIZE;
+    auto segment = log.segments.find(segmentIndex);
+    if (segment == log.segments.end()) {
+        segment = log.segments.insert(segmentIndex, Segment());
+        memset(segment->slots, 0, sizeof(segment->slots));
+    }
+    Slot& slot = segment->slots[(info.sequence - 1) % SEGMENT_SIZE];
+    if (!slot.present) {
+        ++m_messageCount;
+    }
+
+    // Overwrites append fresh text; the old bytes stay in the arena
+    const QByteArray utf8 = info.chatText.toUtf8();
+    slot.textOffset = quint32(log.text.size());
+    slot.textLength = quint32(utf8.size());
+    log.text.append(utf8);
+
+    slot.timestampMs = info.timestamp.toMSecsSinceEpoch();
+    slot.destination = m_nodeIds.intern(info.destination);
+    slot.ackMask = 0;
+    slot.present = 1;
+    m_ackOverflow.remove(qMakePair(originId, info.sequence));
+
+    for (const QString& peerId : info.acknowledgedBy) {
+        acknowledge(originId, info.sequence, m_nodeIds.intern(peerId));
+    }
+}
+
+const MessageStore::Slot* MessageStore::findSlot(NodeId origin, int sequence) const
+{
+    if (sequence < 1) {
+        return nullptr;
+    }
+    const OriginLog* log = m_origins.find(origin);
+    if (!log) {
+        return nullptr;
+    }
+    auto segment = log->segments.constFind((sequence - 1) / SEGMENT_SIZE);
+    if (segment == log->segments.constEnd()) {
+        return nullptr;
+    }
+    const Slot& slot = segment->slots[(sequence - 1) % SEGMENT_SIZE];
+    return slot.present ? &slot : nullptr;
+}
+
+bool MessageStore::contains(NodeId origin, int sequence) const
+{
+    return findSlot(origin, sequence) != nullptr;
+}
+
+MessageInfo MessageStore::get(NodeId origin, int sequence) const
+{
+    MessageInfo info;
+    info.sequence = sequence;
+    const Slot* slot = findSlot(origin, sequence);
+    if (!slot) {
+        return info;
+    }
+
+    const OriginLog* log = m_origins.find(origin);
+    info.origin = m_nodeIds.name(origin);
+    info.destination = m_nodeIds.name(slot->destination);
+    info.chatText = QString::fromUtf8(log->text.constData() + slot->textOffset, int(slot->textLength));
+    info.timestamp = QDateTime::fromMSecsSinceEpoch(slot->timestampMs);
+
+    for (int bit = 0; bit < 64; ++bit) {
+        if (slot->ackMask & (quint64(1) << bit)) {
+            info.acknowledgedBy.insert(m_nodeIds.name(NodeId(bit)));
+        }
+    }
+    const QSet<NodeId> overflow = m_ackOverflow.value(qMakePair(origin, sequence));
+    for (NodeId acker : overflow) {
+        info.acknowledgedBy.insert(m_nodeIds.name(acker));
+    }
+    return info;
+}
+
+bool MessageStore::acknowledge(NodeId origin, int sequence, NodeId peer)
+{
+    Slot* slot = const_cast<Slot*>(findSlot(origin, sequence));
+    if (!slot || peer == INVALID_NODE_ID) {
+        return false;
+    }
+    if (peer < 64) {
+        slot->ackMask |= quint64(1) << peer;
+    } else {
+        m_ackOverflow[qMakePair(origin, sequence)].insert(peer);
+    }
+    return true;
+}
+
+void MessageStore::forEachSequence(NodeId origin, int after, const std::function<bool(int)>& visit) const
+{
+    // Nothing is stored above INT_MAX, and the sequence after it does not fit an int
+    const OriginLog* log = m_origins.find(origin);
+    if (!log || after == std::numeric_limits<int>::max()) {
+        return;
+    }
+
+    int first = qMax(after, 0) + 1;
+    for (auto segment = log->segments.lowerBound((first - 1) / SEGMENT_SIZE);
+         segment != log->segments.constEnd(); ++segment) {
+        int base = segment.key() * SEGMENT_SIZE + 1;
+        for (int i = qMax(0, first - base); i < SEGMENT_SIZE; ++i) {
+            if (segment->slots[i].present && !visit(base + i)) {
+                return;
+            }
+        }
+    }
+}
+
+qint64 MessageStore::memoryUsage() const
+{
+    qint64 bytes = 0;
+    m_origins.forEach([&bytes](NodeId, const OriginLog& log) {
+        bytes += qint64(sizeof(OriginLog));
+        // Each QMap node carries the key, the segment and roughly 4 pointers of tree overhead
+        bytes += qint64(log.segments.size()) * qint64(sizeof(Segment) + sizeof(int) + 4 * sizeof(void*));
+        bytes += log.text.capacity();
+    });
+    bytes += qint64(m_ackOverflow.size()) * qint64(sizeof(QPair<NodeId, int>) + sizeof(QSet<NodeId>) + 16);
+    return bytes;
+}
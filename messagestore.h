@@ -0,0 +1,89 @@
+#ifndef SIMPLECHAT_MESSAGESTORE_H
+#define SIMPLECHAT_MESSAGESTORE_H
+
+#include <QString>
+#include <QStringList>
+#include <QByteArray>
+#include <QHash>
+#include <QMap>
+#include <QSet>
+#include <QVector>
+#include <QDateTime>
+#include <functional>
+#include "nodeid.h"
+
+// Structure to hold message information
+struct MessageInfo {
+    QString origin;
+    QString destination;
+    QString chatText;
+    int sequence;
+    QDateTime timestamp;
+    QSet<QString> acknowledgedBy; // Track which peers have acknowledged
+};
+
+// Per-origin message log.
+//
+// Each origin owns fixed-size segments of SEGMENT_SIZE slots indexed by
+// (sequence - 1), so a lookup is one hash on the origin, one map step to the
+// segment and an array index. Slots are plain 32-byte records: chat text
+// lives in a per-origin UTF-8 arena, destinations are NodeIds, and acks are
+// a bitmask over acker NodeIds (ackers with IDs of 64 and above spill into a
+// side table). MessageInfo is only materialised by get().
+//
+// Sequence numbers start at 1; store() ignores anything lower.
+class MessageStore
+{
+public:
+    static const int SEGMENT_SIZE = 64;
+
+    // Names in stored messages are interned into nodeIds
+    explicit MessageStore(NodeIdTable& nodeIds) : m_nodeIds(nodeIds) {}
+
+    void store(const MessageInfo& info);
+    bool contains(NodeId origin, int sequence) const;
+    MessageInfo get(NodeId origin, int sequence) const;
+
+    // Record that peer acknowledged (origin, sequence); false if not stored
+    bool acknowledge(NodeId origin, int sequence, NodeId peer);
+
+    QVector<NodeId> origins() const { return m_origins.keys(); }
+
+    // Calls visit(sequence) for every stored sequence of origin above `after`,
+    // in ascending order, until visit returns false
+    void forEachSequence(NodeId origin, int after, const std::function<bool(int)>& visit) const;
+
+    int messageCount() const { return m_messageCount; }
+
+    // Approximate heap footprint in bytes
+    qint64 memoryUsage() const;
+
+private:
+    struct Slot {
+        qint64 timestampMs;
+        quint64 ackMask;        // bit i = acker i (i < 64) acknowledged
+        quint32 textOffset;     // into OriginLog::text
+        quint32 textLength;
+        NodeId destination;
+        quint32 present;        // 0 = empty slot
+    };
+
+    struct Segment {
+        Slot slots[SEGMENT_SIZE];
+    };
+
+    struct OriginLog {
+        QMap<int, Segment> segments;  // (sequence - 1) / SEGMENT_SIZE -> segment
+        QByteArray text;              // UTF-8 chat text arena
+    };
+
+    const Slot* findSlot(NodeId origin, int sequence) const;
+
+    NodeIdTable& m_nodeIds;
+    NodeMap<OriginLog> m_origins;
+    QHash<QPair<NodeId, int>, QSet<NodeId>> m_ackOverflow; // (origin, sequence) -> ackers >= 64
+
+    int m_messageCount = 0;
+};
+
+#endif // SIMPLECHAT_MESSAGESTORE_H
@@ -0,0 +1,127 @@
+#include "metrics.h"
+#include <QMutexLocker>
+#include <QStringList>
+#include <chrono>
+
+int Histogram::bucketIndex(quint64 value)
+{
+    if (value < quint64(SUB_BUCKETS)) {
+        return int(value);
+    }
+    int msb = 63;
+    while (!(value >> msb)) {
+        --msb;
+    }
+    const int shift = msb - SUB_BUCKET_BITS;
+    return (shift + 1) * SUB_BUCKETS + int((value >> shift) & (SUB_BUCKETS - 1));
+}
+
+quint64 Histogram::bucketUpperBound(int index)
+{
+    if (index < SUB_BUCKETS) {
+        return quint64(index);
+    }
+    const int shift = index / SUB_BUCKETS - 1;
+    const quint64 sub = quint64(index % SUB_BUCKETS);
+    return ((quint64(SUB_BUCKETS) + sub + 1) << shift) - 1;
+}
+
+void Histogram::record(quint64 value)
+{
+    m_buckets[bucketIndex(value)].fetch_add(1, std::memory_order_relaxed);
+    m_count.fetch_add(1, std::memory_order_relaxed);
+    m_sum.fetch_add(value, std::memory_order_relaxed);
+    quint64 seen = m_max.load(std::memory_order_relaxed);
+    while (value > seen && !m_max.compare_exchange_weak(seen, value, std::memory_order_relaxed)) {
+    }
+}
+
+quint64 Histogram::quantile(double q) const
+{
+    const quint64 total = count();
+    if (total == 0) {
+        return 0;
+    }
+    const quint64 rank = qMax<quint64>(1, quint64(q * double(total) + 0.5));
+    quint64 seen = 0;
+    for (int i = 0; i < BUCKET_COUNT; ++i) {
+        seen += m_buckets[i].load(std::memory_order_relaxed);
+        if (seen >= rank) {
+            return qMin(bucketUpperBound(i), max());
+        }
+    }
+    return max();
+}
+
+QString MetricsRegistry::seriesName(const QString& name, const QString& labels)
+{
+    return labels.isEmpty() ? name : QString("%1{%2}").arg(name, labels);
+}
+
+Counter* MetricsRegistry::counter(const QString& name, const QString& labels)
+{
+    QMutexLocker locker(&m_mutex);
+    std::unique_ptr<Counter>& slot = m_counters[seriesName(name, labels)];
+    if (!slot) {
+        slot.reset(new Counter);
+    }
+    return slot.get();
+}
+
+Histogram* MetricsRegistry::histogram(const QString& name, const QString& labels)
+{
+    QMutexLocker locker(&m_mutex);
+    std::unique_ptr<Histogram>& slot = m_histograms[seriesName(name, labels)];
+    if (!slot) {
+        slot.reset(new Histogram);
+    }
+    return slot.get();
+}
+
+void MetricsRegistry::setGauge(const QString& name, std::function<qint64()> read)
+{
+    QMutexLocker locker(&m_mutex);
+    m_gauges[name] = std::move(read);
+}
+
+QString MetricsRegistry::snapshot() const
+{
+    QMutexLocker locker(&m_mutex);
+    QStringList lines;
+    for (const auto& entry : m_counters) {
+        lines << QString("%1 %2").arg(entry.first).arg(entry.second->value());
+    }
+    for (const auto& entry : m_gauges) {
+        lines << QString("%1 %2").arg(entry.first).arg(entry.second());
+    }
+
+    // name{labels} -> name_suffix{labels}, and quantiles as an extra label
+    for (const auto& entry : m_histograms) {
+        const QString& series = entry.first;
+        const Histogram& histogram = *entry.second;
+        const int brace = series.indexOf('{');
+        const QString name = brace < 0 ? series : series.left(brace);
+        const QString labels = brace < 0 ? QString() : series.mid(brace + 1, series.size() - brace - 2);
+        auto withSuffix = [&](const char* suffix) {
+            return seriesName(name + QLatin1String(suffix), labels);
+        };
+        auto withQuantile = [&](const char* quantile) {
+            const QString label = QString("quantile=\"%1\"").arg(QLatin1String(quantile));
+            return seriesName(name, labels.isEmpty() ? label : labels + "," + label);
+        };
+        lines << QString("%1 %2").arg(withSuffix("_count")).arg(histogram.count());
+        lines << QString("%1 %2").arg(withSuffix("_sum")).arg(histogram.sum());
+        lines << QString("%1 %2").arg(withSuffix("_max")).arg(histogram.max());
+        lines << QString("%1 %2").arg(withQuantile("0.5")).arg(histogram.quantile(0.5));
+        lines << QString("%1 %2").arg(withQuantile("0.9")).arg(histogram.quantile(0.9));
+        lines << QString("%1 %2").arg(withQuantile("0.99")).arg(histogram.quantile(0.99));
+        lines << QString("%1 %2").arg(withQuantile("0.999")).arg(histogram.quantile(0.999));
+    }
+    return lines.join('\n') + '\n';
+}
+
+quint64 MetricsRegistry::nowNs()
+{
+    return quint64(std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count());
+}
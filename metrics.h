@@ -0,0 +1,81 @@
+#ifndef SIMPLECHAT_METRICS_H
+#define SIMPLECHAT_METRICS_H
+
+#include <QMutex>
+#include <QString>
+#include <atomic>
+#include <functional>
+#include <map>
+#include <memory>
+
+// Monotonic event count. Updates are single relaxed atomic adds, so any
+// thread may bump or read one without locking.
+class Counter
+{
+public:
+    void add(quint64 n = 1) { m_value.fetch_add(n, std::memory_order_relaxed); }
+    quint64 value() const { return m_value.load(std::memory_order_relaxed); }
+
+private:
+    std::atomic<quint64> m_value{0};
+};
+
+// HDR-style log-linear histogram: values below SUB_BUCKETS are exact, above
+// that each power of two is split into SUB_BUCKETS equal buckets (about 6%
+// relative error). Recording is a handful of relaxed atomic adds.
+class Histogram
+{
+public:
+    void record(quint64 value);
+
+    quint64 count() const { return m_count.load(std::memory_order_relaxed); }
+    quint64 sum() const { return m_sum.load(std::memory_order_relaxed); }
+    quint64 max() const { return m_max.load(std::memory_order_relaxed); }
+    // Upper bound of the bucket holding the q-quantile (0 <= q <= 1); 0 if empty
+    quint64 quantile(double q) const;
+
+    static const int SUB_BUCKET_BITS = 4;
+    static const int SUB_BUCKETS = 1 << SUB_BUCKET_BITS;
+    static const int BUCKET_COUNT = (64 - SUB_BUCKET_BITS + 1) * SUB_BUCKETS;
+
+private:
+    static int bucketIndex(quint64 value);
+    static quint64 bucketUpperBound(int index);
+
+    std::atomic<quint64> m_buckets[BUCKET_COUNT] = {};
+    std::atomic<quint64> m_count{0};
+    std::atomic<quint64> m_sum{0};
+    std::atomic<quint64> m_max{0};
+};
+
+// Named counters, histograms and gauges of one node. Series are created once
+// (callers keep the returned pointer, which stays valid for the registry's
+// lifetime) and then updated lock-free; the mutex only guards creation and
+// snapshots. Gauges are read by callback when a snapshot is taken, so the
+// snapshot must be taken on the thread that owns what they read.
+//
+// Names follow the Prometheus text format: name{label="value"}.
+class MetricsRegistry
+{
+public:
+    Counter* counter(const QString& name, const QString& labels = QString());
+    Histogram* histogram(const QString& name, const QString& labels = QString());
+    void setGauge(const QString& name, std::function<qint64()> read);
+
+    // One "series value" line per counter and gauge; histograms expand to
+    // _count, _sum, _max and p50/p90/p99/p999 lines
+    QString snapshot() const;
+
+    // Steady clock for timing dispatch, independent of any simulated clock
+    static quint64 nowNs();
+
+private:
+    static QString seriesName(const QString& name, const QString& labels);
+
+    mutable QMutex m_mutex;
+    std::map<QString, std::unique_ptr<Counter>> m_counters;
+    std::map<QString, std::unique_ptr<Histogram>> m_histograms;
+    std::map<QString, std::function<qint64()>> m_gauges;
+};
+
+#endif // SIMPLECHAT_METRICS_H
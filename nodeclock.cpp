@@ -0,0 +1,41 @@
+#include "nodeclock.h"
+#include <QDateTime>
+#include <QTimer>
+
+qint64 SystemClock::currentMSecsSinceEpoch() const
+{
+    return QDateTime::currentMSecsSinceEpoch();
+}
+
+NodeTimer* SystemClock::createTimer(QObject* parent)
+{
+    return new SystemTimer(parent);
+}
+
+SystemTimer::SystemTimer(QObject *parent)
+    : NodeTimer(parent)
+    , m_timer(new QTimer(this))
+{
+    connect(m_timer, &QTimer::timeout, this, &NodeTimer::timeout);
+}
+
+void SystemTimer::start(int msec)
+{
+    m_timer->setSingleShot(m_singleShot);
+    m_timer->start(msec);
+}
+
+void SystemTimer::stop()
+{
+    m_timer->stop();
+}
+
+bool SystemTimer::isActive() const
+{
+    return m_timer->isActive();
+}
+
+int SystemTimer::remainingTime() const
+{
+    return m_timer->remainingTime();
+}
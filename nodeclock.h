@@ -0,0 +1,77 @@
+#ifndef SIMPLECHAT_NODECLOCK_H
+#define SIMPLECHAT_NODECLOCK_H
+
+#include <QObject>
+#include <QElapsedTimer>
+
+class QTimer;
+
+// Timer created by a NodeClock; same contract as the QTimer subset the node
+// uses (interval restarts on start(), single-shot timers stop after firing)
+class NodeTimer : public QObject
+{
+    Q_OBJECT
+
+public:
+    explicit NodeTimer(QObject *parent = nullptr) : QObject(parent) {}
+
+    virtual void start(int msec) = 0;
+    virtual void stop() = 0;
+    virtual bool isActive() const = 0;
+    // Milliseconds until the next timeout, -1 if inactive
+    virtual int remainingTime() const = 0;
+    void setSingleShot(bool singleShot) { m_singleShot = singleShot; }
+    bool isSingleShot() const { return m_singleShot; }
+
+signals:
+    void timeout();
+
+protected:
+    bool m_singleShot = false;
+};
+
+// Time source for the node engine. SystemClock is real time; the simulator
+// drives many nodes from one deterministic virtual clock.
+class NodeClock
+{
+public:
+    virtual ~NodeClock() = default;
+
+    // Monotonic milliseconds since an arbitrary origin
+    virtual qint64 elapsed() const = 0;
+    // Wall clock, for the Timestamp field
+    virtual qint64 currentMSecsSinceEpoch() const = 0;
+    virtual NodeTimer* createTimer(QObject* parent) = 0;
+};
+
+class SystemClock : public NodeClock
+{
+public:
+    SystemClock() { m_clock.start(); }
+
+    qint64 elapsed() const override { return m_clock.elapsed(); }
+    qint64 currentMSecsSinceEpoch() const override;
+    NodeTimer* createTimer(QObject* parent) override;
+
+private:
+    QElapsedTimer m_clock;
+};
+
+// NodeTimer backed by a QTimer
+class SystemTimer : public NodeTimer
+{
+    Q_OBJECT
+
+public:
+    explicit SystemTimer(QObject *parent = nullptr);
+
+    void start(int msec) override;
+    void stop() override;
+    bool isActive() const override;
+    int remainingTime() const override;
+
+private:
+    QTimer* m_timer;
+};
+
+#endif // SIMPLECHAT_NODECLOCK_H
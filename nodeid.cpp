@@ -0,0 +1,26 @@
+#include "nodeid.h"
+
+bool NodeIdTable::isValidName(const QString& name)
+{
+    if (name.isEmpty() || name.size() > MAX_NAME_LENGTH) {
+        return false;
+    }
+    for (const QChar ch : name) {
+        if (ch.category() == QChar::Other_Control) {
+            return false;
+        }
+    }
+    return true;
+}
+
+NodeId NodeIdTable::intern(const QString& name)
+{
+    auto it = m_ids.constFind(name);
+    if (it != m_ids.constEnd()) {
+        return it.value();
+    }
+    NodeId id = NodeId(m_names.size());
+    m_names.append(name);
+    m_ids.insert(name, id);
+    return id;
+}
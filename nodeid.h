@@ -0,0 +1,105 @@
+#ifndef SIMPLECHAT_NODEID_H
+#define SIMPLECHAT_NODEID_H
+
+#include <QHash>
+#include <QString>
+#include <QVector>
+
+// Dense integer handle for a node name (client ID). Internal tables are keyed
+// by NodeId; names are only needed on the wire and at the UI edge.
+using NodeId = quint32;
+static const NodeId INVALID_NODE_ID = 0xFFFFFFFFu;
+
+// Interning table: name <-> NodeId. IDs are assigned 0, 1, 2, ... in order of
+// first appearance and never reused, so they can index flat arrays. Since an
+// ID lives as long as the table, names from the wire are interned only once
+// they pass isValidName() and are about to be stored, routed or made a peer;
+// everything else is looked up with find().
+class NodeIdTable
+{
+public:
+    static const int MAX_NAME_LENGTH = 64;
+
+    // Non-empty, at most MAX_NAME_LENGTH characters, no control characters
+    static bool isValidName(const QString& name);
+
+    NodeId intern(const QString& name);
+    NodeId find(const QString& name) const { return m_ids.value(name, INVALID_NODE_ID); }
+    const QString& name(NodeId id) const { return m_names[int(id)]; }
+    int size() const { return m_names.size(); }
+
+private:
+    QHash<QString, NodeId> m_ids;
+    QVector<QString> m_names;
+};
+
+// Map from NodeId to T stored as a flat array indexed by ID. Lookups are an
+// index and a presence check; memory grows with the highest ID stored.
+template <typename T>
+class NodeMap
+{
+public:
+    bool contains(NodeId id) const { return id < NodeId(m_present.size()) && m_present[int(id)]; }
+
+    T* find(NodeId id) { return contains(id) ? &m_values[int(id)] : nullptr; }
+    const T* find(NodeId id) const { return contains(id) ? &m_values[int(id)] : nullptr; }
+
+    T value(NodeId id, const T& defaultValue = T()) const
+    {
+        return contains(id) ? m_values[int(id)] : defaultValue;
+    }
+
+    // Inserts a default-constructed value if absent
+    T& operator[](NodeId id)
+    {
+        if (id >= NodeId(m_present.size())) {
+            m_values.resize(int(id) + 1);
+            m_present.resize(int(id) + 1);
+        }
+        if (!m_present[int(id)]) {
+            m_present[int(id)] = true;
+            ++m_count;
+        }
+        return m_values[int(id)];
+    }
+
+    bool remove(NodeId id)
+    {
+        if (!contains(id)) {
+            return false;
+        }
+        m_present[int(id)] = false;
+        m_values[int(id)] = T();
+        --m_count;
+        return true;
+    }
+
+    int size() const { return m_count; }
+    bool isEmpty() const { return m_count == 0; }
+
+    // Calls visit(id, value) for every entry in ID order
+    template <typename Visitor>
+    void forEach(Visitor visit) const
+    {
+        for (int i = 0; i < m_present.size(); ++i) {
+            if (m_present[i]) {
+                visit(NodeId(i), m_values[i]);
+            }
+        }
+    }
+
+    QVector<NodeId> keys() const
+    {
+        QVector<NodeId> result;
+        result.reserve(m_count);
+        forEach([&result](NodeId id, const T&) { result.append(id); });
+        return result;
+    }
+
+private:
+    QVector<T> m_values;
+    QVector<bool> m_present;
+    int m_count = 0;
+};
+
+#endif // SIMPLECHAT_NODEID_H
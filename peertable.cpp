@@ -0,0 +1,82 @@
+#include "peertable.h"
+#include <iterator>
+
+const PeerInfo* PeerTable::findByEndpoint(const QHostAddress& addr, quint16 port) const
+{
+    auto it = m_endpoints.constFind(qMakePair(addr, port));
+    return it == m_endpoints.constEnd() ? nullptr : find(it.value());
+}
+
+bool PeerTable::insert(const PeerInfo& info)
+{
+    if (m_peers.contains(info.nodeId)) {
+        return false;
+    }
+    m_peers[info.nodeId] = info;
+    // A later peer at the same endpoint (e.g. a restarted node with a new ID) takes it over
+    m_endpoints.insert(qMakePair(info.address, info.port), info.nodeId);
+    m_expiryQueue.push_back(info.nodeId);
+    m_expiryPosition[info.nodeId] = std::prev(m_expiryQueue.end());
+    return true;
+}
+
+bool PeerTable::remove(NodeId id)
+{
+    const PeerInfo* peer = m_peers.find(id);
+    if (!peer) {
+        return false;
+    }
+    const Endpoint endpoint = qMakePair(peer->address, peer->port);
+    auto owner = m_endpoints.find(endpoint);
+    if (owner != m_endpoints.end() && owner.value() == id) {
+        m_endpoints.erase(owner);
+    }
+    m_expiryQueue.erase(*m_expiryPosition.find(id));
+    m_expiryPosition.remove(id);
+    m_peers.remove(id);
+    return true;
+}
+
+bool PeerTable::touch(const QHostAddress& addr, quint16 port, qint64 nowMs)
+{
+    auto endpoint = m_endpoints.constFind(qMakePair(addr, port));
+    if (endpoint == m_endpoints.constEnd()) {
+        return false;
+    }
+    const NodeId id = endpoint.value();
+    m_peers[id].lastSeenMs = nowMs;
+
+    // Move to the back of the expiry queue without reallocating the node
+    m_expiryQueue.splice(m_expiryQueue.end(), m_expiryQueue, *m_expiryPosition.find(id));
+    return true;
+}
+
+QList<PeerInfo> PeerTable::expire(qint64 nowMs, qint64 timeoutMs)
+{
+    QList<PeerInfo> expired;
+    while (!m_expiryQueue.empty()) {
+        const PeerInfo* peer = m_peers.find(m_expiryQueue.front());
+        if (nowMs - peer->lastSeenMs <= timeoutMs) {
+            break;
+        }
+        expired.append(*peer);
+        remove(peer->nodeId);
+    }
+    return expired;
+}
+
+QList<PeerInfo> PeerTable::values() const
+{
+    QList<PeerInfo> result;
+    result.reserve(m_peers.size());
+    m_peers.forEach([&result](NodeId, const PeerInfo& peer) { result.append(peer); });
+    return result;
+}
+
+QStringList PeerTable::names() const
+{
+    QStringList result;
+    result.reserve(m_peers.size());
+    m_peers.forEach([&result](NodeId, const PeerInfo& peer) { result.append(peer.peerId); });
+    return result;
+}
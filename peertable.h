@@ -0,0 +1,58 @@
+#ifndef SIMPLECHAT_PEERTABLE_H
+#define SIMPLECHAT_PEERTABLE_H
+
+#include <QHash>
+#include <QList>
+#include <QPair>
+#include <QStringList>
+#include <QtNetwork/QHostAddress>
+#include <list>
+#include "nodeid.h"
+
+// Known peer
+struct PeerInfo {
+    QHostAddress address;
+    quint16 port;
+    qint64 lastSeenMs;   // Monotonic time of the last datagram from this peer
+    NodeId nodeId;
+    QString peerId;      // Name, for logs and the UI
+};
+
+// Peer table indexed both by node ID and by (address, port).
+//
+// Peers are also threaded onto an expiry queue ordered by lastSeenMs: touch()
+// moves a peer to the back, so the peers that went quiet longest are always at
+// the front and expire() stops at the first one still alive. Lookup, touch and
+// expiry of one peer are O(1) regardless of table size.
+class PeerTable
+{
+public:
+    using Endpoint = QPair<QHostAddress, quint16>;
+
+    bool contains(NodeId id) const { return m_peers.contains(id); }
+    const PeerInfo* find(NodeId id) const { return m_peers.find(id); }
+    const PeerInfo* findByEndpoint(const QHostAddress& addr, quint16 port) const;
+
+    // Adds a peer; returns false (and changes nothing) if the ID is known
+    bool insert(const PeerInfo& info);
+    bool remove(NodeId id);
+
+    // Refresh the peer at this endpoint; returns false for unknown endpoints
+    bool touch(const QHostAddress& addr, quint16 port, qint64 nowMs);
+
+    // Removes and returns the peers not seen for more than timeoutMs
+    QList<PeerInfo> expire(qint64 nowMs, qint64 timeoutMs);
+
+    QList<PeerInfo> values() const;
+    QStringList names() const;
+    int size() const { return m_peers.size(); }
+    bool isEmpty() const { return m_peers.isEmpty(); }
+
+private:
+    NodeMap<PeerInfo> m_peers;              // nodeId -> peer
+    QHash<Endpoint, NodeId> m_endpoints;    // (address, port) -> nodeId
+    std::list<NodeId> m_expiryQueue;        // nodeIds, least recently seen first
+    NodeMap<std::list<NodeId>::iterator> m_expiryPosition; // nodeId -> node in m_expiryQueue
+};
+
+#endif // SIMPLECHAT_PEERTABLE_H
@@ -0,0 +1,184 @@
+#include "receiveworker.h"
+#include "wireformat.h"
+#include <QReadLocker>
+#include <QThread>
+#include <QWriteLocker>
+
+void SharedRouteTable::publish(const QString& origin, int sequence)
+{
+    QWriteLocker locker(&m_lock);
+    m_sequences.insert(origin, sequence);
+}
+
+int SharedRouteTable::sequence(const QString& origin) const
+{
+    QReadLocker locker(&m_lock);
+    return m_sequences.value(origin, 0);
+}
+
+namespace {
+
+// What the node needs from an announcement with nothing new: the fields that
+// refresh the sender's peer entry and NAT endpoint
+QVariantMap senderOnly(const QVariantMap& message)
+{
+    QVariantMap stripped;
+    for (const char* key : {"Origin", "LastIP", "LastPort"}) {
+        auto it = message.constFind(QString::fromLatin1(key));
+        if (it != message.constEnd()) {
+            stripped.insert(it.key(), it.value());
+        }
+    }
+    return stripped;
+}
+
+} // namespace
+
+ReceiveWorker::ReceiveWorker(const QString& clientId, int port, const SharedRouteTable* routes)
+    : m_clientId(clientId)
+    , m_port(port)
+    , m_routes(routes)
+    , m_socket(nullptr)
+{
+}
+
+QVariantMap ReceiveWorker::discoveryResponse(const QString& clientId, int port, const QHostAddress& localAddress)
+{
+    QVariantMap response;
+    response["Type"] = "discovery_response";
+    response["Origin"] = clientId;
+    response["Port"] = port;
+    response["LastIP"] = localAddress.toString();
+    response["LastPort"] = port;
+    response["Wire"] = WireFormat::WIRE_LEVEL;
+    return response;
+}
+
+bool ReceiveWorker::bind()
+{
+    m_socket = new DatagramSocket(this);
+    if (!m_socket->bind(quint16(m_port), true)) {
+        m_errorString = m_socket->errorString();
+        return false;
+    }
+    m_socket->setReceiveHandler([this](char* data, int size, const QHostAddress& sender, quint16 senderPort) {
+        processDatagram(data, size, sender, senderPort);
+    });
+    return true;
+}
+
+void ReceiveWorker::processDatagram(const char* data, int size, const QHostAddress& sender, quint16 senderPort)
+{
+    ReceivedDatagram received;
+    received.message = WireFormat::decode(data, size);
+    received.sender = sender;
+    received.senderPort = senderPort;
+    received.bytes = size;
+    received.compact = WireFormat::isCompact(data, size);
+    if (received.message.isEmpty() && !received.compact) {
+        return;
+    }
+
+    const QString type = received.message.value("Type").toString();
+    received.type = type;
+    if (type == "discovery") {
+        const QVariantMap response = discoveryResponse(m_clientId, m_port, m_socket->localAddress());
+        QByteArray reply;
+        if (received.compact || received.message.value("Wire").toInt() >= WireFormat::COMPACT_VERSION) {
+            reply = WireFormat::encodeCompact(response);
+        }
+        if (reply.isEmpty()) {
+            reply = WireFormat::encodeLegacy(response);
+        }
+        m_socket->writeDatagram(reply, sender, senderPort);
+        received.answered = true;
+    } else if (type == "route_rumor") {
+        const QString origin = received.message.value("Origin").toString();
+        if (received.message.value("SeqNo").toInt() <= m_routes->sequence(origin)) {
+            received.message = senderOnly(received.message);
+        }
+    } else if (type == "route_update") {
+        // Equal sequences stay: they may carry a shorter path
+        const QVariantList routes = received.message.value("Routes").toList();
+        QVariantList fresh;
+        for (const QVariant& entry : routes) {
+            const QVariantList fields = entry.toList();
+            if (fields.size() == 3 && fields[1].toInt() < m_routes->sequence(fields[0].toString())) {
+                continue;
+            }
+            fresh.append(entry);
+        }
+        if (fresh.isEmpty()) {
+            received.message = senderOnly(received.message);
+        } else if (fresh.size() < routes.size()) {
+            received.message["Routes"] = fresh;
+        }
+    }
+
+    // Everything drained in this notifier callback goes out as one batch
+    if (m_batch.isEmpty()) {
+        QMetaObject::invokeMethod(this, &ReceiveWorker::flush, Qt::QueuedConnection);
+    }
+    m_batch.append(received);
+}
+
+void ReceiveWorker::flush()
+{
+    QVector<ReceivedDatagram> batch;
+    batch.swap(m_batch);
+    if (!batch.isEmpty()) {
+        emit datagramsReceived(batch);
+    }
+}
+
+ReceiveWorkerPool::ReceiveWorkerPool(QObject *parent)
+    : QObject(parent)
+{
+}
+
+ReceiveWorkerPool::~ReceiveWorkerPool()
+{
+    stop();
+}
+
+int ReceiveWorkerPool::start(int count, const QString& clientId, int port, const SharedRouteTable* routes)
+{
+    for (int i = 0; i < count; ++i) {
+        QThread* thread = new QThread(this);
+        thread->setObjectName(QString("recv-%1").arg(i + 1));
+        ReceiveWorker* worker = new ReceiveWorker(clientId, port, routes);
+        worker->moveToThread(thread);
+        connect(thread, &QThread::finished, worker, &QObject::deleteLater);
+        thread->start();
+
+        // The socket must be created on the worker's thread
+        bool bound = false;
+        QMetaObject::invokeMethod(worker, &ReceiveWorker::bind, Qt::BlockingQueuedConnection, &bound);
+        if (!bound) {
+            m_errorString = worker->errorString();
+            thread->quit();
+            thread->wait();
+            delete thread;
+            continue;
+        }
+
+        connect(worker, &ReceiveWorker::datagramsReceived, this, &ReceiveWorkerPool::datagramsReceived);
+        m_threads.append(thread);
+        m_workers.append(worker);
+    }
+    return m_workers.size();
+}
+
+void ReceiveWorkerPool::stop()
+{
+    // Workers (and their sockets) are deleted on their own threads
+    for (QThread* thread : m_threads) {
+        thread->quit();
+    }
+    for (QThread* thread : m_threads) {
+        thread->wait();
+        delete thread;
+    }
+    m_threads.clear();
+    m_workers.clear();
+}
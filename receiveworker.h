@@ -0,0 +1,114 @@
+#ifndef SIMPLECHAT_RECEIVEWORKER_H
+#define SIMPLECHAT_RECEIVEWORKER_H
+
+#include <QObject>
+#include <QHash>
+#include <QList>
+#include <QMetaType>
+#include <QPair>
+#include <QReadWriteLock>
+#include <QVariantMap>
+#include <QVector>
+#include <QtNetwork/QHostAddress>
+#include "datagramsocket.h"
+
+class QThread;
+
+// Highest DSDV sequence the node has seen per destination. Written only by
+// the node thread, read by every receive worker to drop stale route entries
+// before they reach the node; readers never block each other. Like the
+// node's own table it only grows: a lost route is published at its newer
+// (odd) sequence, never removed.
+class SharedRouteTable
+{
+public:
+    void publish(const QString& origin, int sequence);
+    // 0 if the origin is unknown
+    int sequence(const QString& origin) const;
+
+private:
+    mutable QReadWriteLock m_lock;
+    QHash<QString, int> m_sequences;
+};
+
+// One datagram decoded by a worker, handed to the node thread
+struct ReceivedDatagram {
+    QVariantMap message;
+    QHostAddress sender;
+    quint16 senderPort = 0;
+    QString type;           // Type as received; message may have been stripped
+    int bytes = 0;          // Datagram size on the wire
+    bool compact = false;   // Arrived in the compact wire format
+    bool answered = false;  // The worker already sent the discovery response
+};
+Q_DECLARE_METATYPE(ReceivedDatagram)
+
+// Receive shard: one SO_REUSEPORT socket on its own thread. The kernel hashes
+// each sender to a fixed socket, so a worker sees every datagram of the peers
+// in its shard. It keeps no per-peer state: a discovery is answered in the
+// wire format the discovery itself shows the sender speaks.
+//
+// Decoding happens here. Discovery requests are answered straight from this
+// socket, stale entries are dropped from route updates and a route rumor or
+// update with nothing new is reduced to its Origin (the node still refreshes
+// the sender); everything else is passed on unchanged, one batch per socket
+// drain.
+class ReceiveWorker : public QObject
+{
+    Q_OBJECT
+
+public:
+    ReceiveWorker(const QString& clientId, int port, const SharedRouteTable* routes);
+
+    // The discovery_response every node sends; shared with SimpleChatNode
+    static QVariantMap discoveryResponse(const QString& clientId, int port, const QHostAddress& localAddress);
+
+    QString errorString() const { return m_errorString; }
+
+public slots:
+    bool bind();
+
+signals:
+    void datagramsReceived(const QVector<ReceivedDatagram>& batch);
+
+private slots:
+    void flush();
+
+private:
+    void processDatagram(const char* data, int size, const QHostAddress& sender, quint16 senderPort);
+
+    QString m_clientId;
+    int m_port;
+    const SharedRouteTable* m_routes;
+    DatagramSocket* m_socket;
+    QString m_errorString;
+    QVector<ReceivedDatagram> m_batch;
+};
+
+// N-1 receive workers on their own threads, sharing the node's port. The
+// node's own socket is the remaining shard and keeps handling every send.
+class ReceiveWorkerPool : public QObject
+{
+    Q_OBJECT
+
+public:
+    explicit ReceiveWorkerPool(QObject *parent = nullptr);
+    ~ReceiveWorkerPool();
+
+    // Starts count workers; returns how many could bind (errors in errorString())
+    int start(int count, const QString& clientId, int port, const SharedRouteTable* routes);
+    void stop();
+
+    int size() const { return m_workers.size(); }
+    QString errorString() const { return m_errorString; }
+
+signals:
+    void datagramsReceived(const QVector<ReceivedDatagram>& batch);
+
+private:
+    QList<QThread*> m_threads;
+    QList<ReceiveWorker*> m_workers;
+    QString m_errorString;
+};
+
+#endif // SIMPLECHAT_RECEIVEWORKER_H
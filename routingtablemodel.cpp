@@ -0,0 +1,134 @@
+#include "routingtablemodel.h"
+
+RoutingTableModel::RoutingTableModel(SimpleChatNode* node, QObject* parent)
+    : QAbstractTableModel(parent)
+    , m_firstDirtyRow(-1)
+    , m_lastDirtyRow(-1)
+    , m_repaintTimer(new QTimer(this))
+{
+    m_repaintTimer->setSingleShot(true);
+    connect(m_repaintTimer, &QTimer::timeout, this, &RoutingTableModel::flushChangedRows);
+    connect(node, &SimpleChatNode::routeChanged, this, &RoutingTableModel::onRouteChanged);
+    connect(node, &SimpleChatNode::routeRemoved, this, &RoutingTableModel::onRouteRemoved);
+}
+
+int RoutingTableModel::rowCount(const QModelIndex& parent) const
+{
+    return parent.isValid() ? 0 : m_destinations.size();
+}
+
+int RoutingTableModel::columnCount(const QModelIndex& parent) const
+{
+    return parent.isValid() ? 0 : ColumnCount;
+}
+
+QVariant RoutingTableModel::data(const QModelIndex& index, int role) const
+{
+    if (!index.isValid() || index.row() >= m_destinations.size()) {
+        return QVariant();
+    }
+    const QString& destination = m_destinations[index.row()];
+    if (role == Qt::EditRole) {
+        return destination;
+    }
+    if (role != Qt::DisplayRole && role != Qt::ToolTipRole) {
+        return QVariant();
+    }
+
+    const RouteEntry& route = m_routes[index.row()];
+    switch (index.column()) {
+    case NodeColumn:
+        return destination;
+    case SequenceColumn:
+        return route.sequenceNumber;
+    case HopsColumn:
+        return route.hopCount;
+    case FlagsColumn: {
+        QStringList flags;
+        if (route.isDirect) {
+            flags << "D";
+        }
+        if (!route.publicIP.isNull()) {
+            flags << "NAT";
+        }
+        return flags.join(' ');
+    }
+    default:
+        return QVariant();
+    }
+}
+
+QVariant RoutingTableModel::headerData(int section, Qt::Orientation orientation, int role) const
+{
+    if (orientation != Qt::Horizontal || role != Qt::DisplayRole) {
+        return QAbstractTableModel::headerData(section, orientation, role);
+    }
+    switch (section) {
+    case NodeColumn:
+        return "Node";
+    case SequenceColumn:
+        return "Seq";
+    case HopsColumn:
+        return "Hops";
+    case FlagsColumn:
+        return "Flags";
+    default:
+        return QVariant();
+    }
+}
+
+void RoutingTableModel::onRouteChanged(const QString& destination, const RouteEntry& route)
+{
+    auto it = m_rows.constFind(destination);
+    if (it == m_rows.constEnd()) {
+        int row = m_destinations.size();
+        beginInsertRows(QModelIndex(), row, row);
+        m_rows.insert(destination, row);
+        m_destinations.append(destination);
+        m_routes.append(route);
+        endInsertRows();
+        return;
+    }
+
+    // Known row: widen the pending range and repaint it once the interval ends
+    int row = it.value();
+    m_routes[row] = route;
+    m_firstDirtyRow = m_firstDirtyRow < 0 ? row : qMin(m_firstDirtyRow, row);
+    m_lastDirtyRow = qMax(m_lastDirtyRow, row);
+    if (!m_repaintTimer->isActive()) {
+        m_repaintTimer->start(REPAINT_INTERVAL);
+    }
+}
+
+void RoutingTableModel::onRouteRemoved(const QString& destination)
+{
+    auto it = m_rows.find(destination);
+    if (it == m_rows.end()) {
+        return;
+    }
+    int row = it.value();
+    beginRemoveRows(QModelIndex(), row, row);
+    m_rows.erase(it);
+    m_destinations.removeAt(row);
+    m_routes.removeAt(row);
+    for (int i = row; i < m_destinations.size(); ++i) {
+        m_rows[m_destinations[i]] = i;
+    }
+    endRemoveRows();
+
+    // Keep the pending range inside the table
+    if (m_firstDirtyRow >= m_destinations.size()) {
+        m_firstDirtyRow = m_lastDirtyRow = -1;
+    } else if (m_lastDirtyRow >= m_destinations.size()) {
+        m_lastDirtyRow = m_destinations.size() - 1;
+    }
+}
+
+void RoutingTableModel::flushChangedRows()
+{
+    if (m_firstDirtyRow < 0) {
+        return;
+    }
+    emit dataChanged(index(m_firstDirtyRow, 0), index(m_lastDirtyRow, ColumnCount - 1));
+    m_firstDirtyRow = m_lastDirtyRow = -1;
+}
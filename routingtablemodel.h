@@ -0,0 +1,51 @@
+#ifndef SIMPLECHAT_ROUTINGTABLEMODEL_H
+#define SIMPLECHAT_ROUTINGTABLEMODEL_H
+
+#include <QAbstractTableModel>
+#include <QHash>
+#include <QStringList>
+#include <QTimer>
+#include <QVector>
+#include "simplechatnode.h"
+
+// Table model over a node's routing table: one row per destination, in the
+// order destinations were first learned. Follows the node's routeChanged /
+// routeRemoved signals incrementally: new destinations insert a row, removed
+// ones remove it, and updates to known rows are collected and reported as a
+// single dataChanged() per repaint interval instead of one per packet.
+//
+// Rows hold the route copies carried by the signals, so the model never reads
+// the node directly and works while the node runs on another thread.
+class RoutingTableModel : public QAbstractTableModel
+{
+    Q_OBJECT
+
+public:
+    enum Column { NodeColumn, SequenceColumn, HopsColumn, FlagsColumn, ColumnCount };
+
+    explicit RoutingTableModel(SimpleChatNode* node, QObject* parent = nullptr);
+
+    int rowCount(const QModelIndex& parent = QModelIndex()) const override;
+    int columnCount(const QModelIndex& parent = QModelIndex()) const override;
+    QVariant data(const QModelIndex& index, int role = Qt::DisplayRole) const override;
+    QVariant headerData(int section, Qt::Orientation orientation, int role = Qt::DisplayRole) const override;
+
+    QString destinationAt(int row) const { return m_destinations.value(row); }
+
+    static const int REPAINT_INTERVAL = 100;  // ms between batched dataChanged() emissions
+
+private slots:
+    void onRouteChanged(const QString& destination, const RouteEntry& route);
+    void onRouteRemoved(const QString& destination);
+    void flushChangedRows();
+
+private:
+    QStringList m_destinations;         // row -> destination
+    QVector<RouteEntry> m_routes;       // row -> last route received
+    QHash<QString, int> m_rows;         // destination -> row
+    int m_firstDirtyRow;                // Pending dataChanged() range, or -1
+    int m_lastDirtyRow;
+    QTimer* m_repaintTimer;
+};
+
+#endif // SIMPLECHAT_ROUTINGTABLEMODEL_H
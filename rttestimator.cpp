@@ -0,0 +1,29 @@
+#include "rttestimator.h"
+
+void RttEstimator::addSample(qint64 rttMs)
+{
+    rttMs = qMax<qint64>(0, rttMs);
+    if (m_samples++ == 0) {
+        // SRTT = R, RTTVAR = R / 2
+        m_srtt8 = rttMs << 3;
+        m_rttvar4 = rttMs << 1;
+        return;
+    }
+
+    // SRTT += (R - SRTT) / 8; RTTVAR += (|R - SRTT| - RTTVAR) / 4
+    qint64 delta = rttMs - (m_srtt8 >> 3);
+    m_srtt8 += delta;
+    if (delta < 0) {
+        delta = -delta;
+    }
+    m_rttvar4 += delta - (m_rttvar4 >> 2);
+}
+
+int RttEstimator::rto(int minMs, int maxMs, int initialMs) const
+{
+    if (!hasSample()) {
+        return initialMs;
+    }
+    const qint64 timeout = srtt() + qMax<qint64>(1, m_rttvar4);
+    return int(qBound<qint64>(minMs, timeout, maxMs));
+}
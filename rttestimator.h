@@ -0,0 +1,34 @@
+#ifndef SIMPLECHAT_RTTESTIMATOR_H
+#define SIMPLECHAT_RTTESTIMATOR_H
+
+#include <QtGlobal>
+
+// Smoothed round-trip time to one peer (RFC 6298). SRTT and RTTVAR are
+// exponentially weighted moving averages with gains 1/8 and 1/4, kept in
+// fixed point (SRTT x 8, RTTVAR x 4) as in Jacobson's original code, and the
+// retransmission timeout is SRTT + max(1 ms, 4 * RTTVAR).
+//
+// Samples must only come from messages that were sent once (Karn's
+// algorithm): the ack of a retransmitted message does not say which copy it
+// answers.
+class RttEstimator
+{
+public:
+    void addSample(qint64 rttMs);
+
+    bool hasSample() const { return m_samples > 0; }
+    quint64 samples() const { return m_samples; }
+    qint64 srtt() const { return m_srtt8 >> 3; }
+    qint64 rttvar() const { return m_rttvar4 >> 2; }
+
+    // Timeout for a first transmission, clamped to [minMs, maxMs]; initialMs
+    // until the first sample arrives
+    int rto(int minMs, int maxMs, int initialMs) const;
+
+private:
+    qint64 m_srtt8 = 0;
+    qint64 m_rttvar4 = 0;
+    quint64 m_samples = 0;
+};
+
+#endif // SIMPLECHAT_RTTESTIMATOR_H
@@ -0,0 +1,91 @@
+#include "seencache.h"
+#include <QHash>
+
+namespace {
+
+quint64 mix(quint64 x)
+{
+    // splitmix64 finalizer
+    x ^= x >> 30;
+    x *= 0xBF58476D1CE4E5B9ULL;
+    x ^= x >> 27;
+    x *= 0x94D049BB133111EBULL;
+    x ^= x >> 31;
+    return x;
+}
+
+} // namespace
+
+SeenCache::SeenCache(int capacity, qint64 windowMs)
+    : m_capacity(qMax(1, capacity))
+    , m_windowMs(qMax<qint64>(2, windowMs))
+{
+    quint64 bits = 64;
+    while (bits < quint64(m_capacity) * BITS_PER_KEY) {
+        bits <<= 1;
+    }
+    m_mask = bits - 1;
+    m_current.fill(0, int(bits / 64));
+    m_previous.fill(0, int(bits / 64));
+}
+
+quint64 SeenCache::key(quint8 kind, const QString& origin, qint64 sequence)
+{
+    return mix(quint64(qHash(origin)) ^ mix(quint64(sequence) * 0x9E3779B97F4A7C15ULL + kind));
+}
+
+bool SeenCache::test(const QVector<quint64>& bits, quint64 mask, quint64 key)
+{
+    // Double hashing: probe i is key + i * step
+    const quint64 step = mix(key) | 1;
+    for (int i = 0; i < PROBES; ++i) {
+        const quint64 bit = (key + quint64(i) * step) & mask;
+        if (!(bits[int(bit >> 6)] & (quint64(1) << (bit & 63)))) {
+            return false;
+        }
+    }
+    return true;
+}
+
+void SeenCache::rotateIfDue(qint64 nowMs)
+{
+    const qint64 age = nowMs - m_rotatedAtMs;
+    if (age >= m_windowMs) {
+        // Idle for a whole window: nothing is worth keeping
+        m_current.fill(0);
+        m_previous.fill(0);
+        m_currentKeys = 0;
+        m_rotatedAtMs = nowMs;
+    } else if (age >= m_windowMs / 2 || m_currentKeys >= m_capacity) {
+        m_previous.swap(m_current);
+        m_current.fill(0);
+        m_currentKeys = 0;
+        m_rotatedAtMs = nowMs;
+    }
+}
+
+bool SeenCache::contains(quint64 key, qint64 nowMs)
+{
+    rotateIfDue(nowMs);
+    return test(m_current, m_mask, key) || test(m_previous, m_mask, key);
+}
+
+void SeenCache::insert(quint64 key, qint64 nowMs)
+{
+    rotateIfDue(nowMs);
+    const quint64 step = mix(key) | 1;
+    for (int i = 0; i < PROBES; ++i) {
+        const quint64 bit = (key + quint64(i) * step) & m_mask;
+        m_current[int(bit >> 6)] |= quint64(1) << (bit & 63);
+    }
+    ++m_currentKeys;
+}
+
+bool SeenCache::testAndInsert(quint64 key, qint64 nowMs)
+{
+    if (contains(key, nowMs)) {
+        return true;
+    }
+    insert(key, nowMs);
+    return false;
+}
@@ -0,0 +1,48 @@
+#ifndef SIMPLECHAT_SEENCACHE_H
+#define SIMPLECHAT_SEENCACHE_H
+
+#include <QString>
+#include <QVector>
+
+// Time-windowed "seen recently" set for flooded packets, keyed on a 64-bit
+// digest of (kind, origin, sequence).
+//
+// Two Bloom filters rotate: inserts go into the current one, lookups check
+// both, and the current one becomes the previous one (dropping the old
+// previous) every windowMs / 2 or once it holds capacity keys. A key is thus
+// remembered for between half a window and a whole one, memory is fixed
+// (2 x capacity x BITS_PER_KEY bits) however fast packets arrive, and
+// lookups never allocate. At 32 bits and 6 probes per key the false-positive
+// rate stays below 1 in 10^4 even with both filters full.
+class SeenCache
+{
+public:
+    static const int BITS_PER_KEY = 32;
+    static const int PROBES = 6;
+
+    explicit SeenCache(int capacity = 8192, qint64 windowMs = 60000);
+
+    static quint64 key(quint8 kind, const QString& origin, qint64 sequence);
+
+    bool contains(quint64 key, qint64 nowMs);
+    void insert(quint64 key, qint64 nowMs);
+    // Returns true if key was already present; inserts it otherwise
+    bool testAndInsert(quint64 key, qint64 nowMs);
+
+    int capacity() const { return m_capacity; }
+    qint64 windowMs() const { return m_windowMs; }
+
+private:
+    void rotateIfDue(qint64 nowMs);
+    static bool test(const QVector<quint64>& bits, quint64 mask, quint64 key);
+
+    int m_capacity;
+    qint64 m_windowMs;
+    quint64 m_mask;             // Bit count - 1 (a power of two)
+    QVector<quint64> m_current;
+    QVector<quint64> m_previous;
+    int m_currentKeys = 0;
+    qint64 m_rotatedAtMs = 0;
+};
+
+#endif // SIMPLECHAT_SEENCACHE_H
@@ -0,0 +1,310 @@
+#include "segmentedlog.h"
+#include <QDir>
+#include <QSet>
+#include <QVector>
+#include <QtEndian>
+#include <cstring>
+
+namespace {
+
+quint32 recordChecksum(quint8 type, const char* payload, int size)
+{
+    quint32 hash = 2166136261u;
+    hash = (hash ^ type) * 16777619u;
+    for (int i = 0; i < size; ++i) {
+        hash = (hash ^ quint8(payload[i])) * 16777619u;
+    }
+    return hash;
+}
+
+} // namespace
+
+SegmentedLog::SegmentedLog()
+    : m_index(nullptr)
+    , m_segmentCount(0)
+    , m_replayedRecords(0)
+{
+}
+
+SegmentedLog::~SegmentedLog()
+{
+    close();
+}
+
+void SegmentedLog::close()
+{
+    m_segment.reset();
+    if (m_index) {
+        m_indexFile.unmap(m_index);
+        m_index = nullptr;
+    }
+    m_indexFile.close();
+    m_segmentCount = 0;
+}
+
+QString SegmentedLog::segmentPath(quint32 segmentId) const
+{
+    return QDir(m_directory).filePath(QString("seg-%1.log").arg(segmentId, 6, 10, QChar('0')));
+}
+
+SegmentedLog::IndexEntry* SegmentedLog::indexEntry(int i) const
+{
+    return reinterpret_cast<IndexEntry*>(m_index + sizeof(IndexHeader) + i * sizeof(IndexEntry));
+}
+
+bool SegmentedLog::mapIndex(int segmentCount)
+{
+    if (m_index) {
+        m_indexFile.unmap(m_index);
+        m_index = nullptr;
+    }
+    qint64 bytes = qint64(sizeof(IndexHeader)) + qint64(segmentCount) * qint64(sizeof(IndexEntry));
+    if (m_indexFile.size() != bytes && !m_indexFile.resize(bytes)) {
+        m_errorString = m_indexFile.errorString();
+        return false;
+    }
+    m_index = m_indexFile.map(0, bytes);
+    if (!m_index) {
+        m_errorString = m_indexFile.errorString();
+        return false;
+    }
+    m_segmentCount = segmentCount;
+    reinterpret_cast<IndexHeader*>(m_index)->segmentCount = quint32(segmentCount);
+    return true;
+}
+
+bool SegmentedLog::open(const QString& directory, const ReplayHandler& replay)
+{
+    close();
+    m_directory = directory;
+    m_replayedRecords = 0;
+
+    if (!QDir().mkpath(directory)) {
+        m_errorString = QString("Cannot create %1").arg(directory);
+        return false;
+    }
+
+    m_indexFile.setFileName(QDir(directory).filePath("index"));
+    if (!m_indexFile.open(QIODevice::ReadWrite)) {
+        m_errorString = m_indexFile.errorString();
+        return false;
+    }
+
+    // The index is in native byte order; one written elsewhere (or damaged)
+    // fails the magic check and is rebuilt by scanning the segment files
+    IndexHeader header;
+    memset(&header, 0, sizeof(header));
+    bool indexValid = m_indexFile.read(reinterpret_cast<char*>(&header), sizeof(header)) == qint64(sizeof(header))
+                      && header.magic == INDEX_MAGIC && header.version == INDEX_VERSION
+                      && m_indexFile.size() >= qint64(sizeof(IndexHeader) + header.segmentCount * sizeof(IndexEntry));
+
+    if (indexValid) {
+        if (!mapIndex(int(header.segmentCount))) {
+            return false;
+        }
+        removeOrphanSegments();
+    } else {
+        const QStringList segments = QDir(directory).entryList(QStringList() << "seg-*.log", QDir::Files, QDir::Name);
+        if (!mapIndex(segments.size())) {
+            return false;
+        }
+        IndexHeader* mapped = reinterpret_cast<IndexHeader*>(m_index);
+        mapped->magic = INDEX_MAGIC;
+        mapped->version = INDEX_VERSION;
+        mapped->reserved = 0;
+        for (int i = 0; i < segments.size(); ++i) {
+            IndexEntry* entry = indexEntry(i);
+            entry->segmentId = segments[i].mid(4, 6).toUInt();
+            entry->committedBytes = 0;  // Verify everything
+            entry->records = 0;
+            entry->reserved = 0;
+        }
+    }
+
+    for (int i = 0; i < m_segmentCount; ++i) {
+        if (!replaySegment(indexEntry(i), replay)) {
+            return false;
+        }
+    }
+
+    if (m_segmentCount == 0) {
+        return startSegment();
+    }
+    return openSegmentForAppend(indexEntry(m_segmentCount - 1));
+}
+
+bool SegmentedLog::replaySegment(IndexEntry* entry, const ReplayHandler& replay)
+{
+    QFile file(segmentPath(entry->segmentId));
+    if (!file.exists()) {
+        entry->committedBytes = 0;
+        entry->records = 0;
+        return true;
+    }
+    if (!file.open(QIODevice::ReadWrite)) {
+        m_errorString = file.errorString();
+        return false;
+    }
+
+    const qint64 size = file.size();
+    const qint64 trusted = qMin<qint64>(entry->committedBytes, size);
+    qint64 pos = 0;
+    quint32 records = 0;
+
+    if (size > 0) {
+        const uchar* data = file.map(0, size);
+        if (!data) {
+            m_errorString = file.errorString();
+            return false;
+        }
+        while (pos + RECORD_HEADER_BYTES <= size) {
+            const uchar* record = data + pos;
+            quint32 length = qFromLittleEndian<quint32>(record);
+            quint8 type = record[4];
+            quint32 checksum = qFromLittleEndian<quint32>(record + 5);
+            if (pos + RECORD_HEADER_BYTES + qint64(length) > size) {
+                break;  // Torn write at the tail
+            }
+            const char* payload = reinterpret_cast<const char*>(record + RECORD_HEADER_BYTES);
+            if (pos >= trusted && recordChecksum(type, payload, int(length)) != checksum) {
+                break;
+            }
+            if (replay) {
+                replay(type, payload, int(length));
+            }
+            ++records;
+            pos += RECORD_HEADER_BYTES + qint64(length);
+        }
+        file.unmap(const_cast<uchar*>(data));
+    }
+
+    if (pos < size && !file.resize(pos)) {
+        m_errorString = file.errorString();
+        return false;
+    }
+    entry->committedBytes = quint32(pos);
+    entry->records = records;
+    m_replayedRecords += records;
+    return true;
+}
+
+bool SegmentedLog::openSegmentForAppend(IndexEntry* entry)
+{
+    m_segment.reset(new QFile(segmentPath(entry->segmentId)));
+    if (!m_segment->open(QIODevice::WriteOnly | QIODevice::Append | QIODevice::Unbuffered)) {
+        m_errorString = m_segment->errorString();
+        m_segment.reset();
+        return false;
+    }
+    return true;
+}
+
+bool SegmentedLog::startSegment()
+{
+    quint32 segmentId = m_segmentCount > 0 ? indexEntry(m_segmentCount - 1)->segmentId + 1 : 1;
+    if (!mapIndex(m_segmentCount + 1)) {
+        return false;
+    }
+    IndexEntry* entry = indexEntry(m_segmentCount - 1);
+    entry->segmentId = segmentId;
+    entry->committedBytes = 0;
+    entry->records = 0;
+    entry->reserved = 0;
+
+    // A leftover file with this id would be garbage from a lost index
+    QFile::remove(segmentPath(segmentId));
+    return openSegmentForAppend(entry);
+}
+
+bool SegmentedLog::append(quint8 type, const QByteArray& payload)
+{
+    if (!m_segment) {
+        return false;
+    }
+
+    IndexEntry* entry = indexEntry(m_segmentCount - 1);
+    const qint64 recordBytes = RECORD_HEADER_BYTES + qint64(payload.size());
+    if (entry->committedBytes > 0 && entry->committedBytes + recordBytes > SEGMENT_BYTES) {
+        if (!startSegment()) {
+            return false;
+        }
+        entry = indexEntry(m_segmentCount - 1);
+    }
+
+    // One write() per record so a crash leaves at most one torn record
+    QByteArray record(int(recordBytes), Qt::Uninitialized);
+    uchar* out = reinterpret_cast<uchar*>(record.data());
+    qToLittleEndian<quint32>(quint32(payload.size()), out);
+    out[4] = type;
+    qToLittleEndian<quint32>(recordChecksum(type, payload.constData(), payload.size()), out + 5);
+    memcpy(out + RECORD_HEADER_BYTES, payload.constData(), size_t(payload.size()));
+
+    if (m_segment->write(record) != recordBytes) {
+        m_errorString = m_segment->errorString();
+        m_segment->resize(entry->committedBytes);  // Drop the partial record
+        return false;
+    }
+    entry->committedBytes += quint32(recordBytes);
+    ++entry->records;
+    return true;
+}
+
+qint64 SegmentedLog::totalBytes() const
+{
+    qint64 bytes = 0;
+    for (int i = 0; i < m_segmentCount; ++i) {
+        bytes += indexEntry(i)->committedBytes;
+    }
+    return bytes;
+}
+
+bool SegmentedLog::checkpoint(const std::function<bool()>& writeSnapshot)
+{
+    if (!m_segment) {
+        return false;
+    }
+    const int superseded = m_segmentCount;
+    if (!startSegment() || !writeSnapshot()) {
+        return false;  // Old segments plus a partial snapshot still replay to the same state
+    }
+    return dropSegments(superseded);
+}
+
+bool SegmentedLog::dropSegments(int count)
+{
+    QVector<quint32> dropped;
+    for (int i = 0; i < count; ++i) {
+        dropped.append(indexEntry(i)->segmentId);
+    }
+
+    // Invalidate the index while entries move: a crash in between makes the
+    // next open() rebuild it from the segment files and verify every record
+    IndexHeader* header = reinterpret_cast<IndexHeader*>(m_index);
+    header->magic = 0;
+    const int kept = m_segmentCount - count;
+    memmove(indexEntry(0), indexEntry(count), size_t(kept) * sizeof(IndexEntry));
+    if (!mapIndex(kept)) {
+        return false;
+    }
+    reinterpret_cast<IndexHeader*>(m_index)->magic = INDEX_MAGIC;
+
+    for (quint32 segmentId : dropped) {
+        QFile::remove(segmentPath(segmentId));
+    }
+    return true;
+}
+
+void SegmentedLog::removeOrphanSegments()
+{
+    // Files a checkpoint dropped from the index but did not get to delete
+    QSet<quint32> indexed;
+    for (int i = 0; i < m_segmentCount; ++i) {
+        indexed.insert(indexEntry(i)->segmentId);
+    }
+    const QStringList segments = QDir(m_directory).entryList(QStringList() << "seg-*.log", QDir::Files);
+    for (const QString& segment : segments) {
+        if (!indexed.contains(segment.mid(4, 6).toUInt())) {
+            QFile::remove(QDir(m_directory).filePath(segment));
+        }
+    }
+}
@@ -0,0 +1,95 @@
+#ifndef SIMPLECHAT_SEGMENTEDLOG_H
+#define SIMPLECHAT_SEGMENTEDLOG_H
+
+#include <QString>
+#include <QByteArray>
+#include <QFile>
+#include <functional>
+#include <memory>
+
+// Append-only on-disk record log used to persist node state across restarts.
+//
+// Records are appended to numbered segment files (seg-000001.log, ...) of at
+// most SEGMENT_BYTES each:
+//   [u32 payload length][u8 type][u32 FNV-1a checksum of type + payload][payload]
+// All integers are little-endian. A memory-mapped index file holds one
+// fixed-size entry per segment with the number of bytes known to be intact,
+// updated in place after every append. On open() everything below that mark
+// is replayed without re-checking; only the tail past it (a write the index
+// never saw) is verified, and a torn record is truncated away.
+//
+// Writes go straight to the kernel (unbuffered), so the log survives a
+// process crash; it does not fsync, so a power loss may drop the last writes.
+//
+// checkpoint() bounds the log: the owner rewrites its current state into a
+// fresh segment and every older segment is deleted. Replaying a record twice
+// must be harmless, since a crash mid-checkpoint leaves both copies behind.
+class SegmentedLog
+{
+public:
+    using ReplayHandler = std::function<void(quint8 type, const char* payload, int size)>;
+
+    static const qint64 SEGMENT_BYTES = 8 * 1024 * 1024;
+
+    SegmentedLog();
+    ~SegmentedLog();
+
+    // Opens (creating if needed) the log in directory, calling replay for
+    // every stored record in append order. Returns false on I/O errors.
+    bool open(const QString& directory, const ReplayHandler& replay);
+    void close();
+    bool isOpen() const { return m_segment != nullptr; }
+
+    bool append(quint8 type, const QByteArray& payload);
+
+    // Starts a fresh segment, lets writeSnapshot append the current state
+    // (returning false if any append failed) and then drops every segment
+    // before it. On failure the older segments are kept.
+    bool checkpoint(const std::function<bool()>& writeSnapshot);
+
+    // Bytes of whole records across all segments
+    qint64 totalBytes() const;
+
+    QString errorString() const { return m_errorString; }
+    int segmentCount() const { return m_segmentCount; }
+    qint64 replayedRecords() const { return m_replayedRecords; }
+
+private:
+    struct IndexHeader {
+        quint32 magic;
+        quint32 version;
+        quint32 segmentCount;
+        quint32 reserved;
+    };
+    struct IndexEntry {
+        quint32 segmentId;
+        quint32 committedBytes;  // Prefix of the segment known to hold whole records
+        quint32 records;
+        quint32 reserved;
+    };
+
+    static const quint32 INDEX_MAGIC = 0x53434958;  // "SCIX"
+    static const quint32 INDEX_VERSION = 1;
+    static const int RECORD_HEADER_BYTES = 9;
+
+    QString segmentPath(quint32 segmentId) const;
+    bool mapIndex(int segmentCount);
+    IndexEntry* indexEntry(int i) const;
+    bool replaySegment(IndexEntry* entry, const ReplayHandler& replay);
+    bool openSegmentForAppend(IndexEntry* entry);
+    bool startSegment();
+    bool dropSegments(int count);
+    void removeOrphanSegments();
+
+    QString m_directory;
+    QString m_errorString;
+
+    QFile m_indexFile;
+    uchar* m_index;          // Mapping of m_indexFile
+    int m_segmentCount;
+
+    std::unique_ptr<QFile> m_segment;  // Segment currently appended to
+    qint64 m_replayedRecords;
+};
+
+#endif // SIMPLECHAT_SEGMENTEDLOG_H
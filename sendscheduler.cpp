@@ -0,0 +1,241 @@
+#include "sendscheduler.h"
+#include <utility>
+
+void SendScheduler::TokenBucket::refill(qint64 nowMs, qint64 bytesPerSec, qint64 burstBytes)
+{
+    // bytes/s * ms = milli-bytes
+    tokens = qMin(burstBytes * 1000, tokens + qMax<qint64>(0, nowMs - updatedMs) * bytesPerSec);
+    updatedMs = nowMs;
+}
+
+qint64 SendScheduler::TokenBucket::waitMs(qint64 bytesPerSec) const
+{
+    if (tokens > 0 || bytesPerSec <= 0) {
+        return 0;
+    }
+    return -tokens / bytesPerSec + 1;
+}
+
+SendScheduler::SendScheduler(qint64 nowMs)
+{
+    m_nodeBucket.tokens = m_limits.nodeBurstBytes * 1000;
+    m_nodeBucket.updatedMs = nowMs;
+}
+
+void SendScheduler::setLimits(const Limits& limits)
+{
+    m_limits = limits;
+    m_nodeBucket.tokens = m_limits.nodeBurstBytes * 1000;
+    for (EndpointState& endpoint : m_endpoints) {
+        endpoint.bucket.tokens = qMin(endpoint.bucket.tokens, m_limits.peerBurstBytes * 1000);
+    }
+}
+
+SendScheduler::EndpointState& SendScheduler::state(const Endpoint& endpoint, qint64 nowMs)
+{
+    auto it = m_endpoints.find(endpoint);
+    if (it == m_endpoints.end()) {
+        EndpointState fresh;
+        fresh.bucket.tokens = m_limits.peerBurstBytes * 1000;
+        fresh.bucket.updatedMs = nowMs;
+        it = m_endpoints.insert(endpoint, fresh);
+    }
+    return it.value();
+}
+
+bool SendScheduler::hasTokens(EndpointState& state, qint64 nowMs)
+{
+    if (m_limits.nodeBytesPerSec > 0) {
+        m_nodeBucket.refill(nowMs, m_limits.nodeBytesPerSec, m_limits.nodeBurstBytes);
+        if (m_nodeBucket.tokens <= 0) {
+            return false;
+        }
+    }
+    if (m_limits.peerBytesPerSec > 0) {
+        state.bucket.refill(nowMs, m_limits.peerBytesPerSec, m_limits.peerBurstBytes);
+        if (state.bucket.tokens <= 0) {
+            return false;
+        }
+    }
+    return true;
+}
+
+void SendScheduler::charge(EndpointState& state, int bytes)
+{
+    if (m_limits.nodeBytesPerSec > 0) {
+        m_nodeBucket.tokens -= qint64(bytes) * 1000;
+    }
+    if (m_limits.peerBytesPerSec > 0) {
+        state.bucket.tokens -= qint64(bytes) * 1000;
+    }
+}
+
+bool SendScheduler::waitingAtOrAbove(const EndpointState& state, Priority priority)
+{
+    for (int p = Control; p <= priority; ++p) {
+        if (!state.queues[p].isEmpty()) {
+            return true;
+        }
+    }
+    return false;
+}
+
+bool SendScheduler::admit(const QHostAddress& addr, quint16 port, Priority priority, int bytes, qint64 nowMs)
+{
+    // Unlimited both ways: nothing is ever queued, so skip the per-endpoint state
+    if (m_limits.peerBytesPerSec <= 0 && m_limits.nodeBytesPerSec <= 0 && m_queuedDatagrams == 0) {
+        return true;
+    }
+    EndpointState& endpoint = state(qMakePair(addr, port), nowMs);
+    if (waitingAtOrAbove(endpoint, priority) || !hasTokens(endpoint, nowMs)) {
+        return false;
+    }
+    charge(endpoint, bytes);
+    return true;
+}
+
+bool SendScheduler::enqueue(const QByteArray& data, const QHostAddress& addr, quint16 port,
+                            Priority priority, qint64 nowMs, int* evicted)
+{
+    const Endpoint key = qMakePair(addr, port);
+    EndpointState& endpoint = state(key, nowMs);
+    if (priority == Control) {
+        if (data.size() > m_limits.maxControlBytes) {
+            return false;
+        }
+        // A peer that stops draining must not grow the queue without bound
+        QQueue<Datagram>& control = endpoint.queues[Control];
+        while (endpoint.controlBytes + data.size() > m_limits.maxControlBytes) {
+            const int size = control.dequeue().data.size();
+            endpoint.controlBytes -= size;
+            endpoint.queuedBytes -= size;
+            m_queuedBytes -= size;
+            --m_queuedDatagrams;
+            if (evicted) {
+                ++*evicted;
+            }
+        }
+        endpoint.controlBytes += data.size();
+    } else if (endpoint.queuedBytes + data.size() > m_limits.maxQueuedBytes) {
+        return false;
+    }
+
+    Datagram datagram;
+    datagram.data = data;
+    datagram.address = addr;
+    datagram.port = port;
+    datagram.priority = priority;
+    datagram.queuedAtMs = nowMs;
+    endpoint.queues[priority].enqueue(datagram);
+    endpoint.queuedBytes += data.size();
+    m_queuedBytes += data.size();
+    ++m_queuedDatagrams;
+    if (!endpoint.active) {
+        endpoint.active = true;
+        m_active.append(key);
+    }
+    return true;
+}
+
+QVector<SendScheduler::Datagram> SendScheduler::drain(qint64 nowMs)
+{
+    QVector<Datagram> ready;
+    if (m_active.isEmpty()) {
+        return ready;
+    }
+
+    // Class by class; within a class one datagram per endpoint per pass
+    bool nodeExhausted = false;
+    for (int p = Control; p < PriorityCount && !nodeExhausted; ++p) {
+        bool progress = true;
+        while (progress && !nodeExhausted) {
+            progress = false;
+            for (const Endpoint& key : std::as_const(m_active)) {
+                EndpointState& endpoint = m_endpoints[key];
+                if (endpoint.queues[p].isEmpty() || !hasTokens(endpoint, nowMs)) {
+                    if (m_limits.nodeBytesPerSec > 0 && m_nodeBucket.tokens <= 0) {
+                        nodeExhausted = true;
+                        break;
+                    }
+                    continue;
+                }
+                Datagram datagram = endpoint.queues[p].dequeue();
+                charge(endpoint, datagram.data.size());
+                if (p == Control) {
+                    endpoint.controlBytes -= datagram.data.size();
+                }
+                endpoint.queuedBytes -= datagram.data.size();
+                m_queuedBytes -= datagram.data.size();
+                --m_queuedDatagrams;
+                ready.append(datagram);
+                progress = true;
+            }
+        }
+    }
+
+    // Drop emptied endpoints and rotate, so the next drain starts elsewhere
+    for (int i = 0; i < m_active.size(); ) {
+        EndpointState& endpoint = m_endpoints[m_active[i]];
+        if (!waitingAtOrAbove(endpoint, Bulk)) {
+            endpoint.active = false;
+            m_active.removeAt(i);
+        } else {
+            ++i;
+        }
+    }
+    if (m_active.size() > 1) {
+        m_active.append(m_active.takeFirst());
+    }
+    return ready;
+}
+
+qint64 SendScheduler::nextWakeup(qint64 nowMs)
+{
+    if (m_queuedDatagrams == 0) {
+        return -1;
+    }
+
+    qint64 nodeWait = 0;
+    if (m_limits.nodeBytesPerSec > 0) {
+        m_nodeBucket.refill(nowMs, m_limits.nodeBytesPerSec, m_limits.nodeBurstBytes);
+        nodeWait = m_nodeBucket.waitMs(m_limits.nodeBytesPerSec);
+    }
+    qint64 peerWait = -1;
+    for (const Endpoint& key : std::as_const(m_active)) {
+        TokenBucket& bucket = m_endpoints[key].bucket;
+        qint64 wait = 0;
+        if (m_limits.peerBytesPerSec > 0) {
+            bucket.refill(nowMs, m_limits.peerBytesPerSec, m_limits.peerBurstBytes);
+            wait = bucket.waitMs(m_limits.peerBytesPerSec);
+        }
+        if (peerWait < 0 || wait < peerWait) {
+            peerWait = wait;
+        }
+    }
+    return nowMs + qMax(nodeWait, qMax<qint64>(0, peerWait));
+}
+
+bool SendScheduler::isCongested(const QHostAddress& addr, quint16 port) const
+{
+    if (m_queuedBytes > m_limits.nodeBurstBytes) {
+        return true;
+    }
+    auto it = m_endpoints.constFind(qMakePair(addr, port));
+    return it != m_endpoints.constEnd() && it->queuedBytes > m_limits.congestionBytes;
+}
+
+void SendScheduler::prune(qint64 nowMs)
+{
+    for (auto it = m_endpoints.begin(); it != m_endpoints.end(); ) {
+        EndpointState& endpoint = it.value();
+        if (!endpoint.active && m_limits.peerBytesPerSec > 0) {
+            endpoint.bucket.refill(nowMs, m_limits.peerBytesPerSec, m_limits.peerBurstBytes);
+        }
+        if (!endpoint.active &&
+            (m_limits.peerBytesPerSec <= 0 || endpoint.bucket.tokens >= m_limits.peerBurstBytes * 1000)) {
+            it = m_endpoints.erase(it);
+        } else {
+            ++it;
+        }
+    }
+}
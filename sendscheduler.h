@@ -0,0 +1,122 @@
+#ifndef SIMPLECHAT_SENDSCHEDULER_H
+#define SIMPLECHAT_SENDSCHEDULER_H
+
+#include <QByteArray>
+#include <QHash>
+#include <QList>
+#include <QPair>
+#include <QQueue>
+#include <QVector>
+#include <QtNetwork/QHostAddress>
+
+// Outbound datagram scheduler: one queue per destination endpoint and
+// priority class, paced by token buckets per endpoint and for the whole node.
+//
+// Classes are served in strict priority (every Control datagram before any
+// Interactive one, and so on), and endpoints round-robin within a class so a
+// single peer catching up cannot monopolise the node's budget. A datagram
+// goes straight to the wire through admit() when nothing of its class or a
+// higher one is waiting for its endpoint and both buckets have tokens;
+// otherwise it is queued and drain() hands it out once the buckets refill.
+//
+// Buckets are deficit-style: a datagram may be sent whenever the balance is
+// positive and may take it negative, so packets larger than the burst still
+// go out. Times are milliseconds on any monotonic clock. Not thread-safe.
+class SendScheduler
+{
+public:
+    using Endpoint = QPair<QHostAddress, quint16>;
+
+    enum Priority {
+        Control,      // Acks, routing, discovery
+        Interactive,  // Chat and private messages
+        Bulk,         // Anti-entropy and retransmissions
+        PriorityCount
+    };
+
+    struct Limits {
+        qint64 peerBytesPerSec = 1024 * 1024;   // 0 = unlimited
+        qint64 peerBurstBytes = 64 * 1024;
+        qint64 nodeBytesPerSec = 8 * 1024 * 1024;
+        qint64 nodeBurstBytes = 256 * 1024;
+        int maxQueuedBytes = 512 * 1024;        // Per endpoint; new Interactive/Bulk datagrams are dropped past it
+        int maxControlBytes = 64 * 1024;        // Per endpoint; the oldest Control datagrams make room
+        int congestionBytes = 32 * 1024;        // Queued per endpoint before isCongested()
+    };
+
+    struct Datagram {
+        QByteArray data;
+        QHostAddress address;
+        quint16 port = 0;
+        Priority priority = Bulk;
+        qint64 queuedAtMs = 0;
+    };
+
+    explicit SendScheduler(qint64 nowMs = 0);
+
+    void setLimits(const Limits& limits);
+    const Limits& limits() const { return m_limits; }
+
+    // True if bytes may be written to the endpoint right now, bypassing the
+    // queue; the buckets are charged for it
+    bool admit(const QHostAddress& addr, quint16 port, Priority priority, int bytes, qint64 nowMs);
+
+    // Queues a datagram that admit() refused; returns false (and drops it)
+    // when the endpoint's queue is full. Control datagrams instead push out the
+    // oldest queued Control ones (a newer ack or route update supersedes them),
+    // counted in *evicted. data must own its bytes.
+    bool enqueue(const QByteArray& data, const QHostAddress& addr, quint16 port, Priority priority, qint64 nowMs,
+                 int* evicted = nullptr);
+
+    // Removes and returns every queued datagram the buckets allow now, in
+    // send order
+    QVector<Datagram> drain(qint64 nowMs);
+
+    // Earliest time drain() can release something, or -1 when nothing is queued
+    qint64 nextWakeup(qint64 nowMs);
+
+    // Backpressure for anti-entropy and retransmission: the endpoint's queue
+    // is past Limits::congestionBytes, or more than a node burst is queued
+    bool isCongested(const QHostAddress& addr, quint16 port) const;
+
+    // Forgets endpoints with nothing queued and a full bucket (which is what
+    // an unknown endpoint gets anyway)
+    void prune(qint64 nowMs);
+
+    int queuedBytes() const { return m_queuedBytes; }
+    int queuedDatagrams() const { return m_queuedDatagrams; }
+    int endpointCount() const { return m_endpoints.size(); }
+
+private:
+    // Balance in milli-bytes so slow refills do not round away
+    struct TokenBucket {
+        qint64 tokens = 0;
+        qint64 updatedMs = 0;
+
+        void refill(qint64 nowMs, qint64 bytesPerSec, qint64 burstBytes);
+        // Milliseconds until the balance is positive again (0 if it is)
+        qint64 waitMs(qint64 bytesPerSec) const;
+    };
+
+    struct EndpointState {
+        TokenBucket bucket;
+        QQueue<Datagram> queues[PriorityCount];
+        int queuedBytes = 0;
+        int controlBytes = 0; // Part of queuedBytes in queues[Control]
+        bool active = false;  // In m_active
+    };
+
+    EndpointState& state(const Endpoint& endpoint, qint64 nowMs);
+    bool hasTokens(EndpointState& state, qint64 nowMs);
+    void charge(EndpointState& state, int bytes);
+    static bool waitingAtOrAbove(const EndpointState& state, Priority priority);
+
+    Limits m_limits;
+    TokenBucket m_nodeBucket;
+    QHash<Endpoint, EndpointState> m_endpoints;
+    QList<Endpoint> m_active;   // Endpoints with queued datagrams, round-robin order
+    int m_queuedBytes = 0;
+    int m_queuedDatagrams = 0;
+};
+
+#endif // SIMPLECHAT_SENDSCHEDULER_H
@@ -0,0 +1,200 @@
+#include "simnetwork.h"
+#include <QPointer>
+
+NodeTimer* SimClock::createTimer(QObject* parent)
+{
+    return new SimTimer(this, parent);
+}
+
+void SimClock::schedule(qint64 atMs, Event event)
+{
+    m_events.emplace(qMakePair(qMax(atMs, m_now), m_nextOrder++), std::move(event));
+}
+
+void SimClock::runUntil(qint64 untilMs)
+{
+    while (!m_events.empty() && m_events.begin()->first.first <= untilMs) {
+        auto next = m_events.begin();
+        m_now = next->first.first;
+        Event event = std::move(next->second);
+        m_events.erase(next);
+        ++m_eventsRun;
+        event();
+    }
+    m_now = qMax(m_now, untilMs);
+}
+
+SimTimer::SimTimer(SimClock* clock, QObject* parent)
+    : NodeTimer(parent)
+    , m_clock(clock)
+{
+}
+
+void SimTimer::start(int msec)
+{
+    m_interval = qMax(0, msec);
+    m_dueMs = m_clock->elapsed() + m_interval;
+    m_active = true;
+    const quint64 generation = ++m_generation;
+    QPointer<SimTimer> self(this);
+    m_clock->schedule(m_dueMs, [self, generation]() {
+        if (self) {
+            self->fire(generation);
+        }
+    });
+}
+
+void SimTimer::stop()
+{
+    m_active = false;
+    ++m_generation;
+}
+
+int SimTimer::remainingTime() const
+{
+    return m_active ? int(qMax<qint64>(0, m_dueMs - m_clock->elapsed())) : -1;
+}
+
+void SimTimer::fire(quint64 generation)
+{
+    if (!m_active || generation != m_generation) {
+        return;
+    }
+    if (m_singleShot) {
+        m_active = false;
+    } else {
+        start(qMax(1, m_interval));
+    }
+    emit timeout();
+}
+
+SimTransport::SimTransport(SimNetwork* network, const QHostAddress& localAddress, const QHostAddress& publicAddress)
+    : m_network(network)
+    , m_localAddress(localAddress)
+    , m_publicAddress(publicAddress.isNull() ? localAddress : publicAddress)
+{
+}
+
+SimTransport::~SimTransport()
+{
+    close();
+}
+
+bool SimTransport::bind(quint16 port, bool reusePort)
+{
+    if (reusePort) {
+        m_errorString = "SO_REUSEPORT is not supported by the simulated network";
+        return false;
+    }
+    m_port = port;
+    if (!m_network->attach(this, port)) {
+        m_errorString = QString("%1:%2 is already bound").arg(m_publicAddress.toString()).arg(port);
+        m_port = 0;
+        return false;
+    }
+    return true;
+}
+
+void SimTransport::close()
+{
+    if (m_port != 0) {
+        m_network->detach(this);
+        m_port = 0;
+    }
+}
+
+qint64 SimTransport::writeDatagram(const QByteArray& data, const QHostAddress& addr, quint16 port)
+{
+    if (m_port == 0) {
+        return -1;
+    }
+    m_network->send(this, data, addr, port);
+    return data.size();
+}
+
+SimNetwork::SimNetwork(SimClock* clock, quint32 seed)
+    : m_clock(clock)
+    , m_random(seed)
+{
+}
+
+void SimNetwork::setLink(const QHostAddress& a, const QHostAddress& b, const LinkProfile& link)
+{
+    m_links.insert(qMakePair(a, b), link);
+    m_links.insert(qMakePair(b, a), link);
+}
+
+const LinkProfile& SimNetwork::link(const QHostAddress& a, const QHostAddress& b) const
+{
+    if (!m_links.isEmpty()) {
+        auto it = m_links.constFind(qMakePair(a, b));
+        if (it != m_links.constEnd()) {
+            return it.value();
+        }
+    }
+    return m_defaultLink;
+}
+
+bool SimNetwork::attach(SimTransport* transport, quint16 port)
+{
+    const Endpoint endpoint = qMakePair(transport->m_publicAddress, port);
+    if (m_endpoints.contains(endpoint)) {
+        return false;
+    }
+    m_endpoints.insert(endpoint, transport);
+    return true;
+}
+
+void SimNetwork::detach(SimTransport* transport)
+{
+    m_endpoints.remove(qMakePair(transport->m_publicAddress, transport->m_port));
+}
+
+void SimNetwork::send(SimTransport* from, const QByteArray& data, const QHostAddress& addr, quint16 port)
+{
+    from->m_stats.packetsSent++;
+    from->m_stats.bytesSent += quint64(data.size());
+    if (from->behindNat()) {
+        from->m_natPermits.insert(addr);
+    }
+
+    const LinkProfile& profile = link(from->m_publicAddress, addr);
+    if (profile.loss > 0 && m_random.generateDouble() < profile.loss) {
+        from->m_stats.packetsLost++;
+        return;
+    }
+    qint64 delay = profile.latencyMs;
+    if (profile.jitterMs > 0) {
+        delay += m_random.bounded(profile.jitterMs + 1);
+    }
+    if (profile.reorder > 0 && m_random.generateDouble() < profile.reorder) {
+        delay += profile.latencyMs + m_random.bounded(profile.latencyMs + 1);
+    }
+
+    // Deep copy: data may be a raw view into the sender's receive buffer
+    QByteArray payload(data.constData(), data.size());
+    const Endpoint source = qMakePair(from->m_publicAddress, from->m_port);
+    const Endpoint target = qMakePair(addr, port);
+    m_clock->schedule(m_clock->elapsed() + delay, [this, payload, source, target]() mutable {
+        deliver(payload, source, target);
+    });
+}
+
+void SimNetwork::deliver(QByteArray& data, const Endpoint& from, const Endpoint& to)
+{
+    SimTransport* target = m_endpoints.value(to, nullptr);
+    SimTransport* source = m_endpoints.value(from, nullptr);
+    if (!target || (target->behindNat() && !target->m_natPermits.contains(from.first))) {
+        if (source) {
+            source->m_stats.packetsUnreachable++;
+        }
+        return;
+    }
+
+    target->m_stats.packetsReceived++;
+    target->m_stats.bytesReceived += quint64(data.size());
+    if (target->m_handler) {
+        // The payload is this datagram's own copy, so the handler may patch it
+        target->m_handler(data.data(), int(data.size()), from.first, from.second);
+    }
+}
@@ -0,0 +1,144 @@
+#ifndef SIMPLECHAT_SIMNETWORK_H
+#define SIMPLECHAT_SIMNETWORK_H
+
+#include <QHash>
+#include <QPair>
+#include <QRandomGenerator>
+#include <QSet>
+#include <QtNetwork/QHostAddress>
+#include <functional>
+#include <map>
+#include "datagramtransport.h"
+#include "nodeclock.h"
+
+// Virtual time for the simulator. Every node's timers and every datagram in
+// flight are events in one queue, run in (time, insertion) order, so a run is
+// a pure function of its inputs and seed.
+class SimClock : public NodeClock
+{
+public:
+    using Event = std::function<void()>;
+
+    qint64 elapsed() const override { return m_now; }
+    qint64 currentMSecsSinceEpoch() const override { return EPOCH_MS + m_now; }
+    NodeTimer* createTimer(QObject* parent) override;
+
+    void schedule(qint64 atMs, Event event);
+    // Runs every event due up to untilMs; the clock then reads untilMs
+    void runUntil(qint64 untilMs);
+    quint64 eventsRun() const { return m_eventsRun; }
+
+    // Fixed wall-clock origin so Timestamp fields do not vary between runs
+    static const qint64 EPOCH_MS = 1700000000000LL;
+
+private:
+    std::map<QPair<qint64, quint64>, Event> m_events; // (time, order) -> event
+    qint64 m_now = 0;
+    quint64 m_nextOrder = 0;
+    quint64 m_eventsRun = 0;
+};
+
+class SimTimer : public NodeTimer
+{
+    Q_OBJECT
+
+public:
+    SimTimer(SimClock* clock, QObject* parent);
+
+    void start(int msec) override;
+    void stop() override;
+    bool isActive() const override { return m_active; }
+    int remainingTime() const override;
+
+private:
+    void fire(quint64 generation);
+
+    SimClock* m_clock;
+    int m_interval = 0;
+    qint64 m_dueMs = 0;
+    bool m_active = false;
+    quint64 m_generation = 0; // Bumped by start()/stop() so stale events are ignored
+};
+
+// Behavior of the path between two hosts
+struct LinkProfile {
+    int latencyMs = 5;      // One-way base delay
+    int jitterMs = 0;       // Uniform extra delay in [0, jitterMs]; reorders datagrams
+    double loss = 0.0;      // Probability a datagram is dropped
+    double reorder = 0.0;   // Probability a datagram is held back another 1-2x latencyMs
+};
+
+// What one host's transport has put on and taken off the wire
+struct SimTransportStats {
+    quint64 packetsSent = 0;
+    quint64 bytesSent = 0;
+    quint64 packetsReceived = 0;
+    quint64 bytesReceived = 0;
+    quint64 packetsLost = 0;        // Dropped by the link model
+    quint64 packetsUnreachable = 0; // No host at the destination, or filtered by its NAT
+};
+
+class SimNetwork;
+
+// A host's datagram endpoint on the virtual network. Behind a NAT the host
+// sees its private address; everyone else sees the public one, and only
+// hosts it has sent to may reach it (address-restricted cone).
+class SimTransport : public DatagramTransport
+{
+    Q_OBJECT
+
+public:
+    SimTransport(SimNetwork* network, const QHostAddress& localAddress, const QHostAddress& publicAddress);
+    ~SimTransport();
+
+    bool bind(quint16 port, bool reusePort = false) override;
+    void close() override;
+    qint64 writeDatagram(const QByteArray& data, const QHostAddress& addr, quint16 port) override;
+    QHostAddress localAddress() const override { return m_localAddress; }
+
+    QHostAddress publicAddress() const { return m_publicAddress; }
+    quint16 port() const { return m_port; }
+    bool behindNat() const { return m_publicAddress != m_localAddress; }
+    const SimTransportStats& stats() const { return m_stats; }
+
+private:
+    friend class SimNetwork;
+
+    SimNetwork* m_network;
+    QHostAddress m_localAddress;
+    QHostAddress m_publicAddress;
+    quint16 m_port = 0;
+    SimTransportStats m_stats;
+    QSet<QHostAddress> m_natPermits; // Hosts this NAT lets in
+};
+
+// Routes datagrams between SimTransports through SimClock, applying each
+// link's latency, jitter, loss and reordering
+class SimNetwork
+{
+public:
+    SimNetwork(SimClock* clock, quint32 seed);
+
+    void setDefaultLink(const LinkProfile& link) { m_defaultLink = link; }
+    // Overrides the profile between two hosts (public addresses), both directions
+    void setLink(const QHostAddress& a, const QHostAddress& b, const LinkProfile& link);
+
+private:
+    friend class SimTransport;
+
+    using Endpoint = QPair<QHostAddress, quint16>;
+
+    bool attach(SimTransport* transport, quint16 port);
+    void detach(SimTransport* transport);
+    void send(SimTransport* from, const QByteArray& data, const QHostAddress& addr, quint16 port);
+    void deliver(QByteArray& data, const Endpoint& from, const Endpoint& to);
+    const LinkProfile& link(const QHostAddress& a, const QHostAddress& b) const;
+
+    SimClock* m_clock;
+    QRandomGenerator m_random;
+    LinkProfile m_defaultLink;
+    QHash<QPair<QHostAddress, QHostAddress>, LinkProfile> m_links;
+    QHash<Endpoint, SimTransport*> m_endpoints; // Public endpoint -> bound transport
+};
+
+#endif // SIMPLECHAT_SIMNETWORK_H
@@ -0,0 +1,2350 @@
+#include "simplechatnode.h"
+#include "wireformat.h"
+#include <QDebug>
+#include <QSaveFile>
+#include <QDataStream>
+#include <QRandomGenerator>
+#include <QtAlgorithms>
+#include <algorithm>
+#include <iterator>
+
+bool SequenceSet::insertRange(int start, int end)
+{
+    // Sequence numbers start at 1. Neighbours are compared in 64 bits, since
+    // a peer may send INT_MAX and the one after it does not fit an int
+    if (qint64(end) < qMax(qint64(start), qint64(prefix) + 1)) {
+        return false;
+    }
+    start = qMax(start, prefix + 1);
+    
+    // Merge with a range that starts at or before us and overlaps or touches
+    int newStart = start;
+    int newEnd = end;
+    auto it = ranges.upperBound(start);
+    if (it != ranges.begin()) {
+        auto prev = std::prev(it);
+        if (prev.value() >= end) {
+            return false;  // Already covered
+        }
+        if (qint64(prev.value()) >= qint64(start) - 1) {
+            newStart = prev.key();
+            newEnd = qMax(newEnd, prev.value());
+            it = ranges.erase(prev);
+        }
+    }
+    
+    // Swallow every following range we now overlap or touch
+    while (it != ranges.end() && qint64(it.key()) <= qint64(newEnd) + 1) {
+        newEnd = qMax(newEnd, it.value());
+        it = ranges.erase(it);
+    }
+    
+    if (newStart == prefix + 1) {
+        prefix = newEnd;
+    } else {
+        ranges.insert(newStart, newEnd);
+    }
+    return true;
+}
+
+bool SequenceSet::contains(int seq) const
+{
+    if (seq <= prefix) {
+        return seq >= 1;
+    }
+    auto it = ranges.upperBound(seq);
+    if (it == ranges.begin()) {
+        return false;
+    }
+    return std::prev(it).value() >= seq;
+}
+
+int SequenceSet::maxSequence() const
+{
+    return ranges.isEmpty() ? prefix : ranges.last();
+}
+
+bool VectorClock::add(const QString& origin, int seq)
+{
+    if (seq < 1) {
+        return false;
+    }
+    auto it = sequences.find(origin);
+    if (it == sequences.end()) {
+        SequenceSet set;
+        set.insert(seq);
+        sequences.insert(origin, set);
+        digest ^= entryHash(origin, set);
+        return true;
+    }
+    if (it.value().contains(seq)) {
+        return false;
+    }
+    digest ^= entryHash(origin, it.value());
+    it.value().insert(seq);
+    digest ^= entryHash(origin, it.value());
+    return true;
+}
+
+void VectorClock::assign(const QString& origin, const SequenceSet& set)
+{
+    auto it = sequences.find(origin);
+    if (it != sequences.end()) {
+        digest ^= entryHash(origin, it.value());
+    }
+    sequences[origin] = set;
+    digest ^= entryHash(origin, set);
+}
+
+quint64 VectorClock::entryHash(const QString& origin, const SequenceSet& set)
+{
+    // FNV-1a over the UTF-8 origin, the prefix and every range, then a
+    // splitmix64 finalizer so XOR-combining entries does not cancel similar ones
+    quint64 hash = 14695981039346656037ULL;
+    auto mix = [&hash](quint32 value) {
+        for (int shift = 0; shift < 32; shift += 8) {
+            hash = (hash ^ quint8(value >> shift)) * 1099511628211ULL;
+        }
+    };
+    const QByteArray bytes = origin.toUtf8();
+    for (char c : bytes) {
+        hash = (hash ^ quint8(c)) * 1099511628211ULL;
+    }
+    mix(quint32(set.prefix));
+    for (auto it = set.ranges.begin(); it != set.ranges.end(); ++it) {
+        mix(quint32(it.key()));
+        mix(quint32(it.value()));
+    }
+    hash ^= hash >> 30;
+    hash *= 0xbf58476d1ce4e5b9ULL;
+    hash ^= hash >> 27;
+    hash *= 0x94d049bb133111ebULL;
+    hash ^= hash >> 31;
+    return hash;
+}
+
+SimpleChatNode::SimpleChatNode(const QString& clientId, int port, bool noForward, QObject *parent)
+    : QObject(parent)
+    , m_socket(nullptr)
+    , m_receiveWorkers(1)
+    , m_workerPool(nullptr)
+    , m_discoveryTimer(nullptr)
+    , m_antiEntropyTimer(nullptr)
+    , m_retransmissionTimer(nullptr)
+    , m_fullDumpTimer(nullptr)
+    , m_triggeredUpdateTimer(nullptr)
+    , m_metricsDumpTimer(nullptr)
+    , m_sendTimer(nullptr)
+    , m_ackTimer(nullptr)
+    , m_clientId(clientId)
+    , m_port(port)
+    , m_sequenceNumber(1)
+    , m_privateSequenceNumber(1)
+    , m_dsdvSequenceNumber(1)
+    , m_noForwardMode(noForward)
+    , m_messageStore(m_nodeIds)
+    , m_checkpointBytes(0)
+    , m_clock(&m_systemClock)
+    , m_random(QRandomGenerator::global()->generate())
+    , m_clockVersion(0)
+    , m_advertiseSelf(false)
+    , m_metricsIntervalMs(0)
+{
+    m_selfId = m_nodeIds.intern(m_clientId);
+    for (LogLevel& level : m_logLevels) {
+        level = LogLevel::Debug;
+    }
+    
+    m_retransmissions = m_metrics.counter("simplechat_retransmissions_total");
+    m_fastRelays = m_metrics.counter("simplechat_fast_relays_total");
+    m_coalescedAcks = m_metrics.counter("simplechat_coalesced_acks_total");
+    m_undecodable = m_metrics.counter("simplechat_undecodable_packets_total");
+    m_ackRtt = m_metrics.histogram("simplechat_ack_rtt_ms");
+    m_directLatency = m_metrics.histogram("simplechat_delivery_latency_ms", "path=\"direct\"");
+    m_routedLatency = m_metrics.histogram("simplechat_delivery_latency_ms", "path=\"routed\"");
+    m_syncLatency = m_metrics.histogram("simplechat_delivery_latency_ms", "path=\"sync\"");
+    m_sendDrops = m_metrics.counter("simplechat_send_dropped_total");
+    m_deferredRetransmissions = m_metrics.counter("simplechat_retransmissions_deferred_total");
+    m_suppressedPrivate = m_metrics.counter("simplechat_duplicates_suppressed_total", "kind=\"private\"");
+    m_suppressedRumors = m_metrics.counter("simplechat_duplicates_suppressed_total", "kind=\"route_rumor\"");
+    m_sendQueueDelay[SendScheduler::Control] = m_metrics.histogram("simplechat_send_queue_delay_ms", "class=\"control\"");
+    m_sendQueueDelay[SendScheduler::Interactive] =
+        m_metrics.histogram("simplechat_send_queue_delay_ms", "class=\"interactive\"");
+    m_sendQueueDelay[SendScheduler::Bulk] = m_metrics.histogram("simplechat_send_queue_delay_ms", "class=\"bulk\"");
+    // Gauges are read when a snapshot is taken, on this node's thread
+    m_metrics.setGauge("simplechat_routes", [this]() { return qint64(m_routingTable.size()); });
+    m_metrics.setGauge("simplechat_peers", [this]() { return qint64(m_peers.size()); });
+    m_metrics.setGauge("simplechat_stored_messages", [this]() { return qint64(m_messageStore.messageCount()); });
+    m_metrics.setGauge("simplechat_store_bytes", [this]() { return m_messageStore.memoryUsage(); });
+    m_metrics.setGauge("simplechat_pending_acks", [this]() { return qint64(m_pendingAcks.size()); });
+    m_metrics.setGauge("simplechat_retransmit_queue", [this]() { return qint64(m_retransmitWheel.size()); });
+    m_metrics.setGauge("simplechat_pending_advertisements",
+                       [this]() { return qint64(m_pendingAdvertisements.size()); });
+    m_metrics.setGauge("simplechat_send_queue_bytes", [this]() { return qint64(m_sendScheduler.queuedBytes()); });
+    m_metrics.setGauge("simplechat_send_queue_datagrams",
+                       [this]() { return qint64(m_sendScheduler.queuedDatagrams()); });
+    m_metrics.setGauge("simplechat_receive_dropped_datagrams",
+                       [this]() { return m_socket ? qint64(m_socket->droppedDatagrams()) : 0; });
+}
+
+SimpleChatNode::~SimpleChatNode()
+{
+    // Workers read m_sharedRoutes; join them before any member goes away
+    if (m_workerPool) {
+        m_workerPool->stop();
+        delete m_workerPool;
+        m_workerPool = nullptr;
+    }
+    if (m_socket) {
+        m_socket->close();
+    }
+}
+
+void SimpleChatNode::setMetricsDump(const QString& path, int intervalMs)
+{
+    m_metricsPath = path;
+    m_metricsIntervalMs = qMax(1000, intervalMs);
+}
+
+void SimpleChatNode::setTransport(DatagramTransport* transport)
+{
+    transport->setParent(this);
+    m_socket = transport;
+    m_receiveWorkers = 1;
+}
+
+bool SimpleChatNode::start()
+{
+    m_retransmitWheel = TimerWheel(m_clock->elapsed());
+    if (!m_dataDir.isEmpty() && !openStateLog()) {
+        return false;
+    }
+    
+    // Create UDP socket
+    if (!m_socket) {
+        m_socket = new DatagramSocket(this);
+    }
+    
+    if (!m_socket->bind(m_port, m_receiveWorkers > 1)) {
+        addToMessageLog(QString("Failed to bind to port %1: %2")
+                       .arg(m_port).arg(m_socket->errorString()),
+                        LogCategory::General, LogLevel::Warning);
+        return false;
+    }
+    
+    m_socket->setReceiveHandler([this](char* data, int size, const QHostAddress& sender, quint16 senderPort) {
+        processDatagram(data, size, sender, senderPort);
+    });
+    
+    addToMessageLog(QString("UDP socket bound to port %1%2")
+                   .arg(m_port)
+                   .arg(m_socket->isBatched() ? " (batched receive)" : ""),
+                    LogCategory::General, LogLevel::Info);
+    
+    // Extra shards: the kernel spreads senders over every socket on the port
+    if (m_receiveWorkers > 1) {
+        m_workerPool = new ReceiveWorkerPool(this);
+        // Sequences replayed from the state log; later ones go out through recordRouteSequence()
+        m_lastSeqNoSeen.forEach([this](NodeId destination, int seqNo) {
+            m_sharedRoutes.publish(m_nodeIds.name(destination), seqNo);
+        });
+        connect(m_workerPool, &ReceiveWorkerPool::datagramsReceived, this, &SimpleChatNode::processReceivedBatch);
+        int started = m_workerPool->start(m_receiveWorkers - 1, m_clientId, m_port, &m_sharedRoutes);
+        if (started < m_receiveWorkers - 1) {
+            addToMessageLog(QString("Started %1 of %2 receive workers: %3")
+                           .arg(started).arg(m_receiveWorkers - 1).arg(m_workerPool->errorString()),
+                            LogCategory::General, LogLevel::Warning);
+        }
+        addToMessageLog(QString("Receiving on %1 sockets").arg(started + 1),
+                        LogCategory::General, LogLevel::Info);
+    }
+    
+    // Setup timers
+    m_discoveryTimer = m_clock->createTimer(this);
+    m_antiEntropyTimer = m_clock->createTimer(this);
+    m_retransmissionTimer = m_clock->createTimer(this);
+    m_fullDumpTimer = m_clock->createTimer(this);
+    m_triggeredUpdateTimer = m_clock->createTimer(this);
+    m_sendTimer = m_clock->createTimer(this);
+    m_ackTimer = m_clock->createTimer(this);
+    
+    connect(m_discoveryTimer, &NodeTimer::timeout, this, &SimpleChatNode::performPeerDiscovery);
+    m_discoveryTimer->start(DISCOVERY_INTERVAL);
+    
+    connect(m_antiEntropyTimer, &NodeTimer::timeout, this, &SimpleChatNode::performAntiEntropy);
+    m_antiEntropyTimer->start(ANTI_ENTROPY_INTERVAL);
+    
+    connect(m_retransmissionTimer, &NodeTimer::timeout, this, &SimpleChatNode::checkMessageRetransmission);
+    m_retransmissionTimer->setSingleShot(true);
+    
+    // DSDV: periodic full dumps plus triggered updates for changes in between
+    connect(m_fullDumpTimer, &NodeTimer::timeout, this, &SimpleChatNode::sendFullDump);
+    m_fullDumpTimer->start(FULL_DUMP_INTERVAL);
+    connect(m_triggeredUpdateTimer, &NodeTimer::timeout, this, &SimpleChatNode::sendTriggeredUpdate);
+    m_triggeredUpdateTimer->setSingleShot(true);
+    
+    connect(m_sendTimer, &NodeTimer::timeout, this, &SimpleChatNode::flushSendQueue);
+    m_sendTimer->setSingleShot(true);
+    connect(m_ackTimer, &NodeTimer::timeout, this, &SimpleChatNode::flushDelayedAcks);
+    m_ackTimer->setSingleShot(true);
+    
+    if (!m_metricsPath.isEmpty()) {
+        m_metricsDumpTimer = m_clock->createTimer(this);
+        connect(m_metricsDumpTimer, &NodeTimer::timeout, this, &SimpleChatNode::dumpMetrics);
+        m_metricsDumpTimer->start(m_metricsIntervalMs);
+    }
+    
+    // Start initial peer discovery and send initial route announcement
+    performPeerDiscovery();
+    sendFullDump();
+    return true;
+}
+
+void SimpleChatNode::sendPrivateMessage(const QString& destination, const QString& text)
+{
+    // Create private message with hop limit
+    QVariantMap message;
+    message["Dest"] = destination;
+    message["Origin"] = m_clientId;
+    message["ChatText"] = text;
+    message["HopLimit"] = static_cast<quint32>(DEFAULT_HOP_LIMIT);
+    message["Type"] = "private";
+    message["Sequence"] = m_privateSequenceNumber++;
+    persistCounters();
+    message["Timestamp"] = m_clock->currentMSecsSinceEpoch();
+    
+    // Add NAT traversal information
+    message["LastIP"] = m_socket->localAddress().toString();
+    message["LastPort"] = m_port;
+
+    // A flood that comes back to us is dropped rather than sent out again
+    m_seenFloods.insert(SeenCache::key(PrivateFlood, m_clientId, message["Sequence"].toInt()), m_clock->elapsed());
+    
+    // Check if we have a route to the destination
+    if (const RouteEntry* route = m_routingTable.find(m_nodeIds.find(destination))) {
+        sendMessageToPeer(message, route->nextHop, route->nextPort);
+        addToMessageLog(QString("Routing via %1:%2").arg(route->nextHop.toString()).arg(route->nextPort),
+                        LogCategory::Routing, LogLevel::Debug);
+    } else {
+        // No route found, broadcast to discover route
+        addToMessageLog("No route to destination, broadcasting...",
+                        LogCategory::Routing, LogLevel::Info);
+        broadcastMessage(message);
+    }
+}
+
+
+void SimpleChatNode::bumpOwnSequence()
+{
+    // Own sequence numbers are even; odd ones mean "unreachable"
+    m_dsdvSequenceNumber = (m_dsdvSequenceNumber | 1) + 1;
+    persistCounters();
+}
+
+QVariantList SimpleChatNode::fullRouteList() const
+{
+    QVariantList routes;
+    routes.append(QVariant(QVariantList{m_clientId, m_dsdvSequenceNumber, 0}));
+    
+    // A rendezvous node does not forward, so it only advertises itself
+    if (m_noForwardMode) {
+        return routes;
+    }
+    m_routingTable.forEach([&](NodeId destination, const RouteEntry& route) {
+        routes.append(QVariant(QVariantList{m_nodeIds.name(destination), route.sequenceNumber, route.hopCount}));
+    });
+    m_brokenRoutes.forEach([&](NodeId destination, int seqNo) {
+        routes.append(QVariant(QVariantList{m_nodeIds.name(destination), seqNo, INFINITE_METRIC}));
+    });
+    return routes;
+}
+
+void SimpleChatNode::sendFullDump()
+{
+    bumpOwnSequence();
+    const QVariantList routes = fullRouteList();
+    
+    // Everything pending is covered by the dump
+    m_brokenRoutes = NodeMap<int>();
+    m_pendingAdvertisements.clear();
+    m_advertiseSelf = false;
+    
+    sendRouteUpdate(routes, true, getActivePeers());
+    addToMessageLog(QString("Sent full dump of %1 routes (seq %2)")
+                   .arg(routes.size())
+                   .arg(m_dsdvSequenceNumber),
+                    LogCategory::Routing, LogLevel::Debug);
+}
+
+void SimpleChatNode::scheduleTriggeredUpdate()
+{
+    if (!m_triggeredUpdateTimer->isActive()) {
+        m_triggeredUpdateTimer->start(TRIGGERED_UPDATE_DELAY);
+    }
+}
+
+void SimpleChatNode::sendTriggeredUpdate()
+{
+    const qint64 now = m_clock->elapsed();
+    qint64 nextDue = -1;
+    QVariantList routes;
+    
+    if (m_advertiseSelf) {
+        routes.append(QVariant(QVariantList{m_clientId, m_dsdvSequenceNumber, 0}));
+        m_advertiseSelf = false;
+    }
+    
+    const QSet<NodeId> pending = m_pendingAdvertisements;
+    for (NodeId destination : pending) {
+        if (const int* brokenSeq = m_brokenRoutes.find(destination)) {
+            routes.append(QVariant(QVariantList{m_nodeIds.name(destination), *brokenSeq, INFINITE_METRIC}));
+            m_brokenRoutes.remove(destination);
+        } else if (const RouteEntry* route = m_routingTable.find(destination)) {
+            // Still settling: keep it for a later update
+            const qint64 advertiseAt = m_routeSettling.value(destination).advertiseAtMs;
+            if (advertiseAt > now) {
+                nextDue = nextDue < 0 ? advertiseAt : qMin(nextDue, advertiseAt);
+                continue;
+            }
+            if (!m_noForwardMode) {
+                routes.append(QVariant(QVariantList{m_nodeIds.name(destination),
+                                                    route->sequenceNumber, route->hopCount}));
+            }
+        }
+        m_pendingAdvertisements.remove(destination);
+    }
+    
+    if (!routes.isEmpty()) {
+        sendRouteUpdate(routes, false, getActivePeers());
+        addToMessageLog(QString("Sent triggered update of %1 routes").arg(routes.size()),
+                        LogCategory::Routing, LogLevel::Debug);
+    }
+    if (nextDue >= 0) {
+        m_triggeredUpdateTimer->start(int(qMax<qint64>(nextDue - now, TRIGGERED_UPDATE_DELAY)));
+    }
+}
+
+void SimpleChatNode::sendRouteUpdate(const QVariantList& routes, bool full, const QList<PeerInfo>& peers)
+{
+    if (peers.isEmpty()) {
+        return;
+    }
+    
+    QVariantMap update;
+    update["Type"] = "route_update";
+    update["Origin"] = m_clientId;
+    if (full) {
+        update["Full"] = 1;
+    }
+    
+    // Add NAT traversal information
+    update["LastIP"] = m_socket->localAddress().toString();
+    update["LastPort"] = m_port;
+    
+    // Large tables are split so every datagram stays well under the MTU
+    for (int offset = 0; offset < routes.size(); offset += ROUTES_PER_UPDATE) {
+        update["Routes"] = routes.mid(offset, ROUTES_PER_UPDATE);
+        sendToPeers(update, peers);
+    }
+    
+    // Peers that never advertised a wire level may predate DSDV and ignore route_update
+    QList<PeerInfo> legacyPeers;
+    for (const PeerInfo& peer : peers) {
+        if (wireLevel(peer.address, peer.port) == 0) {
+            legacyPeers.append(peer);
+        }
+    }
+    if (!legacyPeers.isEmpty()) {
+        sendRouteRumors(routes, legacyPeers);
+    }
+}
+
+void SimpleChatNode::sendRouteRumors(const QVariantList& routes, const QList<PeerInfo>& peers)
+{
+    // A pre-DSDV node learns one origin per route_rumor and installs it through
+    // the sender, so each reachable entry becomes a rumor of its own. Hops is
+    // ignored by those nodes; newer ones use it instead of assuming one hop.
+    for (const QVariant& entry : routes) {
+        const QVariantList fields = entry.toList();
+        const int hopCount = fields.value(2).toInt();
+        if (hopCount >= INFINITE_METRIC) {
+            continue;  // A rumor cannot withdraw a route
+        }
+        
+        QVariantMap rumor;
+        rumor["Type"] = "route_rumor";
+        rumor["Origin"] = fields.value(0);
+        rumor["SeqNo"] = fields.value(1);
+        rumor["Hops"] = hopCount;
+        const RouteEntry* route = nullptr;
+        if (hopCount == 0) {
+            rumor["LastIP"] = m_socket->localAddress().toString();
+            rumor["LastPort"] = m_port;
+        } else {
+            route = m_routingTable.find(m_nodeIds.find(fields.value(0).toString()));
+        }
+        
+        // Never offer a peer the route it gave us
+        QList<PeerInfo> targets;
+        for (const PeerInfo& peer : peers) {
+            if (!route || route->nextHop != peer.address || route->nextPort != peer.port) {
+                targets.append(peer);
+            }
+        }
+        sendToPeers(rumor, targets);
+    }
+}
+
+void SimpleChatNode::sendChatMessage(const QString& destination, const QString& text)
+{
+    // Create message
+    QVariantMap message;
+    message["ChatText"] = text;
+    message["Origin"] = m_clientId;
+    message["Destination"] = destination;
+    message["Sequence"] = m_sequenceNumber++;
+    message["Type"] = "message";
+    persistCounters();
+    message["Timestamp"] = m_clock->currentMSecsSinceEpoch();
+    
+    // Add NAT traversal information
+    message["LastIP"] = m_socket->localAddress().toString();
+    message["LastPort"] = m_port;
+    
+    // Store message
+    MessageInfo info;
+    info.origin = m_clientId;
+    info.destination = destination;
+    info.chatText = text;
+    info.sequence = message["Sequence"].toInt();
+    info.timestamp = QDateTime::fromMSecsSinceEpoch(message["Timestamp"].toLongLong());
+    storeMessage(info);
+    
+    // Send to destination peer using DSDV routing if available
+    const NodeId destinationId = m_nodeIds.intern(destination);
+    if (const RouteEntry* route = m_routingTable.find(destinationId)) {
+        sendMessageToPeer(message, route->nextHop, route->nextPort);
+        addToMessageLog(QString("Using DSDV route via %1:%2")
+                       .arg(route->nextHop.toString())
+                       .arg(route->nextPort),
+                        LogCategory::Routing, LogLevel::Debug);
+    } else if (const PeerInfo* peer = m_peers.find(destinationId)) {
+        // Fall back to direct send if peer is known
+        sendMessageToPeer(message, peer->address, peer->port);
+    } else {
+        addToMessageLog("Destination peer not found. Broadcasting...",
+                        LogCategory::Routing, LogLevel::Info);
+        broadcastMessage(message);
+    }
+    
+    // Add to pending acknowledgments for retransmission
+    trackPendingMessage(message, destinationId);
+}
+
+void SimpleChatNode::broadcastChatMessage(const QString& text)
+{
+    QVariantMap message;
+    message["ChatText"] = text;
+    message["Origin"] = m_clientId;
+    message["Destination"] = "-1"; // Broadcast indicator
+    message["Sequence"] = m_sequenceNumber++;
+    message["Type"] = "message";
+    persistCounters();
+    message["Timestamp"] = m_clock->currentMSecsSinceEpoch();
+    
+    broadcastMessage(message);
+    
+    // Store our own broadcast message
+    MessageInfo info;
+    info.origin = m_clientId;
+    info.destination = "-1";
+    info.chatText = text;
+    info.sequence = message["Sequence"].toInt();
+    info.timestamp = QDateTime::fromMSecsSinceEpoch(message["Timestamp"].toLongLong());
+    storeMessage(info);
+}
+
+void SimpleChatNode::processDatagram(char* data, int size, const QHostAddress& senderAddr, quint16 senderPort)
+{
+    // Private messages we only relay never get decoded
+    if (!m_noForwardMode) {
+        WireFormat::ForwardHeader header;
+        if (WireFormat::parseForwardHeader(data, size, &header) && header.destination != m_clientId &&
+            relayPrivateMessage(data, size, header, senderAddr, senderPort)) {
+            return;
+        }
+    }
+
+    // data points into the socket's receive slab; decode it in place
+    QVariantMap message = deserializeMessage(data, size);
+    if (WireFormat::isCompact(data, size)) {
+        noteWireLevel(senderAddr, senderPort, WireFormat::COMPACT_VERSION);
+    }
+    if (!message.isEmpty()) {
+        dispatchReceived(message, message.value("Type").toString(), size, senderAddr, senderPort);
+    } else {
+        m_undecodable->add();
+    }
+}
+
+void SimpleChatNode::processReceivedBatch(const QVector<ReceivedDatagram>& batch)
+{
+    // Datagrams decoded by a receive worker
+    for (const ReceivedDatagram& received : batch) {
+        if (received.compact) {
+            noteWireLevel(received.sender, received.senderPort, WireFormat::COMPACT_VERSION);
+        }
+        if (!received.message.isEmpty()) {
+            dispatchReceived(received.message, received.type, received.bytes,
+                             received.sender, received.senderPort, received.answered);
+        } else {
+            m_undecodable->add();
+        }
+    }
+}
+
+void SimpleChatNode::dispatchReceived(const QVariantMap& message, const QString& type, int bytes,
+                                      const QHostAddress& senderAddr, quint16 senderPort, bool answered)
+{
+    // A copy of the pointers: handling the message may register new types
+    const TypeMetrics metrics = typeMetrics(type);
+    metrics.packetsIn->add();
+    metrics.bytesIn->add(quint64(bytes));
+    const quint64 startNs = MetricsRegistry::nowNs();
+    processReceivedMessage(message, senderAddr, senderPort, answered);
+    metrics.dispatchNs->record(MetricsRegistry::nowNs() - startNs);
+}
+
+void SimpleChatNode::processReceivedMessage(const QVariantMap& message, const QHostAddress& senderAddr, quint16 senderPort,
+                                            bool answered)
+{
+    QString type = message["Type"].toString();
+    QString origin = message["Origin"].toString();
+    // Looked up once per packet; only a direct sender that becomes a peer is
+    // interned here, so relayed and junk origins never get an ID
+    NodeId originId = m_nodeIds.find(origin);
+    
+    // Peers advertise their wire feature level in discovery packets (builds
+    // that predate it send none). It replaces what we knew, so a peer that
+    // restarts as an older build on the same endpoint is downgraded at once.
+    if (type == "discovery" || type == "discovery_response") {
+        noteWireLevel(senderAddr, senderPort, message.value("Wire").toInt(), true);
+    }
+    
+    // A relayed private message comes from the last relay, not from its origin,
+    // and carries the origin's LastIP/LastPort untouched
+    const bool relayed = type == "private" && message.value("HopLimit").toUInt() < DEFAULT_HOP_LIMIT;
+
+    // Process NAT information if present
+    if (!relayed && message.contains("LastIP") && message.contains("LastPort")) {
+        processNATInfo(message, senderAddr, senderPort);
+    }
+    
+    // Update peer information
+    if (!origin.isEmpty() && originId != m_selfId) {
+        updatePeerLastSeen(senderAddr, senderPort);
+        if (!relayed && !m_peers.contains(originId) && NodeIdTable::isValidName(origin)) {
+            originId = m_nodeIds.intern(origin);
+            addPeer(originId, senderAddr, senderPort);
+        }
+    }
+    
+    if (type == "route_update") {
+        processRouteUpdate(message, senderAddr, senderPort);
+    } else if (type == "route_rumor") {
+        // Pre-DSDV nodes
+        processRouteRumor(message, senderAddr, senderPort);
+    } else if (type == "private") {
+        // Handle private messages with DSDV routing
+        QString dest = message["Dest"].toString();
+        if (message.contains("Sequence") &&
+            suppressDuplicate(PrivateFlood, origin, message["Sequence"].toInt(), m_suppressedPrivate)) {
+            return;
+        }
+        
+        if (dest == m_clientId) {
+            // Message is for us
+            recordDeliveryLatency(m_routedLatency, message.value("Timestamp").toLongLong());
+            emit messageDelivered(origin, dest, message["ChatText"].toString(), true);
+        } else {
+            // Forward the message if not in no-forward mode
+            if (!m_noForwardMode) {
+                forwardPrivateMessage(message);
+            }
+        }
+    } else if (type == "message") {
+        // Check if in no-forward mode
+        if (m_noForwardMode && message.contains("ChatText")) {
+            // Don't forward chat messages in no-forward mode
+            return;
+        }
+        
+        QString destination = message["Destination"].toString();
+        QString chatText = message["ChatText"].toString();
+        int sequence = message["Sequence"].toInt();
+        if (!NodeIdTable::isValidName(origin) || !NodeIdTable::isValidName(destination)) {
+            return;
+        }
+        
+        // Check if we've already seen this message
+        const bool duplicate = hasMessage(originId, sequence);
+        if (!duplicate) {
+            // Store the message with the origin's send time, which syncs pass on
+            const qint64 timestampMs = message.value("Timestamp").toLongLong();
+            MessageInfo info;
+            info.origin = origin;
+            info.destination = destination;
+            info.chatText = chatText;
+            info.sequence = sequence;
+            info.timestamp = QDateTime::fromMSecsSinceEpoch(timestampMs > 0 ? timestampMs
+                                                                             : m_clock->currentMSecsSinceEpoch());
+            storeMessage(info);
+            recordDeliveryLatency(m_directLatency, timestampMs);
+        }
+        
+        // Send acknowledgment; a duplicate is a retransmission whose ack was lost
+        if (wireLevel(senderAddr, senderPort) >= WireFormat::ACK_BATCH_LEVEL) {
+            queueAck(origin, sequence, senderAddr, senderPort);
+        } else {
+            QVariantMap ack;
+            ack["Type"] = "ack";
+            ack["Origin"] = m_clientId;
+            ack["AckOrigin"] = origin;
+            ack["AckSequence"] = sequence;
+            sendMessageToPeer(ack, senderAddr, senderPort);
+        }
+        if (duplicate) {
+            return;
+        }
+        
+        // Deliver if for us or broadcast
+        if (destination == m_clientId || destination == "-1") {
+            emit messageDelivered(origin, destination, chatText, false);
+        }
+        
+    } else if (type == "ack") {
+        QString ackOrigin = message["AckOrigin"].toString();
+        int ackSequence = message["AckSequence"].toInt();
+        
+        // Remove from pending acknowledgments
+        if (ackOrigin == m_clientId) {
+            handleAck(originId, ackSequence);
+        }
+        
+        // Track acknowledgment in message store
+        m_messageStore.acknowledge(m_nodeIds.find(ackOrigin), ackSequence, originId);
+        
+    } else if (type == "ack_batch") {
+        // Only peers that accept ack_batch send one
+        noteWireLevel(senderAddr, senderPort, WireFormat::ACK_BATCH_LEVEL);
+        handleAckBatch(message, originId);
+        
+    } else if (type == "discovery") {
+        // Peer discovery response (unless a receive worker already sent it)
+        if (!answered) {
+            sendMessageToPeer(ReceiveWorker::discoveryResponse(m_clientId, m_port, m_socket->localAddress()),
+                              senderAddr, senderPort);
+        }
+        
+    } else if (type == "discovery_response") {
+        // Already handled by updatePeerLastSeen
+        
+    } else if (type == "stats") {
+        // Metrics are for local tooling, not for the network at large
+        if (senderAddr.isLoopback()) {
+            QVariantMap response;
+            response["Type"] = "stats_response";
+            response["Origin"] = m_clientId;
+            response["Stats"] = m_metrics.snapshot();
+            sendMessageToPeer(response, senderAddr, senderPort);
+        }
+        
+    } else if (type == "clock_digest") {
+        handleClockDigest(message, senderAddr, senderPort);
+        
+    } else if (type == "vector_clock") {
+        handleVectorClock(message, senderAddr, senderPort);
+        
+    } else if (type == "sync_message") {
+        // Message received during anti-entropy sync
+        QString syncOrigin = message["SyncOrigin"].toString();
+        int syncSequence = message["SyncSequence"].toInt();
+        
+        if (storeSyncedMessage(syncOrigin, syncSequence,
+                               message["SyncDestination"].toString(),
+                               message["SyncText"].toString(),
+                               message.value("SyncTimestamp").toLongLong())) {
+            addToMessageLog(QString("🔄 Synced: %1 (seq %2)").arg(syncOrigin).arg(syncSequence),
+                            LogCategory::Sync, LogLevel::Debug);
+        }
+        
+    } else if (type == "sync_batch") {
+        // Many synced messages packed into one datagram: [origin, seq, dest, text]
+        // each, plus their origin timestamps in the same order
+        int stored = 0;
+        const QVariantList batch = message["SyncBatch"].toList();
+        const QVariantList timestamps = message.value("SyncTimestamps").toList();
+        for (int i = 0; i < batch.size(); ++i) {
+            const QVariantList fields = batch[i].toList();
+            if (fields.size() < 4) {
+                continue;
+            }
+            const qint64 timestampMs = i < timestamps.size() ? timestamps[i].toLongLong() : 0;
+            if (storeSyncedMessage(fields[0].toString(), fields[1].toInt(),
+                                   fields[2].toString(), fields[3].toString(), timestampMs)) {
+                ++stored;
+            }
+        }
+        if (stored > 0) {
+            addToMessageLog(QString("🔄 Synced %1 messages from %2").arg(stored).arg(origin),
+                            LogCategory::Sync, LogLevel::Debug);
+        }
+    }
+}
+
+bool SimpleChatNode::storeSyncedMessage(const QString& origin, int sequence, const QString& destination,
+                                        const QString& chatText, qint64 timestampMs)
+{
+    if (!NodeIdTable::isValidName(origin) || !NodeIdTable::isValidName(destination) ||
+        hasMessage(m_nodeIds.find(origin), sequence)) {
+        return false;
+    }
+    
+    // Older peers send no timestamp (0); the message then dates from now
+    MessageInfo info;
+    info.origin = origin;
+    info.destination = destination;
+    info.chatText = chatText;
+    info.sequence = sequence;
+    info.timestamp = QDateTime::fromMSecsSinceEpoch(timestampMs > 0 ? timestampMs
+                                                                     : m_clock->currentMSecsSinceEpoch());
+    storeMessage(info);
+    recordDeliveryLatency(m_syncLatency, timestampMs);
+    return true;
+}
+
+void SimpleChatNode::processRouteRumor(const QVariantMap& message, const QHostAddress& senderAddr, quint16 senderPort)
+{
+    QString origin = message["Origin"].toString();
+    int seqNo = message["SeqNo"].toInt();
+    if (!NodeIdTable::isValidName(origin) || suppressDuplicate(RumorFlood, origin, seqNo, m_suppressedRumors)) {
+        return;
+    }
+    
+    // Check if this is a new route rumor (only then is the origin worth an ID)
+    if (seqNo > m_lastSeqNoSeen.value(m_nodeIds.find(origin), 0)) {
+        const NodeId originId = m_nodeIds.intern(origin);
+        recordRouteSequence(originId, seqNo);
+        
+        // Rumors from DSDV nodes carry the sender's hop count; pre-DSDV ones
+        // only ever describe their sender
+        const int hopCount = message.value("Hops").toInt();
+        if (hopCount < 0 || hopCount >= INFINITE_METRIC) {
+            return;
+        }
+        updateRoutingTable(originId, senderAddr, senderPort, seqNo, hopCount + 1, hopCount == 0);
+        
+        // The sender also sent every DSDV peer a route_update, and we pass the
+        // route on to our own legacy peers in ours
+        if (message.contains("Hops")) {
+            return;
+        }
+        
+        // Forward to random neighbor (rumor propagation)
+        auto peers = getActivePeers();
+        if (!peers.isEmpty()) {
+            int randomIndex = m_random.bounded(peers.size());
+            const PeerInfo& peer = peers.at(randomIndex);
+            
+            // Don't send back to sender
+            if (peer.address != senderAddr || peer.port != senderPort) {
+                sendMessageToPeer(message, peer.address, peer.port);
+                addToMessageLog(QString("Forwarded route rumor from %1 (seq %2) to %3")
+                               .arg(origin).arg(seqNo).arg(peer.peerId),
+                                LogCategory::Forwarding, LogLevel::Debug);
+            }
+        }
+    }
+}
+
+void SimpleChatNode::processRouteUpdate(const QVariantMap& message, const QHostAddress& senderAddr, quint16 senderPort)
+{
+    const QString origin = message["Origin"].toString();
+    if (origin.isEmpty() || origin == m_clientId) {
+        return;
+    }
+    
+    const QVariantList routes = message["Routes"].toList();
+    for (const QVariant& entry : routes) {
+        const QVariantList fields = entry.toList();
+        if (fields.size() != 3) {
+            continue;
+        }
+        const QString destinationName = fields[0].toString();
+        const int seqNo = fields[1].toInt();
+        const int hopCount = fields[2].toInt();
+        
+        if (destinationName == m_clientId) {
+            // Someone reports us unreachable with a newer sequence: outbid it
+            if (seqNo >= m_dsdvSequenceNumber) {
+                m_dsdvSequenceNumber = seqNo;
+                bumpOwnSequence();
+                m_advertiseSelf = true;
+                scheduleTriggeredUpdate();
+            }
+            continue;
+        }
+        
+        if (!NodeIdTable::isValidName(destinationName)) {
+            continue;
+        }
+        const NodeId known = m_nodeIds.find(destinationName);
+        if (seqNo < m_lastSeqNoSeen.value(known, 0)) {
+            continue;  // Stale
+        }
+        
+        if (hopCount >= INFINITE_METRIC) {
+            // Only matters if our route goes through the neighbor that lost it
+            const RouteEntry* route = m_routingTable.find(known);
+            if (route && route->nextHop == senderAddr && route->nextPort == senderPort &&
+                seqNo > route->sequenceNumber) {
+                breakRoute(known, seqNo);
+            }
+            continue;
+        }
+        
+        // A route we will hold: now the name gets an ID
+        const NodeId destination = m_nodeIds.intern(destinationName);
+        recordRouteSequence(destination, seqNo);
+        updateRoutingTable(destination, senderAddr, senderPort, seqNo, hopCount + 1, hopCount == 0);
+    }
+}
+
+void SimpleChatNode::recordRouteSequence(NodeId destination, int seqNo)
+{
+    int& lastSeqNo = m_lastSeqNoSeen[destination];
+    if (seqNo > lastSeqNo) {
+        lastSeqNo = seqNo;
+        if (m_workerPool) {
+            m_sharedRoutes.publish(m_nodeIds.name(destination), seqNo);
+        }
+    }
+}
+
+void SimpleChatNode::invalidateRoutesVia(const QHostAddress& nextHop, quint16 nextPort)
+{
+    // Each lost route is advertised with the next odd sequence: it beats the
+    // route everyone has and loses to the destination's next own announcement
+    QVector<QPair<NodeId, int>> lost;
+    m_routingTable.forEach([&](NodeId destination, const RouteEntry& route) {
+        if (route.nextHop == nextHop && route.nextPort == nextPort) {
+            lost.append(qMakePair(destination, (route.sequenceNumber + 1) | 1));
+        }
+    });
+    for (const auto& entry : lost) {
+        breakRoute(entry.first, entry.second);
+    }
+}
+
+void SimpleChatNode::breakRoute(NodeId destination, int seqNo)
+{
+    if (!m_routingTable.contains(destination)) {
+        return;
+    }
+    
+    recordRouteSequence(destination, seqNo);
+    m_routingTable.remove(destination);
+    m_routeSettling.remove(destination);
+    persistRouteSequence(destination, seqNo);
+    
+    const QString& name = m_nodeIds.name(destination);
+    addToMessageLog(QString("Lost route to %1 (seq %2)").arg(name).arg(seqNo),
+                    LogCategory::Routing, LogLevel::Info);
+    emit routeRemoved(name);
+    
+    m_brokenRoutes[destination] = seqNo;
+    m_pendingAdvertisements.insert(destination);
+    scheduleTriggeredUpdate();
+}
+
+void SimpleChatNode::updateRoutingTable(NodeId destination, const QHostAddress& nextHop, 
+                                      quint16 nextPort, int seqNo, int hopCount, bool isDirect)
+{
+    RouteEntry newRoute;
+    newRoute.nextHop = nextHop;
+    newRoute.nextPort = nextPort;
+    newRoute.sequenceNumber = seqNo;
+    newRoute.hopCount = hopCount;
+    newRoute.lastUpdate = QDateTime::fromMSecsSinceEpoch(m_clock->currentMSecsSinceEpoch());
+    newRoute.isDirect = isDirect;
+    
+    // Check for public endpoints if available
+    if (const auto* endpoint = m_publicEndpoints.find(destination)) {
+        newRoute.publicIP = endpoint->first;
+        newRoute.publicPort = endpoint->second;
+    }
+    
+    // Check if we should update the route
+    const QString& name = m_nodeIds.name(destination);
+    RouteEntry* oldRoute = m_routingTable.find(destination);
+    if (oldRoute && !isBetterRoute(*oldRoute, newRoute)) {
+        return;
+    }
+    
+    // Settling time: how long after a sequence first arrives its best path shows up
+    const qint64 now = m_clock->elapsed();
+    RouteSettling& settling = m_routeSettling[destination];
+    if (settling.sequence != seqNo) {
+        settling.sequence = seqNo;
+        settling.firstHeardMs = now;
+    } else {
+        settling.settleMs = (settling.settleMs * 7 + (now - settling.firstHeardMs)) / 8;
+    }
+    
+    if (oldRoute && oldRoute->nextHop == nextHop && oldRoute->nextPort == nextPort &&
+        oldRoute->hopCount == hopCount) {
+        // Same path, newer sequence: a refresh that the next full dump carries on
+        *oldRoute = newRoute;
+        persistRouteSequence(destination, seqNo);
+        emit routeChanged(name, newRoute);
+        return;
+    }
+    
+    // A longer path at a newer sequence waits in case the shorter one is just late
+    const bool longer = oldRoute && hopCount > oldRoute->hopCount;
+    settling.advertiseAtMs = longer ? now + qMin<qint64>(2 * settling.settleMs, MAX_SETTLING_DELAY) : now;
+    
+    const bool isNew = !oldRoute;
+    m_routingTable[destination] = newRoute;
+    m_brokenRoutes.remove(destination);
+    persistRouteSequence(destination, seqNo);
+    addToMessageLog(QString("%1 route to %2 via %3:%4 (seq %5, hops %6)")
+                   .arg(isNew ? "New" : "Updated")
+                   .arg(name)
+                   .arg(nextHop.toString())
+                   .arg(nextPort)
+                   .arg(seqNo)
+                   .arg(hopCount),
+                    LogCategory::Routing, LogLevel::Info);
+    emit routeChanged(name, newRoute);
+    
+    m_pendingAdvertisements.insert(destination);
+    scheduleTriggeredUpdate();
+}
+
+bool SimpleChatNode::isBetterRoute(const RouteEntry& oldRoute, const RouteEntry& newRoute)
+{
+    // Prefer higher sequence numbers (fresher routes)
+    if (newRoute.sequenceNumber > oldRoute.sequenceNumber) {
+        return true;
+    }
+    
+    // If same sequence number, prefer direct routes (for NAT traversal)
+    if (newRoute.sequenceNumber == oldRoute.sequenceNumber && newRoute.isDirect && !oldRoute.isDirect) {
+        return true;
+    }
+    
+    // If same sequence number and directness, prefer shorter hop count
+    if (newRoute.sequenceNumber == oldRoute.sequenceNumber && 
+        newRoute.isDirect == oldRoute.isDirect && 
+        newRoute.hopCount < oldRoute.hopCount) {
+        return true;
+    }
+    
+    return false;
+}
+
+void SimpleChatNode::forwardPrivateMessage(const QVariantMap& message)
+{
+    QString dest = message["Dest"].toString();
+    quint32 hopLimit = message["HopLimit"].toUInt();
+    
+    if (hopLimit > 0) {
+        // Decrement hop limit; the rest travels as the origin sent it
+        QVariantMap forwardMsg = message;
+        forwardMsg["HopLimit"] = hopLimit - 1;
+        
+        // Check routing table for destination
+        if (const RouteEntry* route = m_routingTable.find(m_nodeIds.find(dest))) {
+            sendMessageToPeer(forwardMsg, route->nextHop, route->nextPort);
+            addToMessageLog(QString("Forwarding private message to %1 via %2:%3")
+                           .arg(dest)
+                           .arg(route->nextHop.toString())
+                           .arg(route->nextPort),
+                            LogCategory::Forwarding, LogLevel::Debug);
+        } else {
+            // No route found, broadcast to neighbors
+            broadcastMessage(forwardMsg);
+            addToMessageLog(QString("Broadcasting private message for %1 (no route)").arg(dest),
+                            LogCategory::Forwarding, LogLevel::Debug);
+        }
+    } else {
+        addToMessageLog(QString("Dropped private message to %1 (hop limit reached)").arg(dest),
+                        LogCategory::Forwarding, LogLevel::Info);
+    }
+}
+
+bool SimpleChatNode::relayPrivateMessage(char* data, int size, const WireFormat::ForwardHeader& header,
+                                         const QHostAddress& senderAddr, quint16 senderPort)
+{
+    // Duplicates are dropped before anything else looks at the packet. It is
+    // only remembered once this path commits; otherwise the decoding path
+    // would take its first copy for a duplicate.
+    static const QString privateType = QStringLiteral("private");
+    const qint64 now = m_clock->elapsed();
+    const bool flooded = !header.origin.isEmpty();
+    const quint64 floodKey = flooded ? SeenCache::key(PrivateFlood, header.origin, header.sequence) : 0;
+    if (flooded && m_seenFloods.contains(floodKey, now)) {
+        const TypeMetrics metrics = typeMetrics(privateType);
+        metrics.packetsIn->add();
+        metrics.bytesIn->add(quint64(size));
+        updatePeerLastSeen(senderAddr, senderPort);
+        m_suppressedPrivate->add();
+        addToMessageLog(QString("Suppressed duplicate from %1 (seq %2)").arg(header.origin).arg(header.sequence),
+                        LogCategory::Forwarding, LogLevel::Debug);
+        return true;
+    }
+
+    // Legacy next hops and broadcasts (no route) need the decoded message
+    const RouteEntry* route = m_routingTable.find(m_nodeIds.find(header.destination));
+    if (!route || !peerSupportsCompact(route->nextHop, route->nextPort)) {
+        return false;
+    }
+
+    // Patch the receive slab and send it on as is; only a queued copy needs its own bytes
+    if (header.hopLimit > 0 && !WireFormat::patchHopLimit(data, size, header, header.hopLimit - 1)) {
+        return false;
+    }
+
+    // Committed: the decoding path never sees this packet, so count it here
+    const TypeMetrics metrics = typeMetrics(privateType);
+    metrics.packetsIn->add();
+    metrics.bytesIn->add(quint64(size));
+    noteWireLevel(senderAddr, senderPort, WireFormat::COMPACT_VERSION);
+    updatePeerLastSeen(senderAddr, senderPort);
+    if (flooded) {
+        m_seenFloods.insert(floodKey, now);
+    }
+
+    if (header.hopLimit == 0) {
+        addToMessageLog(QString("Dropped private message to %1 (hop limit reached)").arg(header.destination),
+                        LogCategory::Forwarding, LogLevel::Info);
+        return true;
+    }
+    if (m_sendScheduler.admit(route->nextHop, route->nextPort, SendScheduler::Interactive, size, now)) {
+        if (m_socket->writeDatagram(QByteArray::fromRawData(data, size), route->nextHop, route->nextPort) < 0) {
+            m_sendDrops->add();
+            addToMessageLog(QString("Send to %1:%2 failed")
+                           .arg(route->nextHop.toString())
+                           .arg(route->nextPort),
+                            LogCategory::General, LogLevel::Warning);
+            return true;
+        }
+    } else if (!transmitQueued(QByteArray(data, size), route->nextHop, route->nextPort, SendScheduler::Interactive)) {
+        return true;  // Counted and logged as a drop already
+    }
+    countSent(privateType, size);
+    m_fastRelays->add();
+    addToMessageLog(QString("Relaying private message to %1 via %2:%3")
+                   .arg(header.destination)
+                   .arg(route->nextHop.toString())
+                   .arg(route->nextPort),
+                    LogCategory::Forwarding, LogLevel::Debug);
+    return true;
+}
+
+bool SimpleChatNode::suppressDuplicate(quint8 kind, const QString& origin, int sequence, Counter* suppressed)
+{
+    if (!m_seenFloods.testAndInsert(SeenCache::key(kind, origin, sequence), m_clock->elapsed())) {
+        return false;
+    }
+    suppressed->add();
+    addToMessageLog(QString("Suppressed duplicate from %1 (seq %2)").arg(origin).arg(sequence),
+                    LogCategory::Forwarding, LogLevel::Debug);
+    return true;
+}
+
+void SimpleChatNode::processNATInfo(const QVariantMap& message, const QHostAddress& senderAddr, quint16 senderPort)
+{
+    QString origin = message["Origin"].toString();
+    
+    // The sender's public endpoint is what we see
+    if (NodeIdTable::isValidName(origin) && origin != m_clientId) {
+        // Store the public endpoint we observed
+        const NodeId originId = m_nodeIds.intern(origin);
+        addPublicEndpoint(originId, senderAddr, senderPort);
+        
+        // If the message contains LastIP/LastPort different from what we see,
+        // the sender is behind NAT
+        QString lastIP = message["LastIP"].toString();
+        quint16 lastPort = message["LastPort"].toUInt();
+        
+        QHostAddress reportedAddr(lastIP);
+
+        // Check if this is a meaningful NAT detection (not just 0.0.0.0 or localhost differences)
+        // and only log once per node
+        bool isRealNAT = (reportedAddr != senderAddr || lastPort != senderPort);
+        bool isNotLocalhost = !reportedAddr.isLoopback() && !senderAddr.isLoopback();
+        bool isNotAnyAddress = !reportedAddr.isNull() && lastIP != "0.0.0.0";
+
+        if (isRealNAT && isNotAnyAddress && !m_natDetected.contains(originId)) {
+            // Only log meaningful NAT scenarios and only once per node
+            if (isNotLocalhost) {
+                addToMessageLog(QString("NAT detected for %1: local %2:%3 → public %4:%5")
+                            .arg(origin)
+                            .arg(lastIP).arg(lastPort)
+                            .arg(senderAddr.toString()).arg(senderPort),
+                                LogCategory::Nat, LogLevel::Info);
+                m_natDetected[originId] = true;
+            }
+        }
+    }
+}
+
+void SimpleChatNode::addPublicEndpoint(NodeId nodeId, const QHostAddress& publicIP, quint16 publicPort)
+{
+    m_publicEndpoints[nodeId] = qMakePair(publicIP, publicPort);
+    
+    // Update routing table if we have a route to this node
+    if (RouteEntry* route = m_routingTable.find(nodeId)) {
+        route->publicIP = publicIP;
+        route->publicPort = publicPort;
+    }
+}
+
+void SimpleChatNode::sendMessageToPeer(const QVariantMap& message, const QHostAddress& addr, quint16 port)
+{
+    const QString type = message.value("Type").toString();
+    QByteArray data = serializeMessage(message, peerSupportsCompact(addr, port));
+    if (transmit(data, addr, port, sendPriority(type))) {
+        countSent(type, data.size());
+    }
+}
+
+void SimpleChatNode::broadcastMessage(const QVariantMap& message)
+{
+    sendToPeers(message, m_peers.values());
+}
+
+void SimpleChatNode::sendToPeers(const QVariantMap& message, const QList<PeerInfo>& peers)
+{
+    // Serialize once per wire format and submit each group as one batched send
+    QVector<DatagramTransport::Destination> compactPeers;
+    QVector<DatagramTransport::Destination> legacyPeers;
+    for (const PeerInfo& peer : peers) {
+        if (peerSupportsCompact(peer.address, peer.port)) {
+            compactPeers.append({peer.address, peer.port});
+        } else {
+            legacyPeers.append({peer.address, peer.port});
+        }
+    }
+    
+    const QString type = message.value("Type").toString();
+    const SendScheduler::Priority priority = sendPriority(type);
+    if (!compactPeers.isEmpty()) {
+        const QByteArray data = serializeMessage(message, true);
+        sendToDestinations(data, compactPeers, priority);
+        countSent(type, data.size(), compactPeers.size());
+    }
+    if (!legacyPeers.isEmpty()) {
+        const QByteArray data = serializeMessage(message, false);
+        sendToDestinations(data, legacyPeers, priority);
+        countSent(type, data.size(), legacyPeers.size());
+    }
+}
+
+void SimpleChatNode::sendToDestinations(const QByteArray& data, const QVector<DatagramTransport::Destination>& destinations,
+                                        SendScheduler::Priority priority)
+{
+    // Whatever the buckets admit still goes out as one batched send
+    const qint64 now = m_clock->elapsed();
+    QVector<DatagramTransport::Destination> admitted;
+    admitted.reserve(destinations.size());
+    for (const DatagramTransport::Destination& destination : destinations) {
+        if (m_sendScheduler.admit(destination.address, destination.port, priority, data.size(), now)) {
+            admitted.append(destination);
+        } else {
+            transmitQueued(data, destination.address, destination.port, priority);
+        }
+    }
+    if (admitted.isEmpty()) {
+        return;
+    }
+    
+    const QVector<qint64> results = m_socket->writeDatagrams(data, admitted);
+    for (int i = 0; i < results.size(); ++i) {
+        if (results[i] < 0) {
+            addToMessageLog(QString("Send to %1:%2 failed")
+                           .arg(admitted[i].address.toString())
+                           .arg(admitted[i].port),
+                            LogCategory::General, LogLevel::Warning);
+        }
+    }
+}
+
+bool SimpleChatNode::transmit(const QByteArray& data, const QHostAddress& addr, quint16 port,
+                              SendScheduler::Priority priority)
+{
+    if (m_sendScheduler.admit(addr, port, priority, data.size(), m_clock->elapsed())) {
+        return m_socket->writeDatagram(data, addr, port) >= 0;
+    }
+    return transmitQueued(data, addr, port, priority);
+}
+
+bool SimpleChatNode::transmitQueued(const QByteArray& data, const QHostAddress& addr, quint16 port,
+                                    SendScheduler::Priority priority)
+{
+    int evicted = 0;
+    const bool queued = m_sendScheduler.enqueue(data, addr, port, priority, m_clock->elapsed(), &evicted);
+    if (evicted > 0) {
+        m_sendDrops->add(quint64(evicted));
+        addToMessageLog(QString("Control queue to %1:%2 full, dropped the %3 oldest")
+                       .arg(addr.toString()).arg(port).arg(evicted),
+                        LogCategory::General, LogLevel::Debug);
+    }
+    if (!queued) {
+        m_sendDrops->add();
+        addToMessageLog(QString("Send queue to %1:%2 full, dropped %3 bytes")
+                       .arg(addr.toString()).arg(port).arg(data.size()),
+                        LogCategory::General, LogLevel::Debug);
+        return false;
+    }
+    armSendTimer();
+    return true;
+}
+
+void SimpleChatNode::flushSendQueue()
+{
+    const qint64 now = m_clock->elapsed();
+    const QVector<SendScheduler::Datagram> ready = m_sendScheduler.drain(now);
+    for (const SendScheduler::Datagram& datagram : ready) {
+        m_socket->writeDatagram(datagram.data, datagram.address, datagram.port);
+        m_sendQueueDelay[datagram.priority]->record(quint64(now - datagram.queuedAtMs));
+    }
+    armSendTimer();
+}
+
+void SimpleChatNode::armSendTimer()
+{
+    qint64 wakeup = m_sendScheduler.nextWakeup(m_clock->elapsed());
+    if (wakeup < 0) {
+        m_sendTimer->stop();
+        return;
+    }
+    int delay = int(qMax<qint64>(0, wakeup - m_clock->elapsed()));
+    if (!m_sendTimer->isActive() || m_sendTimer->remainingTime() > delay) {
+        m_sendTimer->start(delay);
+    }
+}
+
+SendScheduler::Priority SimpleChatNode::sendPriority(const QString& type)
+{
+    // Acks and routing first, then chat; anti-entropy (and anything unknown) last
+    static const QHash<QString, SendScheduler::Priority> priorities = {
+        { QStringLiteral("ack"),                SendScheduler::Control },
+        { QStringLiteral("ack_batch"),          SendScheduler::Control },
+        { QStringLiteral("route_update"),       SendScheduler::Control },
+        { QStringLiteral("route_rumor"),        SendScheduler::Control },
+        { QStringLiteral("discovery"),          SendScheduler::Control },
+        { QStringLiteral("discovery_response"), SendScheduler::Control },
+        { QStringLiteral("stats"),              SendScheduler::Control },
+        { QStringLiteral("stats_response"),     SendScheduler::Control },
+        { QStringLiteral("message"),            SendScheduler::Interactive },
+        { QStringLiteral("private"),            SendScheduler::Interactive },
+    };
+    return priorities.value(type, SendScheduler::Bulk);
+}
+
+void SimpleChatNode::performPeerDiscovery()
+{
+    // Discover peers on local ports
+    QVariantMap discovery;
+    discovery["Type"] = "discovery";
+    discovery["Origin"] = m_clientId;
+    discovery["Port"] = m_port;
+    discovery["LastIP"] = m_socket->localAddress().toString();
+    discovery["LastPort"] = m_port;
+    discovery["Wire"] = WireFormat::WIRE_LEVEL;
+    
+    for (int port = BASE_PORT; port < BASE_PORT + MAX_PORTS; ++port) {
+        if (port != m_port) {
+            sendMessageToPeer(discovery, QHostAddress::LocalHost, port);
+        }
+    }
+    
+    // Forget the token buckets of endpoints that have gone quiet
+    m_sendScheduler.prune(m_clock->elapsed());
+    
+    // Clean up old peers: only the front of the expiry queue can have timed out
+    const QList<PeerInfo> expired = m_peers.expire(m_clock->elapsed(), PEER_TIMEOUT);
+    for (const PeerInfo& peer : expired) {
+        const QString& peerId = peer.peerId;
+        m_peerSync.remove(peer.nodeId);
+        m_peerRtt.remove(peer.nodeId);
+        addToMessageLog(QString("Peer %1 timed out").arg(peerId),
+                        LogCategory::Peers, LogLevel::Info);
+        emit peerRemoved(peerId);
+        
+        // Every route through this peer is lost
+        invalidateRoutesVia(peer.address, peer.port);
+    }
+    
+    // Wire levels outlive neither the peer nor an endpoint that never became
+    // one; a returning peer advertises its level again in its discovery
+    for (auto it = m_wireLevels.begin(); it != m_wireLevels.end(); ) {
+        if (!m_peers.findByEndpoint(it.key().first, it.key().second)) {
+            it = m_wireLevels.erase(it);
+        } else {
+            ++it;
+        }
+    }
+}
+
+void SimpleChatNode::performAntiEntropy()
+{
+    // Peers that understand digests get an 8-byte summary of our clock and
+    // only ask for entries when it differs from theirs. Everyone else (older
+    // builds, or peers we have not heard a digest from yet) gets the full
+    // clock; its Digest field tells newer peers that we speak digests too.
+    QList<PeerInfo> digestPeers;
+    QList<PeerInfo> fullClockPeers;
+    const QList<PeerInfo> peers = m_peers.values();
+    for (const PeerInfo& peer : peers) {
+        // New round: refill the peer's sync push budget
+        PeerSyncState& sync = m_peerSync[peer.nodeId];
+        sync.syncBudget = SYNC_BUDGET_PER_ROUND;
+        if (sync.supportsDigest) {
+            digestPeers.append(peer);
+        } else {
+            fullClockPeers.append(peer);
+        }
+    }
+    
+    if (!digestPeers.isEmpty()) {
+        sendToPeers(buildClockDigestMessage(false), digestPeers);
+    }
+    if (!fullClockPeers.isEmpty()) {
+        sendToPeers(buildVectorClockMessage(0), fullClockPeers);
+    }
+}
+
+QVariantMap SimpleChatNode::buildClockDigestMessage(bool resync) const
+{
+    QVariantMap message;
+    message["Type"] = "clock_digest";
+    message["Origin"] = m_clientId;
+    message["Digest"] = qlonglong(m_myClock.digest);
+    if (resync) {
+        message["Resync"] = 1;
+    }
+    return message;
+}
+
+QVariantMap SimpleChatNode::buildVectorClockMessage(quint64 sinceVersion) const
+{
+    QVariantMap message;
+    message["Type"] = "vector_clock";
+    message["Origin"] = m_clientId;
+    
+    // Only entries that changed after sinceVersion; 0 means the whole clock.
+    // VectorClock carries each origin's contiguous prefix (older builds read
+    // it as the max sequence, which just makes them resend the tail) and
+    // ClockRanges the exception ranges above it as a flat [start, end, ...] list.
+    QVariantMap clockMap;
+    QVariantMap rangesMap;
+    for (auto it = m_myClock.sequences.begin(); it != m_myClock.sequences.end(); ++it) {
+        if (sinceVersion == 0 || m_clockEntryVersion.value(it.key()) > sinceVersion) {
+            const SequenceSet& set = it.value();
+            clockMap[it.key()] = set.prefix;
+            if (!set.ranges.isEmpty()) {
+                QVariantList ranges;
+                for (auto range = set.ranges.begin(); range != set.ranges.end(); ++range) {
+                    ranges << range.key() << range.value();
+                }
+                rangesMap[it.key()] = ranges;
+            }
+        }
+    }
+    message["VectorClock"] = clockMap;
+    if (!rangesMap.isEmpty()) {
+        message["ClockRanges"] = rangesMap;
+    }
+    message["Digest"] = qlonglong(m_myClock.digest);
+    message["Full"] = sinceVersion == 0 ? 1 : 0;
+    
+    return message;
+}
+
+void SimpleChatNode::handleClockDigest(const QVariantMap& message, const QHostAddress& addr, quint16 port)
+{
+    // Only peers (interned when they were added) take part in anti-entropy
+    const NodeId peerId = m_nodeIds.find(message["Origin"].toString());
+    if (peerId == INVALID_NODE_ID) {
+        return;
+    }
+    PeerSyncState& sync = m_peerSync[peerId];
+    sync.supportsDigest = true;
+    
+    if (message["Resync"].toInt()) {
+        // The peer's copy of our clock is inconsistent; start over with a full clock
+        sync.sentVersion = 0;
+    } else if (quint64(message["Digest"].toLongLong()) == m_myClock.digest) {
+        return;  // Clocks agree, nothing to exchange
+    }
+    
+    // Send what changed since our last exchange so the peer can push what we lack
+    sendMessageToPeer(buildVectorClockMessage(sync.sentVersion), addr, port);
+    sync.sentVersion = m_clockVersion;
+}
+
+void SimpleChatNode::handleVectorClock(const QVariantMap& message, const QHostAddress& addr, quint16 port)
+{
+    const NodeId peerId = m_nodeIds.find(message["Origin"].toString());
+    if (peerId == INVALID_NODE_ID) {
+        return;
+    }
+    QVariantMap clockMap = message["VectorClock"].toMap();
+    QVariantMap rangesMap = message["ClockRanges"].toMap();
+    
+    // Older peers send their full max-only clock without a digest; treat
+    // each max as a prefix (their holes were never repairable anyway)
+    if (!message.contains("Digest")) {
+        VectorClock peerClock;
+        for (auto it = clockMap.begin(); it != clockMap.end(); ++it) {
+            SequenceSet set;
+            set.prefix = qMax(0, it.value().toInt());
+            peerClock.sequences[it.key()] = set;
+        }
+        sendMissingMessages(peerId, peerClock, addr, port);
+        return;
+    }
+    
+    PeerSyncState& sync = m_peerSync[peerId];
+    sync.supportsDigest = true;
+    
+    if (message["Full"].toInt()) {
+        sync.clock = VectorClock();
+    }
+    // Each entry is the origin's complete current set, so it replaces ours
+    for (auto it = clockMap.begin(); it != clockMap.end(); ++it) {
+        SequenceSet set;
+        set.prefix = qMax(0, it.value().toInt());
+        const QVariantList ranges = rangesMap.value(it.key()).toList();
+        for (int i = 0; i + 1 < ranges.size(); i += 2) {
+            set.insertRange(ranges[i].toInt(), ranges[i + 1].toInt());
+        }
+        sync.clock.assign(it.key(), set);
+    }
+    
+    // A lost delta leaves our copy behind; rebuild it rather than guess
+    if (sync.clock.digest != quint64(message["Digest"].toLongLong())) {
+        sendMessageToPeer(buildClockDigestMessage(true), addr, port);
+        return;
+    }
+    
+    // Send missing messages
+    sendMissingMessages(peerId, sync.clock, addr, port);
+}
+
+void SimpleChatNode::sendMissingMessages(NodeId peerId, const VectorClock& peerClock,
+                                         const QHostAddress& addr, quint16 port)
+{
+    // Peers that speak digests also accept sync_batch; older ones get one
+    // sync_message per missing message. Either way the peer's per-round budget
+    // caps how much we push, so a long history drains over several rounds
+    // instead of overflowing socket buffers in one burst.
+    PeerSyncState& sync = m_peerSync[peerId];
+    const bool batched = sync.supportsDigest;
+    
+    QVariantList batch;
+    QVariantList timestamps;
+    int batchBytes = 0;
+    auto flushBatch = [&]() {
+        if (batch.isEmpty()) {
+            return;
+        }
+        QVariantMap batchMsg;
+        batchMsg["Type"] = "sync_batch";
+        batchMsg["Origin"] = m_clientId;
+        batchMsg["SyncBatch"] = batch;
+        batchMsg["SyncTimestamps"] = timestamps;
+        sendMessageToPeer(batchMsg, addr, port);
+        batch.clear();
+        timestamps.clear();
+        batchBytes = 0;
+    };
+    
+    // For each origin in our message store
+    bool budgetExhausted = false;
+    for (NodeId origin : m_messageStore.origins()) {
+        // Clocks stay keyed by name: they are hashed into digests and go on the wire
+        const SequenceSet peerSet = peerClock.sequences.value(m_nodeIds.name(origin));
+        
+        // Everything up to the peer's prefix is known to it; above that, send
+        // exactly the sequences that fall outside its exception ranges
+        m_messageStore.forEachSequence(origin, peerSet.prefix, [&](int seq) {
+            if (peerSet.contains(seq)) {
+                return true;
+            }
+            // A backlogged send queue counts as a spent budget
+            if (sync.syncBudget <= 0 || m_sendScheduler.isCongested(addr, port)) {
+                budgetExhausted = true;
+                return false;
+            }
+            --sync.syncBudget;
+            
+            const MessageInfo info = m_messageStore.get(origin, seq);
+            
+            if (!batched) {
+                QVariantMap syncMsg;
+                syncMsg["Type"] = "sync_message";
+                syncMsg["Origin"] = m_clientId;
+                syncMsg["SyncOrigin"] = info.origin;
+                syncMsg["SyncSequence"] = info.sequence;
+                syncMsg["SyncDestination"] = info.destination;
+                syncMsg["SyncText"] = info.chatText;
+                syncMsg["SyncTimestamp"] = info.timestamp.toMSecsSinceEpoch();
+                
+                sendMessageToPeer(syncMsg, addr, port);
+                return true;
+            }
+            
+            // Rough encoded size; a message larger than a batch still goes out alone
+            int entryBytes = info.origin.size() + info.destination.size() + info.chatText.toUtf8().size() + 24;
+            if (!batch.isEmpty() && batchBytes + entryBytes > SYNC_BATCH_BYTES) {
+                flushBatch();
+            }
+            batch.append(QVariant(QVariantList{info.origin, info.sequence, info.destination, info.chatText}));
+            timestamps.append(info.timestamp.toMSecsSinceEpoch());
+            batchBytes += entryBytes;
+            return true;
+        });
+        if (budgetExhausted) {
+            break;  // Resume next round from the peer's updated clock
+        }
+    }
+    
+    flushBatch();
+}
+
+VectorClock SimpleChatNode::getMyVectorClock() const
+{
+    // Maintained incrementally by storeMessage()
+    return m_myClock;
+}
+
+void SimpleChatNode::trackPendingMessage(const QVariantMap& message, NodeId destination)
+{
+    PendingMessage pending;
+    pending.destination = destination;
+    pending.timeoutMs = retransmissionTimeout(destination);
+    pending.sentMs = m_clock->elapsed();
+    pending.compactPayload = serializeMessage(message, true);
+    pending.legacyPayload = serializeMessage(message, false);
+    
+    int sequence = message["Sequence"].toInt();
+    PendingMessage& stored = m_pendingAcks[sequence];
+    stored = pending;
+    scheduleRetransmission(sequence, stored);
+}
+
+bool SimpleChatNode::resolveNextHop(NodeId destination, QHostAddress* addr, quint16* port) const
+{
+    if (const RouteEntry* route = m_routingTable.find(destination)) {
+        *addr = route->nextHop;
+        *port = route->nextPort;
+        return true;
+    }
+    if (const PeerInfo* peer = m_peers.find(destination)) {
+        *addr = peer->address;
+        *port = peer->port;
+        return true;
+    }
+    return false;
+}
+
+int SimpleChatNode::retransmissionTimeout(NodeId destination) const
+{
+    // Chat messages are acked by the next hop, so its RTT is the one that counts.
+    // Broadcasts and unmeasured peers start from the conservative default.
+    QHostAddress addr;
+    quint16 port = 0;
+    if (!resolveNextHop(destination, &addr, &port)) {
+        return RETRANSMISSION_INTERVAL;
+    }
+    const PeerInfo* peer = m_peers.findByEndpoint(addr, port);
+    const RttEstimator* rtt = peer ? m_peerRtt.find(peer->nodeId) : nullptr;
+    if (!rtt) {
+        return RETRANSMISSION_INTERVAL;
+    }
+    return rtt->rto(MIN_RETRANSMISSION_INTERVAL, MAX_RETRANSMISSION_INTERVAL, RETRANSMISSION_INTERVAL);
+}
+
+void SimpleChatNode::handleAck(NodeId ackerId, int sequence)
+{
+    auto it = m_pendingAcks.find(sequence);
+    if (it == m_pendingAcks.end()) {
+        return;
+    }
+    
+    // Karn's algorithm: an ack after a retransmission may answer either copy
+    if (it->attempts == 0) {
+        sampleRtt(ackerId, it->sentMs);
+    }
+    
+    m_pendingAcks.erase(it);
+    m_retransmitWheel.cancel(quint64(sequence));
+}
+
+void SimpleChatNode::handleAckBatch(const QVariantMap& message, NodeId ackerId)
+{
+    // Each entry [origin, cumulative, base, mask] acknowledges every sequence
+    // up to cumulative, base itself and base + 1 + i for each bit i of mask
+    struct Coverage {
+        int cumulative;
+        int base;
+        quint64 mask;
+    };
+    QVector<Coverage> ours;
+    const QVariantList acks = message.value("Acks").toList();
+    for (const QVariant& entry : acks) {
+        const QVariantList fields = entry.toList();
+        if (fields.size() < 4) {
+            continue;
+        }
+        const QString ackOrigin = fields[0].toString();
+        const Coverage coverage{fields[1].toInt(), fields[2].toInt(), fields[3].toULongLong()};
+        
+        // Track acknowledgments in message store (the cumulative part was
+        // recorded when those sequences were acked the first time)
+        const NodeId ackOriginId = m_nodeIds.find(ackOrigin);
+        m_messageStore.acknowledge(ackOriginId, coverage.base, ackerId);
+        for (quint64 bits = coverage.mask; bits; bits &= bits - 1) {
+            m_messageStore.acknowledge(ackOriginId, coverage.base + 1 + qCountTrailingZeroBits(bits), ackerId);
+        }
+        if (ackOrigin == m_clientId) {
+            ours.append(coverage);
+        }
+    }
+    if (ours.isEmpty()) {
+        return;
+    }
+    
+    // One pass over the pending messages clears everything the batch covers
+    qint64 newestSentMs = -1;
+    for (auto it = m_pendingAcks.begin(); it != m_pendingAcks.end(); ) {
+        const int sequence = it.key();
+        bool covered = false;
+        for (const Coverage& coverage : ours) {
+            const int offset = sequence - coverage.base;
+            if (sequence <= coverage.cumulative || offset == 0 ||
+                (offset > 0 && offset <= 64 && ((coverage.mask >> (offset - 1)) & 1))) {
+                covered = true;
+                break;
+            }
+        }
+        if (!covered) {
+            ++it;
+            continue;
+        }
+        if (it->attempts == 0) {
+            newestSentMs = qMax(newestSentMs, it->sentMs);
+        }
+        m_retransmitWheel.cancel(quint64(sequence));
+        it = m_pendingAcks.erase(it);
+    }
+    
+    // One RTT sample per batch, from the newest message sent once (it
+    // includes up to ACK_DELAY of coalescing at the receiver)
+    if (newestSentMs >= 0) {
+        sampleRtt(ackerId, newestSentMs);
+    }
+}
+
+void SimpleChatNode::sampleRtt(NodeId ackerId, qint64 sentMs)
+{
+    if (ackerId == INVALID_NODE_ID) {
+        return;
+    }
+    const qint64 rttMs = qMax<qint64>(0, m_clock->elapsed() - sentMs);
+    RttEstimator& rtt = m_peerRtt[ackerId];
+    rtt.addSample(rttMs);
+    m_ackRtt->record(quint64(rttMs));
+    addToMessageLog(QString("RTT to %1: %2 ms (srtt %3, rttvar %4, rto %5)")
+                   .arg(m_nodeIds.name(ackerId)).arg(rttMs).arg(rtt.srtt()).arg(rtt.rttvar())
+                   .arg(rtt.rto(MIN_RETRANSMISSION_INTERVAL, MAX_RETRANSMISSION_INTERVAL,
+                                RETRANSMISSION_INTERVAL)),
+                    LogCategory::Retransmission, LogLevel::Debug);
+}
+
+void SimpleChatNode::queueAck(const QString& origin, int sequence, const QHostAddress& addr, quint16 port)
+{
+    const QPair<QHostAddress, quint16> endpoint = qMakePair(addr, port);
+    DelayedAcks& acks = m_delayedAcks[endpoint];
+    acks.sequences[origin].append(sequence);
+    if (++acks.count >= ACK_BATCH_SEQUENCES) {
+        sendDelayedAcks(endpoint);
+    } else if (!m_ackTimer->isActive()) {
+        m_ackTimer->start(ACK_DELAY);
+    }
+}
+
+void SimpleChatNode::flushDelayedAcks()
+{
+    const QList<QPair<QHostAddress, quint16>> endpoints = m_delayedAcks.keys();
+    for (const auto& endpoint : endpoints) {
+        sendDelayedAcks(endpoint);
+    }
+}
+
+void SimpleChatNode::sendDelayedAcks(const QPair<QHostAddress, quint16>& endpoint)
+{
+    auto pending = m_delayedAcks.find(endpoint);
+    if (pending == m_delayedAcks.end()) {
+        return;
+    }
+    const DelayedAcks acks = pending.value();
+    m_delayedAcks.erase(pending);
+    
+    QVariantList entries;
+    auto flush = [&]() {
+        if (entries.isEmpty()) {
+            return;
+        }
+        QVariantMap batch;
+        batch["Type"] = "ack_batch";
+        batch["Origin"] = m_clientId;
+        batch["Acks"] = entries;
+        sendMessageToPeer(batch, endpoint.first, endpoint.second);
+        entries.clear();
+    };
+    auto append = [&](const QString& origin, int cumulative, int base, quint64 mask) {
+        entries.append(QVariant(QVariantList{origin, cumulative, base, qulonglong(mask)}));
+        if (entries.size() >= ACK_BATCH_ENTRIES) {
+            flush();
+        }
+    };
+    
+    for (auto it = acks.sequences.constBegin(); it != acks.sequences.constEnd(); ++it) {
+        QVector<int> sequences = it.value();
+        std::sort(sequences.begin(), sequences.end());
+        sequences.erase(std::unique(sequences.begin(), sequences.end()), sequences.end());
+        
+        // Everything we hold contiguously from the origin rides on the
+        // cumulative ack, which also repairs earlier acks that were lost;
+        // the rest goes out as base + 64-sequence bitmaps
+        const int cumulative = m_myClock.sequences.value(it.key()).prefix;
+        bool appended = false;
+        for (int i = 0; i < sequences.size(); ) {
+            if (sequences[i] <= cumulative) {
+                ++i;
+                continue;
+            }
+            const int base = sequences[i];
+            quint64 mask = 0;
+            for (++i; i < sequences.size() && sequences[i] - base <= 64; ++i) {
+                mask |= quint64(1) << (sequences[i] - base - 1);
+            }
+            append(it.key(), cumulative, base, mask);
+            appended = true;
+        }
+        if (!appended) {
+            append(it.key(), cumulative, cumulative, 0);
+        }
+    }
+    flush();
+    m_coalescedAcks->add(quint64(acks.count));
+}
+
+void SimpleChatNode::scheduleRetransmission(int sequence, PendingMessage& pending)
+{
+    // Jitter keeps messages sent together from retransmitting in lockstep
+    int spread = pending.timeoutMs * RETRANSMISSION_JITTER / 100;
+    int timeout = pending.timeoutMs + m_random.bounded(-spread, spread + 1);
+    m_retransmitWheel.schedule(quint64(sequence), m_clock->elapsed() + timeout);
+    armRetransmissionTimer();
+}
+
+void SimpleChatNode::armRetransmissionTimer()
+{
+    qint64 wakeup = m_retransmitWheel.nextWakeup();
+    if (wakeup < 0) {
+        m_retransmissionTimer->stop();
+        return;
+    }
+    int delay = int(qMax<qint64>(0, wakeup - m_clock->elapsed()));
+    if (!m_retransmissionTimer->isActive() || m_retransmissionTimer->remainingTime() > delay) {
+        m_retransmissionTimer->start(delay);
+    }
+}
+
+void SimpleChatNode::checkMessageRetransmission()
+{
+    const QVector<quint64> due = m_retransmitWheel.advance(m_clock->elapsed());
+    
+    for (quint64 key : due) {
+        int seq = int(key);
+        auto it = m_pendingAcks.find(seq);
+        if (it == m_pendingAcks.end()) {
+            continue;
+        }
+        PendingMessage& pending = it.value();
+        
+        if (pending.attempts >= MAX_RETRANSMISSIONS) {
+            addToMessageLog(QString("Giving up on seq %1 to %2 after %3 retransmissions")
+                           .arg(seq).arg(m_nodeIds.name(pending.destination)).arg(pending.attempts),
+                            LogCategory::Retransmission, LogLevel::Info);
+            m_pendingAcks.erase(it);
+            continue;
+        }
+        
+        // Resolve the next hop now; the route may have changed since the first send
+        QHostAddress addr;
+        quint16 port = 0;
+        const bool routed = resolveNextHop(pending.destination, &addr, &port);
+        
+        // A backlogged next hop would only queue the copy behind the original;
+        // wait another timeout without using up an attempt
+        if (routed && m_sendScheduler.isCongested(addr, port)) {
+            m_deferredRetransmissions->add();
+            scheduleRetransmission(seq, pending);
+            continue;
+        }
+        
+        static const QString messageType = QStringLiteral("message");
+        const QByteArray& payload = peerSupportsCompact(addr, port) ? pending.compactPayload
+                                                                    : pending.legacyPayload;
+        const bool sent = routed && transmit(payload, addr, port, SendScheduler::Bulk);
+        
+        // Nothing went out (no next hop, or the write failed): the attempt is
+        // kept for when one can, but only until the whole backoff would have run
+        if (!sent) {
+            if (m_clock->elapsed() - pending.sentMs > qint64(MAX_RETRANSMISSIONS) * MAX_RETRANSMISSION_INTERVAL) {
+                addToMessageLog(QString("Giving up on seq %1 to %2: nothing could be sent")
+                               .arg(seq).arg(m_nodeIds.name(pending.destination)),
+                                LogCategory::Retransmission, LogLevel::Info);
+                m_pendingAcks.erase(it);
+                continue;
+            }
+            addToMessageLog(routed ? QString("Retransmission of seq %1 to %2:%3 failed, retrying later")
+                                         .arg(seq).arg(addr.toString()).arg(port)
+                                   : QString("No route to %1 for seq %2, retrying later")
+                                         .arg(m_nodeIds.name(pending.destination)).arg(seq),
+                            LogCategory::Retransmission, LogLevel::Debug);
+            scheduleRetransmission(seq, pending);
+            continue;
+        }
+        countSent(messageType, payload.size());
+        m_retransmissions->add();
+        
+        ++pending.attempts;
+        pending.timeoutMs = qMin(pending.timeoutMs * 2, MAX_RETRANSMISSION_INTERVAL);
+        addToMessageLog(QString("🔄 Retransmitting seq %1 (attempt %2)").arg(seq).arg(pending.attempts),
+                        LogCategory::Retransmission, LogLevel::Debug);
+        scheduleRetransmission(seq, pending);
+    }
+    
+    armRetransmissionTimer();
+}
+
+void SimpleChatNode::sendDiscovery(const QHostAddress& addr, quint16 port)
+{
+    QVariantMap discovery;
+    discovery["Type"] = "discovery";
+    discovery["Origin"] = m_clientId;
+    discovery["Port"] = m_port;
+    discovery["LastIP"] = m_socket->localAddress().toString();
+    discovery["LastPort"] = m_port;
+    discovery["Wire"] = WireFormat::WIRE_LEVEL;
+    sendMessageToPeer(discovery, addr, port);
+}
+
+void SimpleChatNode::addPeer(NodeId nodeId, const QHostAddress& addr, quint16 port)
+{
+    if (nodeId == m_selfId) return; // Don't add ourselves
+    
+    const QString& peerId = m_nodeIds.name(nodeId);
+    PeerInfo info;
+    info.address = addr;
+    info.port = port;
+    info.lastSeenMs = m_clock->elapsed();
+    info.nodeId = nodeId;
+    info.peerId = peerId;
+    
+    if (m_peers.insert(info)) {
+        addToMessageLog(QString("✅ Peer connected: %1 (%2:%3)")
+                       .arg(peerId)
+                       .arg(addr.toString())
+                       .arg(port),
+                        LogCategory::Peers, LogLevel::Info);
+        emit peerAdded(peerId);
+        
+        // Update routing table with direct route
+        updateRoutingTable(nodeId, addr, port, m_lastSeqNoSeen.value(nodeId, 0), 1, true);
+        
+        // A new neighbor gets our whole table instead of waiting for the next dump
+        if (const PeerInfo* peer = m_peers.find(nodeId)) {
+            sendRouteUpdate(fullRouteList(), true, {*peer});
+        }
+    }
+}
+
+void SimpleChatNode::updatePeerLastSeen(const QHostAddress& addr, quint16 port)
+{
+    m_peers.touch(addr, port, m_clock->elapsed());
+}
+
+QMap<QString, RouteEntry> SimpleChatNode::routingTable() const
+{
+    QMap<QString, RouteEntry> table;
+    m_routingTable.forEach([&](NodeId destination, const RouteEntry& route) {
+        table.insert(m_nodeIds.name(destination), route);
+    });
+    return table;
+}
+
+QList<PeerInfo> SimpleChatNode::getActivePeers() const
+{
+    return m_peers.values();
+}
+
+void SimpleChatNode::storeMessage(const MessageInfo& msgInfo)
+{
+    m_messageStore.store(msgInfo);
+    persistMessage(msgInfo);
+    
+    if (m_myClock.add(msgInfo.origin, msgInfo.sequence)) {
+        m_clockEntryVersion[msgInfo.origin] = ++m_clockVersion;
+    }
+}
+
+bool SimpleChatNode::hasMessage(NodeId origin, int sequence) const
+{
+    return m_messageStore.contains(origin, sequence);
+}
+
+MessageInfo SimpleChatNode::getMessage(NodeId origin, int sequence) const
+{
+    return m_messageStore.get(origin, sequence);
+}
+
+bool SimpleChatNode::openStateLog()
+{
+    // Replay runs before the log accepts appends, so the persist*() calls made
+    // while rebuilding state are no-ops
+    bool ok = m_stateLog.open(m_dataDir, [this](quint8 type, const char* data, int size) {
+        replayStateRecord(type, data, size);
+    });
+    if (!ok) {
+        addToMessageLog(QString("Failed to open data directory %1: %2")
+                       .arg(m_dataDir, m_stateLog.errorString()),
+                        LogCategory::General, LogLevel::Warning);
+        return false;
+    }
+    
+    addToMessageLog(QString("Restored %1 messages and %2 route sequences from %3 (%4 records, next sequence %5)")
+                   .arg(m_messageStore.messageCount())
+                   .arg(m_lastSeqNoSeen.size())
+                   .arg(m_dataDir)
+                   .arg(m_stateLog.replayedRecords())
+                   .arg(m_sequenceNumber),
+                    LogCategory::General, LogLevel::Info);
+    
+    // Replay already reproduces these counters; a log left large by an
+    // earlier run is compacted before it grows further
+    m_persistedCounters = countersRecord();
+    if (m_stateLog.totalBytes() > STATE_CHECKPOINT_BYTES) {
+        checkpointStateLog();
+    }
+    return true;
+}
+
+void SimpleChatNode::replayStateRecord(quint8 type, const char* data, int size)
+{
+    QDataStream stream(QByteArray::fromRawData(data, size));
+    stream.setVersion(QDataStream::Qt_6_0);
+    
+    if (type == MessageRecord) {
+        MessageInfo info;
+        qint64 timestampMs = 0;
+        stream >> info.origin >> info.destination >> info.chatText >> info.sequence >> timestampMs;
+        if (stream.status() != QDataStream::Ok) {
+            return;
+        }
+        info.timestamp = QDateTime::fromMSecsSinceEpoch(timestampMs);
+        storeMessage(info);
+        if (info.origin == m_clientId) {
+            m_sequenceNumber = qMax(m_sequenceNumber, info.sequence + 1);
+        }
+    } else if (type == CountersRecord) {
+        qint32 sequenceNumber = 0;
+        qint32 dsdvSequenceNumber = 0;
+        qint32 privateSequenceNumber = 0;
+        stream >> sequenceNumber >> dsdvSequenceNumber;
+        if (stream.status() == QDataStream::Ok) {
+            m_sequenceNumber = qMax(m_sequenceNumber, int(sequenceNumber));
+            m_dsdvSequenceNumber = qMax(m_dsdvSequenceNumber, int(dsdvSequenceNumber));
+        }
+        // Records written before private messages had their own counter stop here
+        if (!stream.atEnd()) {
+            stream >> privateSequenceNumber;
+            if (stream.status() == QDataStream::Ok) {
+                m_privateSequenceNumber = qMax(m_privateSequenceNumber, int(privateSequenceNumber));
+            }
+        }
+    } else if (type == RouteSequenceRecord || type == RouteRecord) {
+        // A restored route's next hop is not a peer yet, so nothing would ever
+        // expire it; keep only its sequence and let neighbors re-advertise it
+        QString destination;
+        qint32 seqNo = 0;
+        stream >> destination;
+        if (type == RouteRecord) {
+            QHostAddress nextHop;
+            quint16 nextPort = 0;
+            stream >> nextHop >> nextPort;
+        }
+        stream >> seqNo;
+        if (stream.status() == QDataStream::Ok) {
+            recordRouteSequence(m_nodeIds.intern(destination), seqNo);
+        }
+    }
+    // RouteRemovedRecord has nothing left to undo; unknown record types come
+    // from newer builds. Skip them.
+}
+
+QByteArray SimpleChatNode::messageRecord(const MessageInfo& msgInfo)
+{
+    QByteArray payload;
+    QDataStream stream(&payload, QIODevice::WriteOnly);
+    stream.setVersion(QDataStream::Qt_6_0);
+    stream << msgInfo.origin << msgInfo.destination << msgInfo.chatText
+           << qint32(msgInfo.sequence) << msgInfo.timestamp.toMSecsSinceEpoch();
+    return payload;
+}
+
+QByteArray SimpleChatNode::countersRecord() const
+{
+    QByteArray payload;
+    QDataStream stream(&payload, QIODevice::WriteOnly);
+    stream.setVersion(QDataStream::Qt_6_0);
+    stream << qint32(m_sequenceNumber) << qint32(m_dsdvSequenceNumber) << qint32(m_privateSequenceNumber);
+    return payload;
+}
+
+QByteArray SimpleChatNode::routeSequenceRecord(const QString& destination, int seqNo)
+{
+    // Records carry names: NodeIds are only stable within one run
+    QByteArray payload;
+    QDataStream stream(&payload, QIODevice::WriteOnly);
+    stream.setVersion(QDataStream::Qt_6_0);
+    stream << destination << qint32(seqNo);
+    return payload;
+}
+
+void SimpleChatNode::persistMessage(const MessageInfo& msgInfo)
+{
+    if (!m_stateLog.isOpen()) {
+        return;
+    }
+    appendStateRecord(MessageRecord, messageRecord(msgInfo));
+}
+
+void SimpleChatNode::persistCounters()
+{
+    if (!m_stateLog.isOpen()) {
+        return;
+    }
+    // Full dumps bump nothing when nobody outbid us; only changes are logged
+    QByteArray payload = countersRecord();
+    if (payload == m_persistedCounters) {
+        return;
+    }
+    m_persistedCounters = payload;
+    appendStateRecord(CountersRecord, payload);
+}
+
+void SimpleChatNode::persistRouteSequence(NodeId destination, int seqNo)
+{
+    if (!m_stateLog.isOpen()) {
+        return;
+    }
+    appendStateRecord(RouteSequenceRecord, routeSequenceRecord(m_nodeIds.name(destination), seqNo));
+}
+
+void SimpleChatNode::appendStateRecord(StateRecordType type, const QByteArray& payload)
+{
+    m_stateLog.append(type, payload);
+
+    // Compact once the log is twice what the last snapshot needed, so
+    // rewriting a large store stays amortized over as many appends
+    if (m_stateLog.totalBytes() > qMax(STATE_CHECKPOINT_BYTES, 2 * m_checkpointBytes)) {
+        checkpointStateLog();
+    }
+}
+
+void SimpleChatNode::checkpointStateLog()
+{
+    // Everything replayStateRecord() rebuilds: messages, counters and route sequences
+    const qint64 before = m_stateLog.totalBytes();
+    bool ok = m_stateLog.checkpoint([this]() {
+        bool written = m_stateLog.append(CountersRecord, countersRecord());
+        for (NodeId origin : m_messageStore.origins()) {
+            m_messageStore.forEachSequence(origin, 0, [&](int sequence) {
+                written = m_stateLog.append(MessageRecord, messageRecord(m_messageStore.get(origin, sequence)));
+                return written;
+            });
+            if (!written) {
+                return false;
+            }
+        }
+        m_lastSeqNoSeen.forEach([&](NodeId destination, int seqNo) {
+            written = written && m_stateLog.append(RouteSequenceRecord,
+                                                   routeSequenceRecord(m_nodeIds.name(destination), seqNo));
+        });
+        return written;
+    });
+    m_persistedCounters = countersRecord();
+    m_checkpointBytes = m_stateLog.totalBytes();
+    if (!ok) {
+        addToMessageLog(QString("State log checkpoint failed: %1").arg(m_stateLog.errorString()),
+                        LogCategory::General, LogLevel::Warning);
+        return;
+    }
+    addToMessageLog(QString("Checkpointed state log: %1 -> %2 bytes").arg(before).arg(m_checkpointBytes),
+                    LogCategory::General, LogLevel::Info);
+}
+
+void SimpleChatNode::addToMessageLog(const QString& text, LogCategory category, LogLevel level)
+{
+    if (isLogEnabled(category, level)) {
+        emit logMessage(text);
+    }
+}
+
+SimpleChatNode::TypeMetrics SimpleChatNode::typeMetrics(const QString& type)
+{
+    auto it = m_typeMetrics.constFind(type);
+    if (it != m_typeMetrics.constEnd()) {
+        return it.value();
+    }
+    
+    // Peers can send any Type; everything we do not speak shares one series
+    const QString key = WireFormat::isKnownType(type) ? type : QStringLiteral("other");
+    it = m_typeMetrics.constFind(key);
+    if (it != m_typeMetrics.constEnd()) {
+        return it.value();
+    }
+    const QString label = QString("type=\"%1\"").arg(key);
+    TypeMetrics metrics;
+    metrics.packetsIn = m_metrics.counter("simplechat_packets_in_total", label);
+    metrics.bytesIn = m_metrics.counter("simplechat_bytes_in_total", label);
+    metrics.packetsOut = m_metrics.counter("simplechat_packets_out_total", label);
+    metrics.bytesOut = m_metrics.counter("simplechat_bytes_out_total", label);
+    metrics.dispatchNs = m_metrics.histogram("simplechat_dispatch_ns", label);
+    m_typeMetrics.insert(key, metrics);
+    return metrics;
+}
+
+void SimpleChatNode::countSent(const QString& type, int bytes, int packets)
+{
+    const TypeMetrics metrics = typeMetrics(type);
+    metrics.packetsOut->add(quint64(packets));
+    metrics.bytesOut->add(quint64(bytes) * quint64(packets));
+}
+
+void SimpleChatNode::recordDeliveryLatency(Histogram* histogram, qint64 timestampMs)
+{
+    // Old senders leave Timestamp out; a clock behind the origin's reads negative
+    if (timestampMs <= 0) {
+        return;
+    }
+    const qint64 latencyMs = m_clock->currentMSecsSinceEpoch() - timestampMs;
+    if (latencyMs >= 0) {
+        histogram->record(quint64(latencyMs));
+    }
+}
+
+void SimpleChatNode::dumpMetrics()
+{
+    // QSaveFile swaps the file in whole, so readers never see a partial dump
+    QSaveFile file(m_metricsPath);
+    if (!file.open(QIODevice::WriteOnly)) {
+        addToMessageLog(QString("Cannot write metrics to %1: %2").arg(m_metricsPath, file.errorString()),
+                        LogCategory::General, LogLevel::Warning);
+        return;
+    }
+    file.write(QString("# %1 at %2 ms\n").arg(m_clientId).arg(m_clock->currentMSecsSinceEpoch()).toUtf8());
+    file.write(m_metrics.snapshot().toUtf8());
+    if (!file.commit()) {
+        addToMessageLog(QString("Cannot write metrics to %1: %2").arg(m_metricsPath, file.errorString()),
+                        LogCategory::General, LogLevel::Warning);
+    }
+}
+
+bool SimpleChatNode::setLogLevels(const QString& spec)
+{
+    static const char* const categoryNames[] = {
+        "general", "peers", "routing", "forwarding", "retransmission", "sync", "nat"
+    };
+    static const char* const levelNames[] = { "debug", "info", "warning", "off" };
+    
+    LogLevel levels[int(LogCategory::Count)];
+    std::copy(std::begin(m_logLevels), std::end(m_logLevels), levels);
+    
+    const QStringList entries = spec.split(',', Qt::SkipEmptyParts);
+    for (const QString& entry : entries) {
+        const QStringList parts = entry.trimmed().toLower().split('=');
+        if (parts.size() != 2) {
+            return false;
+        }
+        int level = -1;
+        for (int i = 0; i < 4; ++i) {
+            if (parts[1] == levelNames[i]) {
+                level = i;
+            }
+        }
+        if (level < 0) {
+            return false;
+        }
+        bool matched = false;
+        for (int i = 0; i < int(LogCategory::Count); ++i) {
+            if (parts[0] == "all" || parts[0] == categoryNames[i]) {
+                levels[i] = LogLevel(level);
+                matched = true;
+            }
+        }
+        if (!matched) {
+            return false;
+        }
+    }
+    
+    std::copy(std::begin(levels), std::end(levels), m_logLevels);
+    return true;
+}
+
+QByteArray SimpleChatNode::serializeMessage(const QVariantMap& message, bool compact)
+{
+    if (compact) {
+        QByteArray data = WireFormat::encodeCompact(message);
+        if (!data.isEmpty()) {
+            return data;
+        }
+    }
+    return WireFormat::encodeLegacy(message);
+}
+
+QVariantMap SimpleChatNode::deserializeMessage(const char* data, int size)
+{
+    return WireFormat::decode(data, size);
+}
+
+bool SimpleChatNode::peerSupportsCompact(const QHostAddress& addr, quint16 port) const
+{
+    return wireLevel(addr, port) >= WireFormat::COMPACT_VERSION;
+}
+
+void SimpleChatNode::noteWireLevel(const QHostAddress& addr, quint16 port, int level, bool replace)
+{
+    int& known = m_wireLevels[qMakePair(addr, port)];
+    known = replace ? level : qMax(known, level);
+}
@@ -0,0 +1,460 @@
+#ifndef SIMPLECHAT_NODE_H
+#define SIMPLECHAT_NODE_H
+
+#include <QObject>
+#include <QMetaType>
+#include "datagramsocket.h"
+#include "nodeclock.h"
+#include "messagestore.h"
+#include "metrics.h"
+#include "segmentedlog.h"
+#include "sendscheduler.h"
+#include "timerwheel.h"
+#include "peertable.h"
+#include "rttestimator.h"
+#include "seencache.h"
+#include "receiveworker.h"
+#include "wireformat.h"
+#include <QRandomGenerator>
+#include <QMap>
+#include <QSet>
+#include <QVariantMap>
+#include <QDateTime>
+
+// Sequence numbers seen from one origin: the contiguous prefix 1..prefix plus
+// disjoint exception ranges above it (what arrived after a lost packet)
+struct SequenceSet {
+    int prefix = 0;
+    QMap<int, int> ranges; // start -> end (inclusive); never adjacent to prefix or each other
+
+    // Add [start, end]; returns true if the set changed
+    bool insertRange(int start, int end);
+    bool insert(int seq) { return insertRange(seq, seq); }
+    bool contains(int seq) const;
+    int maxSequence() const;
+};
+
+// Version vector for anti-entropy
+struct VectorClock {
+    QMap<QString, SequenceSet> sequences; // origin -> sequences seen
+    quint64 digest = 0;                   // XOR of entryHash() over all entries, kept current by add()/assign()
+
+    // Record one sequence from origin; returns true if the clock changed
+    bool add(const QString& origin, int seq);
+    // Replace origin's entry wholesale (used when applying a peer's clock)
+    void assign(const QString& origin, const SequenceSet& set);
+
+    // Platform-independent hash of one origin's entry
+    static quint64 entryHash(const QString& origin, const SequenceSet& set);
+};
+
+// DSDV Routing Table Entry
+struct RouteEntry {
+    QHostAddress nextHop;  // Next hop IP address
+    quint16 nextPort;      // Next hop port
+    int sequenceNumber;    // DSDV sequence number
+    int hopCount;          // Number of hops to destination
+    QDateTime lastUpdate;  // When this route was last updated
+    bool isDirect;         // Whether this is a direct route (for NAT traversal preference)
+
+    // NAT traversal fields
+    QHostAddress publicIP;    // Public IP discovered through NAT
+    quint16 publicPort;      // Public port discovered through NAT
+};
+Q_DECLARE_METATYPE(RouteEntry)
+
+// Headless node engine: UDP socket, DSDV routing, anti-entropy and retransmission.
+// Depends only on QtCore/QtNetwork so relay nodes and benchmarks can run it
+// without a QApplication; the GUI is a view that listens to its signals.
+class SimpleChatNode : public QObject
+{
+    Q_OBJECT
+
+public:
+    // Log lines are tagged with a category and a level; a line is emitted
+    // through logMessage() only if its level reaches the category's threshold
+    enum class LogCategory { General, Peers, Routing, Forwarding, Retransmission, Sync, Nat, Count };
+    enum class LogLevel { Debug, Info, Warning, Off };
+
+    SimpleChatNode(const QString& clientId, int port, bool noForward = false, QObject *parent = nullptr);
+    ~SimpleChatNode();
+
+    // Persist messages and sequence counters under dir (one directory
+    // per node). Must be called before start(), which replays what is there.
+    void setDataDirectory(const QString& dir) { m_dataDir = dir; }
+
+    // Receive on count SO_REUSEPORT sockets (this thread plus count-1 worker
+    // threads) instead of one; meant for busy rendezvous nodes. Must be called
+    // before start().
+    void setReceiveWorkers(int count) { m_receiveWorkers = qMax(1, count); }
+
+    // Replace the UDP socket, the system clock and the random seed; the
+    // simulator uses these to run many nodes over a virtual network. The node
+    // takes ownership of the transport (receive workers need the real socket
+    // and are not started with one), not of the clock. Call before start().
+    void setTransport(DatagramTransport* transport);
+    void setClock(NodeClock* clock) { m_clock = clock; }
+    void setRandomSeed(quint32 seed) { m_random.seed(seed); }
+
+    // Outbound pacing (see sendscheduler.h); rates of 0 disable a bucket.
+    // Call before start().
+    void setSendLimits(const SendScheduler::Limits& limits) { m_sendScheduler.setLimits(limits); }
+
+    // Rewrite the metrics snapshot to path every intervalMs. Call before start().
+    void setMetricsDump(const QString& path, int intervalMs);
+
+    // Counters, histograms and gauges in Prometheus text format. The same
+    // snapshot answers "stats" requests from loopback senders.
+    QString metricsSnapshot() const { return m_metrics.snapshot(); }
+
+    // Binds the socket and starts the protocol timers; returns false if the bind
+    // (or opening the data directory) failed
+    bool start();
+
+    // Fixed at construction; safe to read from any thread
+    QString clientId() const { return m_clientId; }
+    int port() const { return m_port; }
+    bool noForwardMode() const { return m_noForwardMode; }
+
+    // Per-category log thresholds (default Debug: everything is shown)
+    void setLogLevel(LogCategory category, LogLevel level) { m_logLevels[int(category)] = level; }
+    LogLevel logLevel(LogCategory category) const { return m_logLevels[int(category)]; }
+    // Applies a spec such as "forwarding=off,retransmission=info" ("all" sets
+    // every category); returns false and changes nothing if it does not parse
+    bool setLogLevels(const QString& spec);
+
+    // Message store statistics
+    int storedMessageCount() const { return m_messageStore.messageCount(); }
+    qint64 storeMemoryUsage() const { return m_messageStore.memoryUsage(); }
+
+    // User actions
+    void sendChatMessage(const QString& destination, const QString& text);
+    void broadcastChatMessage(const QString& text);
+    void sendPrivateMessage(const QString& destination, const QString& text);
+    void sendDiscovery(const QHostAddress& addr, quint16 port);
+
+    // Read-only views, keyed by name. Like every other non-const member these
+    // must be called from the node's own thread; the GUI runs the node on a
+    // network thread and follows the signals below instead.
+    QMap<QString, RouteEntry> routingTable() const;
+    QStringList peerIds() const { return m_peers.names(); }
+    int peerCount() const { return m_peers.size(); }
+
+signals:
+    // Arguments are copies, so these can be delivered across threads
+    void logMessage(const QString& text);
+    void messageDelivered(const QString& origin, const QString& destination,
+                          const QString& chatText, bool isPrivate);
+    void routeChanged(const QString& destination, const RouteEntry& route);
+    void routeRemoved(const QString& destination);
+    void peerAdded(const QString& peerId);
+    void peerRemoved(const QString& peerId);
+
+private slots:
+    void performPeerDiscovery();
+    void performAntiEntropy();
+    void checkMessageRetransmission();
+    void sendFullDump();        // DSDV periodic full-table advertisement
+    void sendTriggeredUpdate(); // DSDV incremental advertisement of changed routes
+    void processReceivedBatch(const QVector<ReceivedDatagram>& batch);
+    void flushSendQueue();
+    void flushDelayedAcks();
+    void dumpMetrics();
+
+private:
+    // Microbenchmarks (bench.cpp) drive the private hot paths directly
+    friend class NodeBench;
+    friend class tst_Node;
+
+    // Unacknowledged messages we originated. Each one sits in m_retransmitWheel
+    // (keyed by sequence) until it is acked or runs out of attempts; the wire
+    // bytes are encoded once and reused for every retransmission.
+    struct PendingMessage {
+        NodeId destination;
+        int attempts = 0;           // Retransmissions so far
+        int timeoutMs = 0;          // Current backoff, before jitter
+        qint64 sentMs = 0;          // First transmission; acked before any retransmission = RTT sample
+        QByteArray compactPayload;
+        QByteArray legacyPayload;
+    };
+
+    void addToMessageLog(const QString& text, LogCategory category = LogCategory::General,
+                         LogLevel level = LogLevel::Info);
+    bool isLogEnabled(LogCategory category, LogLevel level) const { return level >= m_logLevels[int(category)]; }
+
+    // Per message type series; the pointers are owned by m_metrics
+    struct TypeMetrics {
+        Counter* packetsIn = nullptr;
+        Counter* bytesIn = nullptr;
+        Counter* packetsOut = nullptr;
+        Counter* bytesOut = nullptr;
+        Histogram* dispatchNs = nullptr;  // processReceivedMessage() time
+    };
+    TypeMetrics typeMetrics(const QString& type);
+    void countSent(const QString& type, int bytes, int packets = 1);
+    void recordDeliveryLatency(Histogram* histogram, qint64 timestampMs);
+
+    // Message handling
+    void dispatchReceived(const QVariantMap& message, const QString& type, int bytes,
+                          const QHostAddress& senderAddr, quint16 senderPort, bool answered = false);
+    void processDatagram(char* data, int size, const QHostAddress& senderAddr, quint16 senderPort);
+    void processReceivedMessage(const QVariantMap& message, const QHostAddress& senderAddr, quint16 senderPort,
+                                bool answered = false);
+    void sendMessageToPeer(const QVariantMap& message, const QHostAddress& addr, quint16 port);
+    void broadcastMessage(const QVariantMap& message);
+    void sendToPeers(const QVariantMap& message, const QList<PeerInfo>& peers);
+    void sendToDestinations(const QByteArray& data, const QVector<DatagramTransport::Destination>& destinations,
+                            SendScheduler::Priority priority);
+    // Every datagram goes through m_sendScheduler: straight out when the
+    // buckets allow, queued otherwise. data must own its bytes. False if the
+    // write failed or the queue dropped it.
+    bool transmit(const QByteArray& data, const QHostAddress& addr, quint16 port, SendScheduler::Priority priority);
+    // Queue-only half of transmit(), for callers whose admit() was refused
+    bool transmitQueued(const QByteArray& data, const QHostAddress& addr, quint16 port,
+                        SendScheduler::Priority priority);
+    void armSendTimer();
+    static SendScheduler::Priority sendPriority(const QString& type);
+
+    // DSDV Routing
+    void updateRoutingTable(NodeId destination, const QHostAddress& nextHop, quint16 nextPort,
+                          int seqNo, int hopCount, bool isDirect = false);
+    void processRouteRumor(const QVariantMap& message, const QHostAddress& senderAddr, quint16 senderPort);
+    void processRouteUpdate(const QVariantMap& message, const QHostAddress& senderAddr, quint16 senderPort);
+    void sendRouteUpdate(const QVariantList& routes, bool full, const QList<PeerInfo>& peers);
+    void sendRouteRumors(const QVariantList& routes, const QList<PeerInfo>& peers);
+    QVariantList fullRouteList() const;
+    void scheduleTriggeredUpdate();
+    void invalidateRoutesVia(const QHostAddress& nextHop, quint16 nextPort);
+    void breakRoute(NodeId destination, int seqNo);
+    void recordRouteSequence(NodeId destination, int seqNo);
+    void bumpOwnSequence();
+    void forwardPrivateMessage(const QVariantMap& message);
+    // Fast path for compact private messages: forwards the received bytes with
+    // only HopLimit patched; false if the message needs the decoding path
+    bool relayPrivateMessage(char* data, int size, const WireFormat::ForwardHeader& header,
+                             const QHostAddress& senderAddr, quint16 senderPort);
+    // True (and counted) if this flooded packet went through here within the
+    // seen-cache window; remembers it otherwise
+    bool suppressDuplicate(quint8 kind, const QString& origin, int sequence, Counter* suppressed);
+    bool isBetterRoute(const RouteEntry& oldRoute, const RouteEntry& newRoute);
+
+    // NAT Traversal
+    void processNATInfo(const QVariantMap& message, const QHostAddress& senderAddr, quint16 senderPort);
+    void addPublicEndpoint(NodeId nodeId, const QHostAddress& publicIP, quint16 publicPort);
+
+    // Message storage
+    void storeMessage(const MessageInfo& msgInfo);
+    bool hasMessage(NodeId origin, int sequence) const;
+    MessageInfo getMessage(NodeId origin, int sequence) const;
+
+    // Persistence (see segmentedlog.h)
+    enum StateRecordType : quint8 {
+        MessageRecord = 1,
+        CountersRecord = 2,
+        RouteRecord = 3,        // Written by older builds; only the sequence is replayed
+        RouteRemovedRecord = 4, // Written by older builds; ignored
+        RouteSequenceRecord = 5
+    };
+    bool openStateLog();
+    void replayStateRecord(quint8 type, const char* data, int size);
+    void persistMessage(const MessageInfo& msgInfo);
+    void persistCounters();
+    // Routes themselves are relearned from neighbors after a restart; only
+    // the highest sequence seen per destination survives, so it never goes back
+    void persistRouteSequence(NodeId destination, int seqNo);
+    void appendStateRecord(StateRecordType type, const QByteArray& payload);
+    void checkpointStateLog();
+    static QByteArray messageRecord(const MessageInfo& msgInfo);
+    QByteArray countersRecord() const;
+    static QByteArray routeSequenceRecord(const QString& destination, int seqNo);
+
+    // Serialization (see wireformat.h)
+    QByteArray serializeMessage(const QVariantMap& message, bool compact);
+    QVariantMap deserializeMessage(const char* data, int size);
+    bool peerSupportsCompact(const QHostAddress& addr, quint16 port) const;
+    int wireLevel(const QHostAddress& addr, quint16 port) const { return m_wireLevels.value(qMakePair(addr, port)); }
+    // Raises the endpoint's level (a packet that needs it arrived) or, with
+    // replace, sets it outright (the Wire field of a discovery)
+    void noteWireLevel(const QHostAddress& addr, quint16 port, int level, bool replace = false);
+
+    // Anti-entropy
+    QVariantMap buildVectorClockMessage(quint64 sinceVersion) const;
+    QVariantMap buildClockDigestMessage(bool resync) const;
+    void handleClockDigest(const QVariantMap& message, const QHostAddress& addr, quint16 port);
+    void handleVectorClock(const QVariantMap& message, const QHostAddress& addr, quint16 port);
+    void sendMissingMessages(NodeId peerId, const VectorClock& peerClock,
+                             const QHostAddress& addr, quint16 port);
+    bool storeSyncedMessage(const QString& origin, int sequence, const QString& destination,
+                            const QString& chatText, qint64 timestampMs);
+    VectorClock getMyVectorClock() const;
+
+    // Retransmission
+    void trackPendingMessage(const QVariantMap& message, NodeId destination);
+    bool resolveNextHop(NodeId destination, QHostAddress* addr, quint16* port) const;
+    int retransmissionTimeout(NodeId destination) const;
+    void handleAck(NodeId ackerId, int sequence);
+    void sampleRtt(NodeId ackerId, qint64 sentMs);
+    void handleAckBatch(const QVariantMap& message, NodeId ackerId);
+    // Acks for peers that accept ack_batch wait up to ACK_DELAY and go out together
+    void queueAck(const QString& origin, int sequence, const QHostAddress& addr, quint16 port);
+    void sendDelayedAcks(const QPair<QHostAddress, quint16>& endpoint);
+    void scheduleRetransmission(int sequence, PendingMessage& pending);
+    void armRetransmissionTimer();
+
+    // Peer management
+    void addPeer(NodeId peerId, const QHostAddress& addr, quint16 port);
+    void updatePeerLastSeen(const QHostAddress& addr, quint16 port);
+    QList<PeerInfo> getActivePeers() const;
+
+    // Network Components
+    DatagramTransport* m_socket;
+    int m_receiveWorkers;
+    ReceiveWorkerPool* m_workerPool;  // Only with more than one receive socket
+    SharedRouteTable m_sharedRoutes;  // Rumor sequences the workers filter against
+
+    // Timers (created by m_clock in start())
+    NodeTimer* m_discoveryTimer;       // Peer discovery
+    NodeTimer* m_antiEntropyTimer;     // Anti-entropy sync
+    NodeTimer* m_retransmissionTimer;  // Single-shot, armed for the next TimerWheel wakeup
+    NodeTimer* m_fullDumpTimer;        // DSDV full dumps
+    NodeTimer* m_triggeredUpdateTimer; // Single-shot, batches changed routes into one update
+    NodeTimer* m_metricsDumpTimer;     // Only with setMetricsDump()
+    NodeTimer* m_sendTimer;            // Single-shot, armed for when the send queue can move
+    NodeTimer* m_ackTimer;             // Single-shot, flushes delayed acks
+
+    // Configuration
+    QString m_clientId;
+    int m_port;
+    int m_sequenceNumber;           // Chat messages; every one is stored, so the clock prefix advances
+    int m_privateSequenceNumber;    // Private messages, which are never stored or synced
+    int m_dsdvSequenceNumber;       // DSDV sequence number we advertise for ourselves (even once started)
+    bool m_noForwardMode;           // No-forward mode for rendezvous server
+    LogLevel m_logLevels[int(LogCategory::Count)];
+
+    // Every node name we have seen; everything below is keyed by NodeId
+    NodeIdTable m_nodeIds;
+    NodeId m_selfId;
+
+    // Message storage
+    MessageStore m_messageStore;
+    QString m_dataDir;              // Empty = no persistence
+    SegmentedLog m_stateLog;
+    QByteArray m_persistedCounters; // Last counters record, so unchanged counters are not rewritten
+    qint64 m_checkpointBytes;       // Log size right after the last checkpoint
+
+    QHash<int, PendingMessage> m_pendingAcks; // sequence -> pending message
+    NodeMap<RttEstimator> m_peerRtt;          // acking peer -> smoothed RTT
+    
+    // Acks not yet sent to one endpoint
+    struct DelayedAcks {
+        QMap<QString, QVector<int>> sequences; // origin -> sequences received since the last flush
+        int count = 0;
+    };
+    QHash<QPair<QHostAddress, quint16>, DelayedAcks> m_delayedAcks;
+    
+    TimerWheel m_retransmitWheel;
+    SystemClock m_systemClock;
+    NodeClock* m_clock;             // m_systemClock unless replaced with setClock()
+    QRandomGenerator m_random;      // Backoff jitter and rumor peer choice
+    
+    // Anti-entropy state. m_myClock is updated by storeMessage(); every entry
+    // remembers the m_clockVersion at which it last changed so a peer can be
+    // sent only the entries that moved since our previous exchange with it.
+    struct PeerSyncState {
+        quint64 sentVersion = 0;      // m_clockVersion when we last sent this peer our clock
+        bool supportsDigest = false;  // Peer speaks clock_digest (sent a Digest field)
+        VectorClock clock;            // Our copy of the peer's clock, built from its deltas
+        int syncBudget = SYNC_BUDGET_PER_ROUND; // Messages we may still push this round
+    };
+    VectorClock m_myClock;
+    quint64 m_clockVersion;
+    QMap<QString, quint64> m_clockEntryVersion; // origin -> m_clockVersion of last change
+    NodeMap<PeerSyncState> m_peerSync;          // peer -> sync state
+
+    // Peer management
+    PeerTable m_peers;
+
+    // DSDV Routing
+    //
+    // Sequence numbers are issued by each destination (even) and bumped to the
+    // next odd value by a neighbor that loses its route, advertised with
+    // INFINITE_METRIC. A route is replaced by a newer sequence, or by a shorter
+    // path at the same sequence. Changes go out in triggered updates; a newer
+    // sequence that arrived over a longer path is held back for about twice the
+    // destination's settling time (how long the best path for a sequence tends
+    // to lag the first one) so one slow path does not flap the whole network.
+    struct RouteSettling {
+        int sequence = -1;          // Sequence the timing below refers to
+        qint64 firstHeardMs = 0;    // When that sequence first arrived
+        qint64 settleMs = 0;        // Running average of first-to-best delay
+        qint64 advertiseAtMs = 0;   // Earliest triggered advertisement
+    };
+    NodeMap<RouteEntry> m_routingTable;     // destination -> RouteEntry
+    NodeMap<int> m_lastSeqNoSeen;           // destination -> highest sequence number seen
+    NodeMap<RouteSettling> m_routeSettling; // destination -> settling-time state
+    NodeMap<int> m_brokenRoutes;            // destination -> odd sequence still to advertise as unreachable
+    QSet<NodeId> m_pendingAdvertisements;   // Destinations for the next triggered update
+    bool m_advertiseSelf;                   // Our own sequence changed outside a full dump
+
+    // Metrics
+    MetricsRegistry m_metrics;
+    QHash<QString, TypeMetrics> m_typeMetrics; // Known types, plus "other"
+    Counter* m_retransmissions;
+    Counter* m_fastRelays;          // Private messages relayed without decoding
+    Counter* m_coalescedAcks;       // Sequences acknowledged through ack_batch
+    Counter* m_undecodable;         // Datagrams that decoded to nothing
+    Histogram* m_ackRtt;            // Send-to-ack time of messages sent once (ms)
+    // Origin Timestamp to arrival (ms), by how the message got here. Across
+    // hosts this includes the offset between their wall clocks.
+    Histogram* m_directLatency;     // Chat messages
+    Histogram* m_routedLatency;     // Private messages
+    Histogram* m_syncLatency;       // Anti-entropy
+    QString m_metricsPath;
+    int m_metricsIntervalMs;
+
+    // Outbound queues and token buckets
+    SendScheduler m_sendScheduler;
+    Counter* m_sendDrops;           // Datagrams refused by a full queue or evicted from a full Control queue
+    Counter* m_deferredRetransmissions; // Held back because the next hop was congested
+    Histogram* m_sendQueueDelay[SendScheduler::PriorityCount]; // Time spent queued (ms)
+
+    // Flooded packets seen recently, keyed on (kind, origin, sequence)
+    enum FloodKind : quint8 { PrivateFlood = 1, RumorFlood = 2 };
+    SeenCache m_seenFloods;
+    Counter* m_suppressedPrivate;   // Private messages dropped as duplicates
+    Counter* m_suppressedRumors;    // Route rumors dropped as duplicates
+
+    // Wire feature level per endpoint (see wireformat.h); absent = legacy.
+    // Kept for current peers only.
+    QHash<QPair<QHostAddress, quint16>, int> m_wireLevels;
+
+    // NAT Traversal
+    NodeMap<QPair<QHostAddress, quint16>> m_publicEndpoints; // nodeId -> (publicIP, publicPort)
+    NodeMap<bool> m_natDetected; // Track which nodes we've already logged NAT detection for
+
+    // Constants
+    static const int DISCOVERY_INTERVAL = 5000;    // 5 seconds
+    static const int ANTI_ENTROPY_INTERVAL = 3000; // 3 seconds
+    static const int RETRANSMISSION_INTERVAL = 2000; // Timeout until a peer's RTT has been sampled
+    static const int MIN_RETRANSMISSION_INTERVAL = TimerWheel::TICK_MS; // Floor of the adaptive timeout
+    static const int MAX_RETRANSMISSION_INTERVAL = 32000; // Backoff cap
+    static const int MAX_RETRANSMISSIONS = 6;      // Then anti-entropy is left to deliver it
+    static const int ACK_DELAY = 20;               // Longest an ack waits to be coalesced
+    static const int ACK_BATCH_SEQUENCES = 64;     // Queued sequences that flush an endpoint at once
+    static const int ACK_BATCH_ENTRIES = 48;       // Acks entries per ack_batch datagram
+    static const int RETRANSMISSION_JITTER = 25;   // +/- percent applied to every timeout
+    static const int FULL_DUMP_INTERVAL = 15000;   // Periodic full routing table advertisement
+    static const int TRIGGERED_UPDATE_DELAY = 250; // Changes are batched for this long
+    static const int MAX_SETTLING_DELAY = 10000;   // Cap on holding back a longer route
+    static const int INFINITE_METRIC = 16;         // Hop count advertised for lost routes
+    static const int ROUTES_PER_UPDATE = 64;       // Entries per route_update datagram
+    static const int PEER_TIMEOUT = 30000;         // 30 seconds
+    static const int BASE_PORT = 9000;
+    static const int MAX_PORTS = 10;
+    static const int DEFAULT_HOP_LIMIT = 10;       // Default hop limit for private messages
+    static const int SYNC_BUDGET_PER_ROUND = 512;  // Sync messages pushed per peer per anti-entropy round
+    static const int SYNC_BATCH_BYTES = 1200;      // Payload target for one sync_batch (fits a 1280-byte MTU)
+    static const qint64 STATE_CHECKPOINT_BYTES = 2 * SegmentedLog::SEGMENT_BYTES; // Log size that triggers a checkpoint
+};
+
+#endif // SIMPLECHAT_NODE_H
@@ -0,0 +1,309 @@
+#include <QCoreApplication>
+#include <QCommandLineParser>
+#include <QElapsedTimer>
+#include <QHashFunctions>
+#include <QTextStream>
+#include <QVector>
+#include <cmath>
+#include <functional>
+#include <memory>
+#include "simnetwork.h"
+#include "simplechatnode.h"
+
+// In-process network simulator: runs many node engines over SimNetwork on one
+// virtual clock and reports route convergence, anti-entropy catch-up and the
+// traffic each node generated. Runs are deterministic for a given seed.
+
+namespace {
+
+const quint16 SIM_PORT = 7000;  // Outside the localhost range nodes probe on their own
+const int STEP_MS = 10;         // Granularity of the convergence checks
+
+struct Link {
+    int a;
+    int b;
+};
+
+QVector<Link> buildTopology(const QString& topology, int nodes, int degree, QRandomGenerator& random)
+{
+    QVector<Link> links;
+    if (topology == "line" || topology == "ring") {
+        for (int i = 1; i < nodes; ++i) {
+            links.append(Link{i - 1, i});
+        }
+        if (topology == "ring" && nodes > 2) {
+            links.append(Link{nodes - 1, 0});
+        }
+    } else if (topology == "grid") {
+        const int side = int(std::ceil(std::sqrt(double(nodes))));
+        for (int i = 0; i < nodes; ++i) {
+            if ((i % side) + 1 < side && i + 1 < nodes) {
+                links.append(Link{i, i + 1});
+            }
+            if (i + side < nodes) {
+                links.append(Link{i, i + side});
+            }
+        }
+    } else {
+        // Random connected graph: every node joins up to degree earlier ones
+        for (int i = 1; i < nodes; ++i) {
+            QVector<int> chosen;
+            const int wanted = qMin(i, degree);
+            while (chosen.size() < wanted) {
+                int peer = random.bounded(i);
+                if (!chosen.contains(peer)) {
+                    chosen.append(peer);
+                    links.append(Link{peer, i});
+                }
+            }
+        }
+    }
+    return links;
+}
+
+int findRoot(QVector<int>& parent, int i)
+{
+    while (parent[i] != i) {
+        parent[i] = parent[parent[i]];
+        i = parent[i];
+    }
+    return i;
+}
+
+} // namespace
+
+int main(int argc, char *argv[])
+{
+    // QHash iteration order must not depend on a per-process seed
+    QHashSeed::setDeterministicGlobalSeed();
+
+    QCoreApplication app(argc, argv);
+    app.setApplicationName("simplechat_sim");
+
+    QCommandLineParser parser;
+    parser.setApplicationDescription("SimpleChat - in-process network simulator");
+    parser.addHelpOption();
+
+    QCommandLineOption nodesOption(QStringList() << "n" << "nodes", "Number of nodes", "count", "100");
+    parser.addOption(nodesOption);
+    QCommandLineOption topologyOption(QStringList() << "t" << "topology",
+                                      "line, ring, grid or random", "name", "random");
+    parser.addOption(topologyOption);
+    QCommandLineOption degreeOption("degree", "Links each node adds in the random topology", "count", "2");
+    parser.addOption(degreeOption);
+    QCommandLineOption latencyOption("latency", "One-way link latency", "ms", "5");
+    parser.addOption(latencyOption);
+    QCommandLineOption jitterOption("jitter", "Extra random delay per datagram, up to", "ms", "0");
+    parser.addOption(jitterOption);
+    QCommandLineOption lossOption("loss", "Datagram loss probability", "p", "0");
+    parser.addOption(lossOption);
+    QCommandLineOption reorderOption("reorder", "Probability a datagram is delayed past later ones", "p", "0");
+    parser.addOption(reorderOption);
+    QCommandLineOption natOption("nat", "Fraction of nodes behind an address-restricted NAT", "fraction", "0");
+    parser.addOption(natOption);
+    QCommandLineOption messagesOption(QStringList() << "m" << "messages",
+                                      "Broadcasts sent after convergence to time anti-entropy catch-up",
+                                      "count", "50");
+    parser.addOption(messagesOption);
+    QCommandLineOption seedOption(QStringList() << "s" << "seed", "Random seed", "seed", "1");
+    parser.addOption(seedOption);
+    QCommandLineOption maxTimeOption("max-time", "Virtual time limit per phase", "seconds", "600");
+    parser.addOption(maxTimeOption);
+
+    parser.process(app);
+
+    const int nodeCount = qBound(2, parser.value(nodesOption).toInt(), 100000);
+    const QString topology = parser.value(topologyOption);
+    const int degree = qMax(1, parser.value(degreeOption).toInt());
+    const double natFraction = qBound(0.0, parser.value(natOption).toDouble(), 1.0);
+    const int messageCount = qMax(0, parser.value(messagesOption).toInt());
+    const quint32 seed = parser.value(seedOption).toUInt();
+    const qint64 maxTimeMs = qMax(1, parser.value(maxTimeOption).toInt()) * 1000LL;
+
+    LinkProfile link;
+    link.latencyMs = qMax(0, parser.value(latencyOption).toInt());
+    link.jitterMs = qMax(0, parser.value(jitterOption).toInt());
+    link.loss = qBound(0.0, parser.value(lossOption).toDouble(), 1.0);
+    link.reorder = qBound(0.0, parser.value(reorderOption).toDouble(), 1.0);
+
+    QTextStream out(stdout);
+    QElapsedTimer wallClock;
+    wallClock.start();
+
+    SimClock clock;
+    SimNetwork network(&clock, seed);
+    network.setDefaultLink(link);
+    QRandomGenerator random(seed);
+
+    // Hosts: public 10.x.y.z; a NATed host sees itself as 172.16.x.y
+    QVector<SimpleChatNode*> nodes;
+    QVector<SimTransport*> transports;
+    QVector<QSet<QString>> reachable(nodeCount);
+    std::vector<std::unique_ptr<SimpleChatNode>> owner;
+    int natted = 0;
+    for (int i = 0; i < nodeCount; ++i) {
+        const QHostAddress publicAddress(quint32(0x0A000001u + quint32(i)));
+        const bool behindNat = i > 0 && random.generateDouble() < natFraction;
+        const QHostAddress localAddress = behindNat ? QHostAddress(quint32(0xAC100001u + quint32(i)))
+                                                    : publicAddress;
+        natted += behindNat ? 1 : 0;
+
+        auto* node = new SimpleChatNode(QString("Sim%1").arg(i), SIM_PORT);
+        owner.emplace_back(node);
+        node->setLogLevels("all=off");
+        node->setClock(&clock);
+        node->setRandomSeed(seed * 2654435761u + quint32(i));
+        auto* transport = new SimTransport(&network, localAddress, publicAddress);
+        node->setTransport(transport);
+
+        QObject::connect(node, &SimpleChatNode::routeChanged, [&reachable, i](const QString& destination) {
+            reachable[i].insert(destination);
+        });
+        QObject::connect(node, &SimpleChatNode::routeRemoved, [&reachable, i](const QString& destination) {
+            reachable[i].remove(destination);
+        });
+        nodes.append(node);
+        transports.append(transport);
+    }
+
+    // Two NATed hosts cannot reach each other directly; such links never form
+    const QVector<Link> allLinks = buildTopology(topology, nodeCount, degree, random);
+    QVector<Link> links;
+    for (const Link& l : allLinks) {
+        if (!(transports[l.a]->behindNat() && transports[l.b]->behindNat())) {
+            links.append(l);
+        }
+    }
+
+    // What full convergence means: every node reaches the rest of its component
+    QVector<int> parent(nodeCount);
+    for (int i = 0; i < nodeCount; ++i) {
+        parent[i] = i;
+    }
+    for (const Link& l : links) {
+        parent[findRoot(parent, l.a)] = findRoot(parent, l.b);
+    }
+    QVector<int> componentSize(nodeCount, 0);
+    for (int i = 0; i < nodeCount; ++i) {
+        componentSize[findRoot(parent, i)]++;
+    }
+
+    for (SimpleChatNode* node : nodes) {
+        if (!node->start()) {
+            out << "Failed to start " << node->clientId() << Qt::endl;
+            return 1;
+        }
+    }
+
+    // Links are made by discovery from the NATed (or higher-numbered) end,
+    // retried every discovery interval until both ends list each other
+    std::function<void(int)> connectLink = [&](int index) {
+        const Link& l = links[index];
+        const bool aInitiates = transports[l.a]->behindNat();
+        SimpleChatNode* from = nodes[aInitiates ? l.a : l.b];
+        SimTransport* to = transports[aInitiates ? l.b : l.a];
+        const QString toName = nodes[aInitiates ? l.b : l.a]->clientId();
+        if (from->peerIds().contains(toName)) {
+            return;
+        }
+        from->sendDiscovery(to->publicAddress(), SIM_PORT);
+        clock.schedule(clock.elapsed() + 5000, [&connectLink, index]() { connectLink(index); });
+    };
+    for (int i = 0; i < links.size(); ++i) {
+        clock.schedule(0, [&connectLink, i]() { connectLink(i); });
+    }
+
+    auto converged = [&]() {
+        for (int i = 0; i < nodeCount; ++i) {
+            if (reachable[i].size() < componentSize[findRoot(parent, i)] - 1) {
+                return false;
+            }
+        }
+        return true;
+    };
+
+    // Phase 1: routes
+    bool ok = true;
+    qint64 convergenceMs = -1;
+    while (clock.elapsed() < maxTimeMs) {
+        clock.runUntil(clock.elapsed() + STEP_MS);
+        if (converged()) {
+            convergenceMs = clock.elapsed();
+            break;
+        }
+    }
+    ok = ok && convergenceMs >= 0;
+
+    // Phase 2: Sim0 broadcasts; only its neighbors hear it directly, everyone
+    // else has to catch up through anti-entropy
+    qint64 catchUpMs = -1;
+    if (messageCount > 0) {
+        const qint64 phaseStart = clock.elapsed();
+        for (int m = 0; m < messageCount; ++m) {
+            nodes[0]->broadcastChatMessage(QString("sim message %1").arg(m + 1));
+        }
+        const int root = findRoot(parent, 0);
+        while (clock.elapsed() - phaseStart < maxTimeMs) {
+            clock.runUntil(clock.elapsed() + STEP_MS);
+            bool done = true;
+            for (int i = 0; i < nodeCount && done; ++i) {
+                done = findRoot(parent, i) != root || nodes[i]->storedMessageCount() >= messageCount;
+            }
+            if (done) {
+                catchUpMs = clock.elapsed() - phaseStart;
+                break;
+            }
+        }
+        ok = ok && catchUpMs >= 0;
+    }
+
+    // Traffic per node over the whole run
+    SimTransportStats total;
+    SimTransportStats peak;
+    for (SimTransport* transport : transports) {
+        const SimTransportStats& stats = transport->stats();
+        total.packetsSent += stats.packetsSent;
+        total.bytesSent += stats.bytesSent;
+        total.packetsReceived += stats.packetsReceived;
+        total.bytesReceived += stats.bytesReceived;
+        total.packetsLost += stats.packetsLost;
+        total.packetsUnreachable += stats.packetsUnreachable;
+        peak.packetsSent = qMax(peak.packetsSent, stats.packetsSent);
+        peak.bytesSent = qMax(peak.bytesSent, stats.bytesSent);
+        peak.packetsReceived = qMax(peak.packetsReceived, stats.packetsReceived);
+        peak.bytesReceived = qMax(peak.bytesReceived, stats.bytesReceived);
+    }
+    const double seconds = qMax<qint64>(1, clock.elapsed()) / 1000.0;
+    auto perNode = [&](quint64 value) { return QString::number(double(value) / nodeCount, 'f', 1); };
+    auto rate = [&](quint64 value) { return QString::number(double(value) / nodeCount / seconds, 'f', 1); };
+    auto timeOrTimeout = [](qint64 ms) {
+        return ms >= 0 ? QString("%1 ms").arg(ms) : QString("timeout");
+    };
+
+    out << "=== SimpleChat network simulation ===" << Qt::endl;
+    out << "nodes " << nodeCount << ", topology " << topology;
+    if (topology != "line" && topology != "ring" && topology != "grid") {
+        out << " (degree " << degree << ")";
+    }
+    out << ", " << links.size() << " links, seed " << seed << Qt::endl;
+    out << "link: latency " << link.latencyMs << " ms, jitter " << link.jitterMs << " ms, loss "
+        << link.loss << ", reorder " << link.reorder << "; " << natted << " nodes behind NAT ("
+        << allLinks.size() - links.size() << " NAT-to-NAT links dropped)" << Qt::endl;
+    out << "route convergence:     " << timeOrTimeout(convergenceMs) << Qt::endl;
+    if (messageCount > 0) {
+        out << "anti-entropy catch-up: " << timeOrTimeout(catchUpMs)
+            << " (" << messageCount << " broadcasts from Sim0)" << Qt::endl;
+    }
+    out << "per node over " << clock.elapsed() << " ms       sent / received" << Qt::endl;
+    out << "  packets  mean  " << perNode(total.packetsSent) << " / " << perNode(total.packetsReceived)
+        << "  max " << peak.packetsSent << " / " << peak.packetsReceived
+        << "  per s " << rate(total.packetsSent) << " / " << rate(total.packetsReceived) << Qt::endl;
+    out << "  bytes    mean  " << perNode(total.bytesSent) << " / " << perNode(total.bytesReceived)
+        << "  max " << peak.bytesSent << " / " << peak.bytesReceived
+        << "  per s " << rate(total.bytesSent) << " / " << rate(total.bytesReceived) << Qt::endl;
+    out << "  lost " << total.packetsLost << ", unreachable " << total.packetsUnreachable << Qt::endl;
+    out << "simulated in " << wallClock.elapsed() << " ms wall time (" << clock.eventsRun() << " events)"
+        << Qt::endl;
+
+    return ok ? 0 : 1;
+}
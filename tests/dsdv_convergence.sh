@@ -0,0 +1,81 @@
+#!/bin/bash
+
+# DSDV Convergence Measurement for SimpleChat
+# Builds line topologies of increasing diameter (node i peers only with node i-1)
+# and reports how long the far end takes to learn a route to the first node
+# with the correct hop count.
+#
+# Usage: tests/dsdv_convergence.sh [diameter...]   (default: 1 2 4 8)
+
+echo "=== SimpleChat DSDV Convergence vs. Network Diameter ==="
+
+BUILD_DIR="./build/bin"
+BASE_PORT=9100          # Outside the 9000-9009 range scanned by peer discovery
+TIMEOUT_SECONDS=60
+
+# Check if executable exists
+if [ ! -f "$BUILD_DIR/SimpleChat" ]; then
+    echo "Error: SimpleChat executable not found. Building first..."
+    ./build.sh
+    if [ $? -ne 0 ]; then
+        echo "Build failed. Cannot proceed with testing."
+        exit 1
+    fi
+fi
+
+# Function to cleanup processes
+cleanup() {
+    pkill -f "SimpleChat --client Conv" 2>/dev/null
+    sleep 1
+}
+
+# Set up cleanup trap
+trap cleanup EXIT
+
+now_ms() {
+    echo $(( $(date +%s%N) / 1000000 ))
+}
+
+DIAMETERS=("$@")
+if [ ${#DIAMETERS[@]} -eq 0 ]; then
+    DIAMETERS=(1 2 4 8)
+fi
+
+FAILED=0
+printf "\n%-10s %-8s %s\n" "diameter" "nodes" "convergence"
+
+for D in "${DIAMETERS[@]}"; do
+    cleanup
+    rm -f /tmp/dsdv_conv_*.log
+
+    # Line: Conv0 - Conv1 - ... - ConvD
+    for ((i = 0; i <= D; i++)); do
+        PORT=$((BASE_PORT + i))
+        PEER_ARGS=""
+        if [ $i -gt 0 ]; then
+            PEER_ARGS="--peer 127.0.0.1:$((PORT - 1))"
+        fi
+        $BUILD_DIR/SimpleChat --client Conv$i --port $PORT --headless $PEER_ARGS \
+            > /tmp/dsdv_conv_$i.log 2>&1 &
+    done
+    START=$(now_ms)
+
+    # The far end has converged once it has the full-length route to Conv0
+    CONVERGED=""
+    while [ $(( $(now_ms) - START )) -lt $((TIMEOUT_SECONDS * 1000)) ]; do
+        if grep -qE "route to Conv0 via .*hops $D\)" /tmp/dsdv_conv_$D.log 2>/dev/null; then
+            CONVERGED=$(( $(now_ms) - START ))
+            break
+        fi
+        sleep 0.05
+    done
+
+    if [ -n "$CONVERGED" ]; then
+        printf "%-10s %-8s %s ms\n" "$D" "$((D + 1))" "$CONVERGED"
+    else
+        printf "%-10s %-8s %s\n" "$D" "$((D + 1))" "timeout (${TIMEOUT_SECONDS}s)"
+        FAILED=1
+    fi
+done
+
+exit $FAILED
@@ -0,0 +1,62 @@
+#include <QtTest>
+#include <QtNetwork/QUdpSocket>
+#include "datagramsocket.h"
+
+// Real UDP socket on loopback: long datagrams that spill past their receive slot
+class tst_DatagramSocket : public QObject
+{
+    Q_OBJECT
+
+private slots:
+    void receivesSeveralLongDatagramsInOneBatch();
+
+private:
+    // A port that was free a moment ago
+    static quint16 freePort()
+    {
+        QUdpSocket probe;
+        return probe.bind(QHostAddress::LocalHost, 0) ? probe.localPort() : 0;
+    }
+
+    static QByteArray pattern(int index, int size)
+    {
+        QByteArray datagram(size, Qt::Uninitialized);
+        for (int i = 0; i < size; ++i) {
+            datagram[i] = char((index * 31 + i) % 251);
+        }
+        return datagram;
+    }
+};
+
+void tst_DatagramSocket::receivesSeveralLongDatagramsInOneBatch()
+{
+    const quint16 port = freePort();
+    QVERIFY(port != 0);
+    DatagramSocket socket;
+    QVERIFY2(socket.bind(port), qPrintable(socket.errorString()));
+
+    QList<QByteArray> received;
+    socket.setReceiveHandler([&received](char* data, int size, const QHostAddress&, quint16) {
+        received.append(QByteArray(data, size));
+    });
+
+    // Everything is queued before the event loop runs, so one drain sees the
+    // lot: long datagrams of several sizes with short ones between them
+    const int slot = DatagramSocket::RECV_SLOT_SIZE;
+    const QList<int> sizes{slot + 1, 100, 20000, 3 * slot, 7, slot, 9000};
+    QList<QByteArray> sent;
+    QUdpSocket sender;
+    for (int i = 0; i < sizes.size(); ++i) {
+        sent.append(pattern(i, sizes[i]));
+        QCOMPARE(sender.writeDatagram(sent.last(), QHostAddress::LocalHost, port), qint64(sizes[i]));
+    }
+
+    QTRY_COMPARE(received.size(), sent.size());
+    for (int i = 0; i < sent.size(); ++i) {
+        QVERIFY2(received[i] == sent[i], qPrintable(QString("datagram %1 of %2 bytes").arg(i).arg(sizes[i])));
+    }
+    QCOMPARE(socket.droppedDatagrams(), quint64(0));
+}
+
+QTEST_GUILESS_MAIN(tst_DatagramSocket)
+#include "tst_datagramsocket.moc"
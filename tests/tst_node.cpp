@@ -0,0 +1,65 @@
+#include <QtTest>
+#include <memory>
+#include "simnetwork.h"
+#include "simplechatnode.h"
+
+// Node engines over the in-process simulated network (see simnetwork.h)
+class tst_Node : public QObject
+{
+    Q_OBJECT
+
+private slots:
+    void privateMessagesLeaveNoSequenceGaps();
+
+private:
+    static const quint16 SIM_PORT = 7000;
+
+    static std::unique_ptr<SimpleChatNode> makeNode(const QString& name, const QHostAddress& address,
+                                                    SimClock* clock, SimNetwork* network)
+    {
+        std::unique_ptr<SimpleChatNode> node(new SimpleChatNode(name, SIM_PORT));
+        node->setLogLevels("all=off");
+        node->setClock(clock);
+        node->setRandomSeed(1);
+        node->setTransport(new SimTransport(network, address, address));
+        return node;
+    }
+};
+
+void tst_Node::privateMessagesLeaveNoSequenceGaps()
+{
+    SimClock clock;
+    SimNetwork network(&clock, 1);
+    const QHostAddress addressA(quint32(0x0A000001u));
+    const QHostAddress addressB(quint32(0x0A000002u));
+    std::unique_ptr<SimpleChatNode> a = makeNode("A", addressA, &clock, &network);
+    std::unique_ptr<SimpleChatNode> b = makeNode("B", addressB, &clock, &network);
+    QVERIFY(a->start());
+    QVERIFY(b->start());
+
+    b->sendDiscovery(addressA, SIM_PORT);
+    clock.runUntil(1000);
+    QVERIFY(a->peerIds().contains("B"));
+
+    // Only chat messages are stored, so only they may use the chat sequence space
+    const int chats = 5;
+    for (int i = 0; i < chats; ++i) {
+        a->sendChatMessage("B", QString("chat %1").arg(i));
+        a->sendPrivateMessage("B", QString("private %1").arg(i));
+    }
+    clock.runUntil(clock.elapsed() + 5000);
+
+    const SequenceSet own = a->m_myClock.sequences.value("A");
+    QCOMPARE(own.prefix, chats);
+    QVERIFY(own.ranges.isEmpty());
+
+    const SequenceSet seen = b->m_myClock.sequences.value("A");
+    QCOMPARE(seen.prefix, chats);
+    QVERIFY(seen.ranges.isEmpty());
+
+    // Every chat message was acknowledged, so nothing is left to retransmit
+    QVERIFY(a->m_pendingAcks.isEmpty());
+}
+
+QTEST_GUILESS_MAIN(tst_Node)
+#include "tst_node.moc"
@@ -0,0 +1,202 @@
+#include <QtTest>
+#include <QTemporaryDir>
+#include <QtEndian>
+#include "segmentedlog.h"
+
+// Append-only state log: recovery of torn writes at the tail
+class tst_SegmentedLog : public QObject
+{
+    Q_OBJECT
+
+private slots:
+    void replaysInAppendOrder();
+    void truncatesTornTail_data();
+    void truncatesTornTail();
+    void rebuildsLostIndex();
+    void checkpointDropsOlderSegments();
+
+private:
+    using Record = QPair<quint8, QByteArray>;  // (type, payload)
+
+    static QList<Record> replay(SegmentedLog& log, const QString& directory)
+    {
+        QList<Record> records;
+        if (!log.open(directory, [&records](quint8 type, const char* payload, int size) {
+                records.append(Record(type, QByteArray(payload, size)));
+            })) {
+            records.append(Record(0, log.errorString().toUtf8()));
+        }
+        return records;
+    }
+
+    static QList<Record> writeRecords(const QString& directory, int count)
+    {
+        QList<Record> records;
+        SegmentedLog log;
+        if (!log.open(directory, nullptr)) {
+            return records;
+        }
+        for (int i = 0; i < count; ++i) {
+            const Record record(quint8(1 + i % 3), QByteArray(10 + i, char('a' + i)));
+            if (log.append(record.first, record.second)) {
+                records.append(record);
+            }
+        }
+        return records;
+    }
+
+    static QString segmentPath(const QString& directory, int segmentId)
+    {
+        return QDir(directory).filePath(QString("seg-%1.log").arg(segmentId, 6, 10, QChar('0')));
+    }
+
+    static bool appendRaw(const QString& path, const QByteArray& bytes)
+    {
+        QFile file(path);
+        return file.open(QIODevice::WriteOnly | QIODevice::Append) && file.write(bytes) == bytes.size();
+    }
+
+    // A whole record in the on-disk layout, optionally with a bad checksum
+    static QByteArray rawRecord(quint8 type, const QByteArray& payload, bool corrupt)
+    {
+        quint32 hash = 2166136261u;
+        hash = (hash ^ type) * 16777619u;
+        for (char c : payload) {
+            hash = (hash ^ quint8(c)) * 16777619u;
+        }
+        if (corrupt) {
+            hash ^= 1;
+        }
+        QByteArray record(9, Qt::Uninitialized);
+        qToLittleEndian<quint32>(quint32(payload.size()), record.data());
+        record[4] = char(type);
+        qToLittleEndian<quint32>(hash, record.data() + 5);
+        return record + payload;
+    }
+};
+
+void tst_SegmentedLog::replaysInAppendOrder()
+{
+    QTemporaryDir dir;
+    QVERIFY(dir.isValid());
+    const QList<Record> written = writeRecords(dir.path(), 20);
+    QCOMPARE(written.size(), 20);
+
+    SegmentedLog log;
+    QCOMPARE(replay(log, dir.path()), written);
+    QCOMPARE(log.replayedRecords(), qint64(20));
+    QCOMPARE(log.segmentCount(), 1);
+}
+
+void tst_SegmentedLog::truncatesTornTail_data()
+{
+    QTest::addColumn<QByteArray>("tail");
+
+    const QByteArray whole = rawRecord(2, QByteArray("lost record"), false);
+    QTest::newRow("torn header") << whole.left(5);
+    QTest::newRow("torn payload") << whole.left(whole.size() - 1);
+    QTest::newRow("bad checksum") << rawRecord(2, QByteArray("lost record"), true);
+    QTest::newRow("huge length") << QByteArray("\xFF\xFF\xFF\x7F\x02\x00\x00\x00\x00xyz", 12);
+}
+
+void tst_SegmentedLog::truncatesTornTail()
+{
+    QFETCH(QByteArray, tail);
+    QTemporaryDir dir;
+    QVERIFY(dir.isValid());
+    const QList<Record> written = writeRecords(dir.path(), 5);
+    const QString segment = segmentPath(dir.path(), 1);
+    const qint64 intactSize = QFileInfo(segment).size();
+
+    // Bytes past the index's committed mark, as a crash mid-write leaves them
+    QVERIFY(appendRaw(segment, tail));
+
+    {
+        SegmentedLog log;
+        QCOMPARE(replay(log, dir.path()), written);
+        QCOMPARE(QFileInfo(segment).size(), intactSize);
+
+        // Appends continue right after the last whole record
+        QVERIFY(log.append(3, QByteArray("after recovery")));
+    }
+
+    SegmentedLog log;
+    QList<Record> expected = written;
+    expected.append(Record(3, QByteArray("after recovery")));
+    QCOMPARE(replay(log, dir.path()), expected);
+}
+
+void tst_SegmentedLog::rebuildsLostIndex()
+{
+    QTemporaryDir dir;
+    QVERIFY(dir.isValid());
+    const QList<Record> written = writeRecords(dir.path(), 5);
+    const QString segment = segmentPath(dir.path(), 1);
+    QVERIFY(appendRaw(segment, rawRecord(1, QByteArray("torn"), false).left(7)));
+
+    // Without an index every record is verified, so the torn tail still goes
+    QVERIFY(QFile::remove(QDir(dir.path()).filePath("index")));
+    {
+        SegmentedLog log;
+        QCOMPARE(replay(log, dir.path()), written);
+        QCOMPARE(log.segmentCount(), 1);
+    }
+
+    // A damaged record in the middle ends replay there when nothing is trusted
+    QFile file(segment);
+    QVERIFY(file.open(QIODevice::ReadWrite));
+    QByteArray bytes = file.readAll();
+    const int secondPayload = 9 + written[0].second.size() + 9;
+    bytes[secondPayload] = char(bytes[secondPayload] ^ 0xFF);
+    QVERIFY(file.seek(0));
+    QCOMPARE(file.write(bytes), qint64(bytes.size()));
+    file.close();
+    QVERIFY(QFile::remove(QDir(dir.path()).filePath("index")));
+
+    SegmentedLog log;
+    QCOMPARE(replay(log, dir.path()), written.mid(0, 1));
+}
+
+void tst_SegmentedLog::checkpointDropsOlderSegments()
+{
+    QTemporaryDir dir;
+    QVERIFY(dir.isValid());
+    writeRecords(dir.path(), 5);
+
+    const QList<Record> snapshot{Record(2, QByteArray("state a")), Record(2, QByteArray("state b"))};
+    {
+        SegmentedLog log;
+        QVERIFY(log.open(dir.path(), nullptr));
+        QVERIFY(log.checkpoint([&log, &snapshot]() {
+            for (const Record& record : snapshot) {
+                if (!log.append(record.first, record.second)) {
+                    return false;
+                }
+            }
+            return true;
+        }));
+        QCOMPARE(log.segmentCount(), 1);
+        QCOMPARE(log.totalBytes(), qint64(2 * 9 + 7 + 7));
+        QVERIFY(log.append(3, QByteArray("after checkpoint")));
+    }
+    QVERIFY(!QFile::exists(segmentPath(dir.path(), 1)));
+
+    SegmentedLog log;
+    QList<Record> expected = snapshot;
+    expected.append(Record(3, QByteArray("after checkpoint")));
+    QCOMPARE(replay(log, dir.path()), expected);
+
+    // A failed snapshot keeps everything, so replay still reaches the same state
+    QVERIFY(!log.checkpoint([&log]() {
+        log.append(2, QByteArray("partial"));
+        return false;
+    }));
+    QCOMPARE(log.segmentCount(), 2);
+    log.close();
+    SegmentedLog reopened;
+    expected.append(Record(2, QByteArray("partial")));
+    QCOMPARE(replay(reopened, dir.path()), expected);
+}
+
+QTEST_GUILESS_MAIN(tst_SegmentedLog)
+#include "tst_segmentedlog.moc"
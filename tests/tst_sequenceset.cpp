@@ -0,0 +1,97 @@
+#include <QtTest>
+#include <limits>
+#include "messagestore.h"
+#include "simplechatnode.h"
+
+// Sequence bookkeeping: merging ranges and walking stored sequences, up to INT_MAX
+class tst_SequenceSet : public QObject
+{
+    Q_OBJECT
+
+private slots:
+    void mergesRanges();
+    void acceptsIntMax();
+    void walksStoreUpToIntMax();
+
+private:
+    static const int LAST = std::numeric_limits<int>::max();
+
+    static QList<int> sequencesAfter(const MessageStore& store, NodeId origin, int after)
+    {
+        QList<int> sequences;
+        store.forEachSequence(origin, after, [&sequences](int sequence) {
+            sequences.append(sequence);
+            return true;
+        });
+        return sequences;
+    }
+};
+
+void tst_SequenceSet::mergesRanges()
+{
+    SequenceSet set;
+    QVERIFY(set.insertRange(5, 6));
+    QVERIFY(set.insert(9));
+    QCOMPARE(set.prefix, 0);
+    QCOMPARE(set.ranges.size(), 2);
+
+    // Touching ranges merge, and closing the gap at 1 folds them into the prefix
+    QVERIFY(set.insertRange(7, 8));
+    QCOMPARE(set.ranges.size(), 1);
+    QVERIFY(!set.insertRange(6, 9));
+    QVERIFY(set.insertRange(1, 4));
+    QCOMPARE(set.prefix, 9);
+    QVERIFY(set.ranges.isEmpty());
+    QVERIFY(!set.insert(0));
+    QVERIFY(!set.contains(0));
+    QCOMPARE(set.maxSequence(), 9);
+}
+
+void tst_SequenceSet::acceptsIntMax()
+{
+    SequenceSet set;
+    QVERIFY(set.insert(LAST));
+    QVERIFY(set.insert(LAST - 1));
+    QCOMPARE(set.ranges.size(), 1);
+    QCOMPARE(set.ranges.firstKey(), LAST - 1);
+    QCOMPARE(set.maxSequence(), int(LAST));
+    QVERIFY(set.contains(LAST));
+    QVERIFY(!set.contains(LAST - 2));
+
+    // A range ending at INT_MAX swallows everything after it
+    QVERIFY(set.insertRange(1, LAST - 2));
+    QCOMPARE(set.prefix, int(LAST));
+    QVERIFY(set.ranges.isEmpty());
+
+    // A full prefix has no next sequence, so nothing more can be added
+    QVERIFY(!set.insert(LAST));
+    QVERIFY(!set.insertRange(LAST, LAST));
+    QVERIFY(!set.insertRange(std::numeric_limits<int>::min(), LAST));
+    QCOMPARE(set.prefix, int(LAST));
+}
+
+void tst_SequenceSet::walksStoreUpToIntMax()
+{
+    NodeIdTable nodeIds;
+    MessageStore store(nodeIds);
+    for (int sequence : {1, LAST - 64, LAST - 1, LAST}) {
+        MessageInfo info;
+        info.origin = "A";
+        info.destination = "B";
+        info.chatText = QString("seq %1").arg(sequence);
+        info.sequence = sequence;
+        info.timestamp = QDateTime::fromMSecsSinceEpoch(1000);
+        store.store(info);
+    }
+    const NodeId origin = nodeIds.find("A");
+    QVERIFY(store.contains(origin, LAST));
+    QCOMPARE(store.get(origin, LAST).chatText, QString("seq %1").arg(LAST));
+
+    QCOMPARE(sequencesAfter(store, origin, 0), (QList<int>{1, LAST - 64, LAST - 1, LAST}));
+    QCOMPARE(sequencesAfter(store, origin, LAST - 64), (QList<int>{LAST - 1, LAST}));
+    QCOMPARE(sequencesAfter(store, origin, LAST - 1), QList<int>{LAST});
+    QVERIFY(sequencesAfter(store, origin, LAST).isEmpty());
+}
+
+QTEST_GUILESS_MAIN(tst_SequenceSet)
+#include "tst_sequenceset.moc"
@@ -0,0 +1,125 @@
+#include <QtTest>
+#include "timerwheel.h"
+
+// Retransmission timer wheel: deadlines across revolutions and tick boundaries
+class tst_TimerWheel : public QObject
+{
+    Q_OBJECT
+
+private slots:
+    void firesDeadlinesInsideATick();
+    void wrapsAroundRevolutions_data();
+    void wrapsAroundRevolutions();
+    void skipsWholeRevolutions();
+    void dropsStaleEntries();
+
+private:
+    static const qint64 REVOLUTION_MS = qint64(TimerWheel::SLOTS) * TimerWheel::TICK_MS;
+
+    // Drives the wheel the way the node does: sleep until nextWakeup(), then advance()
+    static qint64 runUntilFired(TimerWheel& wheel, quint64 key, qint64 now, qint64 limit)
+    {
+        while (now <= limit) {
+            const qint64 wakeup = wheel.nextWakeup();
+            if (wakeup < 0) {
+                return -1;
+            }
+            now = qMax(now, wakeup);
+            if (wheel.advance(now).contains(key)) {
+                return now;
+            }
+        }
+        return -1;
+    }
+};
+
+void tst_TimerWheel::firesDeadlinesInsideATick()
+{
+    // A deadline in the middle of a tick must not wait a whole revolution
+    // because advance() reached its bucket first
+    TimerWheel wheel(0);
+    wheel.schedule(1, 120);
+    QVERIFY(wheel.advance(100).isEmpty());
+    QVERIFY(wheel.advance(119).isEmpty());
+    QVERIFY(wheel.isScheduled(1));
+
+    const qint64 fired = runUntilFired(wheel, 1, 119, REVOLUTION_MS);
+    QVERIFY(fired >= 120);
+    QVERIFY(fired < 120 + TimerWheel::TICK_MS);
+    QVERIFY(wheel.isEmpty());
+    QCOMPARE(wheel.nextWakeup(), qint64(-1));
+}
+
+void tst_TimerWheel::wrapsAroundRevolutions_data()
+{
+    QTest::addColumn<qint64>("start");
+    QTest::addColumn<qint64>("delay");
+
+    QTest::newRow("same revolution") << qint64(0) << qint64(30 * 1000);
+    QTest::newRow("one revolution, same bucket") << qint64(0) << qint64(REVOLUTION_MS);
+    QTest::newRow("three revolutions and a bit") << qint64(1234) << 3 * REVOLUTION_MS + 77;
+    QTest::newRow("already due") << qint64(1) << qint64(0);
+    QTest::newRow("large clock, later revolution") << qint64(1700000000123LL) << 2 * REVOLUTION_MS + 1;
+}
+
+void tst_TimerWheel::wrapsAroundRevolutions()
+{
+    QFETCH(qint64, start);
+    QFETCH(qint64, delay);
+    TimerWheel wheel(start);
+    const qint64 deadline = start + delay;
+    wheel.schedule(7, deadline);
+
+    // An entry in the same bucket from an earlier revolution keeps it busy
+    wheel.schedule(8, deadline - REVOLUTION_MS > start ? deadline - REVOLUTION_MS : deadline);
+
+    const qint64 fired = runUntilFired(wheel, 7, start, deadline + REVOLUTION_MS);
+    QVERIFY2(fired >= deadline, qPrintable(QString::number(fired)));
+    QVERIFY2(fired < deadline + TimerWheel::TICK_MS, qPrintable(QString::number(fired)));
+    QVERIFY(!wheel.isScheduled(7));
+
+    // Stepping tick by tick never fires early either
+    TimerWheel stepped(start);
+    stepped.schedule(7, deadline);
+    for (qint64 now = start; now < deadline; now += TimerWheel::TICK_MS) {
+        QVERIFY2(stepped.advance(now).isEmpty(), qPrintable(QString::number(now)));
+    }
+    QVERIFY(stepped.advance(deadline + TimerWheel::TICK_MS).contains(7));
+}
+
+void tst_TimerWheel::skipsWholeRevolutions()
+{
+    // A clock jump past several revolutions visits every bucket once and
+    // fires everything that is due, leaving the rest
+    TimerWheel wheel(0);
+    for (quint64 key = 0; key < 100; ++key) {
+        wheel.schedule(key, qint64(key) * 1000);
+    }
+    wheel.schedule(1000, 5 * REVOLUTION_MS);
+
+    const QVector<quint64> due = wheel.advance(4 * REVOLUTION_MS);
+    QCOMPARE(due.size(), 100);
+    QCOMPARE(wheel.size(), 1);
+    QVERIFY(wheel.isScheduled(1000));
+    QCOMPARE(runUntilFired(wheel, 1000, 4 * REVOLUTION_MS, 6 * REVOLUTION_MS), 5 * REVOLUTION_MS);
+}
+
+void tst_TimerWheel::dropsStaleEntries()
+{
+    TimerWheel wheel(0);
+
+    // Rescheduled into the same bucket one revolution later
+    wheel.schedule(1, 500);
+    wheel.schedule(1, 500 + REVOLUTION_MS);
+    wheel.schedule(2, 700);
+    wheel.cancel(2);
+
+    QVERIFY(wheel.advance(REVOLUTION_MS).isEmpty());
+    QVERIFY(wheel.isScheduled(1));
+    QVERIFY(!wheel.isScheduled(2));
+    QCOMPARE(wheel.advance(500 + REVOLUTION_MS), QVector<quint64>{1});
+    QVERIFY(wheel.isEmpty());
+}
+
+QTEST_GUILESS_MAIN(tst_TimerWheel)
+#include "tst_timerwheel.moc"
@@ -0,0 +1,344 @@
+#include <QtTest>
+#include "wireformat.h"
+
+// Packet codec; decode() and parseForwardHeader() see untrusted network input
+class tst_WireFormat : public QObject
+{
+    Q_OBJECT
+
+private slots:
+    void roundTripsEveryType_data();
+    void roundTripsEveryType();
+    void rejectsTruncatedPackets_data() { roundTripsEveryType_data(); }
+    void rejectsTruncatedPackets();
+    void rejectsOversizedVarints();
+    void rejectsUnknownTypesAndFields();
+    void fallsBackToLegacyMagic();
+    void parsesForwardHeader();
+    void patchesHopLimitInPlace();
+
+private:
+    static QVariantMap privateMessage(quint32 hopLimit);
+
+    // Hand-built compact packet: header, presence mask, then the raw rest
+    static QByteArray compactPacket(quint8 type, const QByteArray& rest)
+    {
+        QByteArray packet;
+        packet.append(char(0xCA));
+        packet.append(char(0xFE));
+        packet.append(char(WireFormat::COMPACT_VERSION));
+        packet.append(char(type));
+        packet.append(rest);
+        return packet;
+    }
+};
+
+QVariantMap tst_WireFormat::privateMessage(quint32 hopLimit)
+{
+    QVariantMap message;
+    message["Type"] = "private";
+    message["Origin"] = "Alice";
+    message["Dest"] = "Bob";
+    message["Sequence"] = 42;
+    message["ChatText"] = QString::fromUtf8("hello \xc3\xa9");
+    message["Timestamp"] = qlonglong(1700000000000LL);
+    message["HopLimit"] = hopLimit;
+    message["LastIP"] = "10.0.0.1";
+    message["LastPort"] = 9001;
+    return message;
+}
+
+void tst_WireFormat::roundTripsEveryType_data()
+{
+    QTest::addColumn<QVariantMap>("message");
+
+    // Values use the types decode() produces, so maps compare equal
+    QVariantMap chat;
+    chat["Type"] = "message";
+    chat["Origin"] = "Alice";
+    chat["Destination"] = "-1";
+    chat["Sequence"] = 7;
+    chat["ChatText"] = "hi all";
+    chat["Timestamp"] = qlonglong(1700000000000LL);
+    chat["LastIP"] = "fe80::1";
+    chat["LastPort"] = 9000;
+    QTest::newRow("message") << chat;
+
+    QTest::newRow("private") << privateMessage(10);
+
+    QVariantMap rumor;
+    rumor["Type"] = "route_rumor";
+    rumor["Origin"] = "Alice";
+    rumor["SeqNo"] = -3;
+    rumor["LastIP"] = "not-an-address";
+    rumor["LastPort"] = 9000;
+    QTest::newRow("route_rumor") << rumor;
+
+    QVariantMap ack;
+    ack["Type"] = "ack";
+    ack["Origin"] = "Bob";
+    ack["AckOrigin"] = "Alice";
+    ack["AckSequence"] = 42;
+    QTest::newRow("ack") << ack;
+
+    QVariantMap discovery;
+    discovery["Type"] = "discovery";
+    discovery["Origin"] = "Alice";
+    discovery["Port"] = 9000;
+    discovery["LastIP"] = "192.168.1.5";
+    discovery["LastPort"] = 9000;
+    discovery["Wire"] = WireFormat::WIRE_LEVEL;
+    QTest::newRow("discovery") << discovery;
+
+    QVariantMap response = discovery;
+    response["Type"] = "discovery_response";
+    QTest::newRow("discovery_response") << response;
+
+    QVariantMap clock;
+    clock["Type"] = "vector_clock";
+    clock["Origin"] = "Alice";
+    clock["VectorClock"] = QVariantMap{{"Alice", 12}, {"Bob", 0}};
+    clock["ClockRanges"] = QVariantMap{{"Bob", QVariantList{3, 5, 8, 9}}};
+    clock["Digest"] = qlonglong(-1234567890123LL);
+    clock["Full"] = 1;
+    QTest::newRow("vector_clock") << clock;
+
+    QVariantMap sync;
+    sync["Type"] = "sync_message";
+    sync["Origin"] = "Bob";
+    sync["SyncOrigin"] = "Alice";
+    sync["SyncSequence"] = 4;
+    sync["SyncDestination"] = "-1";
+    sync["SyncText"] = "late";
+    sync["SyncTimestamp"] = qlonglong(1700000000001LL);
+    QTest::newRow("sync_message") << sync;
+
+    QVariantMap digest;
+    digest["Type"] = "clock_digest";
+    digest["Origin"] = "Alice";
+    digest["Digest"] = qlonglong(99);
+    digest["Resync"] = 1;
+    QTest::newRow("clock_digest") << digest;
+
+    QVariantMap batch;
+    batch["Type"] = "sync_batch";
+    batch["Origin"] = "Bob";
+    batch["SyncBatch"] = QVariantList{QVariant(QVariantList{"Alice", 1, "-1", "one"}),
+                                      QVariant(QVariantList{"Carol", 2, "Bob", ""})};
+    batch["SyncTimestamps"] = QVariantList{qlonglong(1), qlonglong(-2)};
+    QTest::newRow("sync_batch") << batch;
+
+    QVariantMap routes;
+    routes["Type"] = "route_update";
+    routes["Origin"] = "Alice";
+    routes["Full"] = 1;
+    routes["Routes"] = QVariantList{QVariant(QVariantList{"Bob", 2, 1}),
+                                    QVariant(QVariantList{"Carol", -1, 16})};
+    routes["LastIP"] = "10.0.0.1";
+    routes["LastPort"] = 9000;
+    QTest::newRow("route_update") << routes;
+
+    QVariantMap stats;
+    stats["Type"] = "stats";
+    stats["Origin"] = "Alice";
+    QTest::newRow("stats") << stats;
+
+    QVariantMap statsResponse;
+    statsResponse["Type"] = "stats_response";
+    statsResponse["Origin"] = "Bob";
+    statsResponse["Stats"] = "{\"counters\":{}}";
+    QTest::newRow("stats_response") << statsResponse;
+
+    QVariantMap ackBatch;
+    ackBatch["Type"] = "ack_batch";
+    ackBatch["Origin"] = "Bob";
+    ackBatch["Acks"] = QVariantList{QVariant(QVariantList{"Alice", 10, 12, qulonglong(0x5)}),
+                                    QVariant(QVariantList{"Carol", 0, 0, qulonglong(0)})};
+    QTest::newRow("ack_batch") << ackBatch;
+}
+
+void tst_WireFormat::roundTripsEveryType()
+{
+    QFETCH(QVariantMap, message);
+    QVERIFY(WireFormat::isKnownType(message.value("Type").toString()));
+
+    const QByteArray compact = WireFormat::encodeCompact(message);
+    QVERIFY(!compact.isEmpty());
+    QVERIFY(WireFormat::isCompact(compact.constData(), compact.size()));
+    QCOMPARE(WireFormat::decode(compact), message);
+
+    const QByteArray legacy = WireFormat::encodeLegacy(message);
+    QVERIFY(!WireFormat::isCompact(legacy.constData(), legacy.size()));
+    QCOMPARE(WireFormat::decode(legacy), message);
+}
+
+void tst_WireFormat::rejectsTruncatedPackets()
+{
+    QFETCH(QVariantMap, message);
+
+    // Every field takes at least one byte, so no strict prefix is a valid packet
+    const QByteArray compact = WireFormat::encodeCompact(message);
+    for (int size = 0; size < compact.size(); ++size) {
+        QVERIFY2(WireFormat::decode(compact.constData(), size).isEmpty(), qPrintable(QString::number(size)));
+    }
+
+    const QByteArray legacy = WireFormat::encodeLegacy(message);
+    for (int size = 0; size < legacy.size(); ++size) {
+        QVERIFY2(WireFormat::decode(legacy.constData(), size).isEmpty(), qPrintable(QString::number(size)));
+    }
+}
+
+void tst_WireFormat::rejectsOversizedVarints()
+{
+    const quint8 ackType = 4;
+    const QByteArray portPresence("\x80\x20", 2);  // Bit 12: Port
+    const QByteArray noIds("\x00", 1);
+
+    // The largest 64-bit varint is accepted
+    QByteArray value(9, char(0xFF));
+    value.append(char(0x01));
+    QVERIFY(!WireFormat::decode(compactPacket(ackType, portPresence + noIds + value)).isEmpty());
+
+    // A tenth byte carrying more than bit 63 overflows
+    value[9] = char(0x02);
+    QVERIFY(WireFormat::decode(compactPacket(ackType, portPresence + noIds + value)).isEmpty());
+
+    // Eleven bytes never terminate within 64 bits, even when the payload is zero
+    QByteArray padded(10, char(0x80));
+    padded.append(char(0x00));
+    QVERIFY(WireFormat::decode(compactPacket(ackType, portPresence + noIds + padded)).isEmpty());
+    QVERIFY(WireFormat::decode(compactPacket(ackType, padded)).isEmpty());
+
+    // Counts and lengths larger than what is left in the datagram
+    const QByteArray huge("\xFF\xFF\xFF\xFF\x0F", 5);
+    QVERIFY(WireFormat::decode(compactPacket(ackType, QByteArray(1, '\0') + huge)).isEmpty());
+    QVERIFY(WireFormat::decode(compactPacket(ackType, QByteArray(1, '\0') + QByteArray(1, '\x01') + huge)).isEmpty());
+
+    // A node-id index outside the packet's table
+    const QByteArray originPresence("\x01", 1);  // Bit 0: Origin
+    QVERIFY(WireFormat::decode(compactPacket(ackType, originPresence + noIds + QByteArray(1, '\0'))).isEmpty());
+}
+
+void tst_WireFormat::rejectsUnknownTypesAndFields()
+{
+    // The compact encoder refuses what it cannot express; the caller falls back to legacy
+    QVariantMap unknownType;
+    unknownType["Type"] = "no_such_type";
+    unknownType["Origin"] = "Alice";
+    QVERIFY(!WireFormat::isKnownType("no_such_type"));
+    QVERIFY(WireFormat::encodeCompact(unknownType).isEmpty());
+    QCOMPARE(WireFormat::decode(WireFormat::encodeLegacy(unknownType)), unknownType);
+
+    QVariantMap unknownField = privateMessage(10);
+    unknownField["NoSuchField"] = 1;
+    QVERIFY(WireFormat::encodeCompact(unknownField).isEmpty());
+    QCOMPARE(WireFormat::decode(WireFormat::encodeLegacy(unknownField)), unknownField);
+
+    QVariantMap wrongKind = privateMessage(10);
+    wrongKind["Sequence"] = "not a number";
+    QVERIFY(WireFormat::encodeCompact(wrongKind).isEmpty());
+
+    // Type byte 0 is reserved and bytes past the table are unknown
+    const QByteArray empty("\x00\x00", 2);
+    QVERIFY(WireFormat::decode(compactPacket(0, empty)).isEmpty());
+    QVERIFY(WireFormat::decode(compactPacket(0xFF, empty)).isEmpty());
+    QVERIFY(!WireFormat::decode(compactPacket(4, empty)).isEmpty());
+
+    // A presence bit past the field table
+    QByteArray highBit(9, char(0x80));
+    highBit.append(char(0x01));
+    QVERIFY(WireFormat::decode(compactPacket(4, highBit + QByteArray(1, '\0'))).isEmpty());
+}
+
+void tst_WireFormat::fallsBackToLegacyMagic()
+{
+    const QVariantMap message = privateMessage(10);
+    QByteArray legacy = WireFormat::encodeLegacy(message);
+
+    // A legacy packet leads with its (small) size, then the magic
+    QCOMPARE(quint8(legacy[4]), quint8(WireFormat::LEGACY_MAGIC >> 24));
+    QCOMPARE(quint8(legacy[7]), quint8(WireFormat::LEGACY_MAGIC & 0xFF));
+    QCOMPARE(WireFormat::decode(legacy), message);
+
+    legacy[7] = char(legacy[7] ^ 0x01);
+    QVERIFY(WireFormat::decode(legacy).isEmpty());
+
+    // The compact prefix with an unknown version is decoded as legacy, and rejected
+    QByteArray future = WireFormat::encodeCompact(message);
+    future[2] = char(WireFormat::COMPACT_VERSION + 1);
+    QVERIFY(!WireFormat::isCompact(future.constData(), future.size()));
+    QVERIFY(WireFormat::decode(future).isEmpty());
+}
+
+void tst_WireFormat::parsesForwardHeader()
+{
+    const QByteArray packet = WireFormat::encodeCompact(privateMessage(10));
+    WireFormat::ForwardHeader header;
+    QVERIFY(WireFormat::parseForwardHeader(packet.constData(), packet.size(), &header));
+    QCOMPARE(header.destination, QString("Bob"));
+    QCOMPARE(header.origin, QString("Alice"));
+    QCOMPARE(header.sequence, 42);
+    QCOMPARE(header.hopLimit, 10u);
+    QCOMPARE(header.hopLimitLength, 1);
+    QCOMPARE(quint8(packet[header.hopLimitOffset]), quint8(10));
+
+    // Without a Sequence the packet has no flood identity
+    QVariantMap unsequenced = privateMessage(10);
+    unsequenced.remove("Sequence");
+    const QByteArray bare = WireFormat::encodeCompact(unsequenced);
+    QVERIFY(WireFormat::parseForwardHeader(bare.constData(), bare.size(), &header));
+    QVERIFY(header.origin.isEmpty());
+
+    // Only compact private packets that carry Dest and HopLimit
+    QVariantMap noHopLimit = privateMessage(10);
+    noHopLimit.remove("HopLimit");
+    const QByteArray noHop = WireFormat::encodeCompact(noHopLimit);
+    QVERIFY(!WireFormat::parseForwardHeader(noHop.constData(), noHop.size(), &header));
+
+    QVariantMap chat = privateMessage(10);
+    chat["Type"] = "message";
+    const QByteArray chatPacket = WireFormat::encodeCompact(chat);
+    QVERIFY(!WireFormat::parseForwardHeader(chatPacket.constData(), chatPacket.size(), &header));
+
+    const QByteArray legacy = WireFormat::encodeLegacy(privateMessage(10));
+    QVERIFY(!WireFormat::parseForwardHeader(legacy.constData(), legacy.size(), &header));
+
+    // Any cut through the fields up to and including HopLimit is rejected
+    for (int size = 0; size < header.hopLimitOffset + header.hopLimitLength; ++size) {
+        QVERIFY2(!WireFormat::parseForwardHeader(packet.constData(), size, &header),
+                 qPrintable(QString::number(size)));
+    }
+}
+
+void tst_WireFormat::patchesHopLimitInPlace()
+{
+    QByteArray packet = WireFormat::encodeCompact(privateMessage(10));
+    WireFormat::ForwardHeader header;
+    QVERIFY(WireFormat::parseForwardHeader(packet.constData(), packet.size(), &header));
+
+    QVERIFY(WireFormat::patchHopLimit(packet.data(), packet.size(), header, 9));
+    QCOMPARE(WireFormat::decode(packet), privateMessage(9));
+
+    // 200 needs two bytes; the packet must stay as it was
+    const QByteArray before = packet;
+    QVERIFY(!WireFormat::patchHopLimit(packet.data(), packet.size(), header, 200));
+    QCOMPARE(packet, before);
+
+    // A wider varint takes smaller values as padded encodings
+    packet = WireFormat::encodeCompact(privateMessage(200));
+    QVERIFY(WireFormat::parseForwardHeader(packet.constData(), packet.size(), &header));
+    QCOMPARE(header.hopLimitLength, 2);
+    QVERIFY(WireFormat::patchHopLimit(packet.data(), packet.size(), header, 3));
+    QCOMPARE(WireFormat::decode(packet), privateMessage(3));
+    QVERIFY(WireFormat::parseForwardHeader(packet.constData(), packet.size(), &header));
+    QCOMPARE(header.hopLimit, 3u);
+    QCOMPARE(header.hopLimitLength, 2);
+
+    // A header pointing outside the packet is refused
+    WireFormat::ForwardHeader outside = header;
+    outside.hopLimitOffset = packet.size();
+    QVERIFY(!WireFormat::patchHopLimit(packet.data(), packet.size(), outside, 1));
+}
+
+QTEST_GUILESS_MAIN(tst_WireFormat)
+#include "tst_wireformat.moc"
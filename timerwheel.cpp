@@ -0,0 +1,65 @@
+#include "timerwheel.h"
+
+TimerWheel::TimerWheel(qint64 nowMs)
+    : m_slots(SLOTS)
+    , m_currentTick(tickOf(nowMs))
+{
+}
+
+void TimerWheel::schedule(quint64 key, qint64 deadlineMs)
+{
+    // Anything already due lands in the next bucket advance() will visit
+    qint64 tick = qMax(deadlineTickOf(deadlineMs), m_currentTick + 1);
+    m_slots[int(tick % SLOTS)].append({key, deadlineMs});
+    m_deadlines.insert(key, deadlineMs);
+}
+
+void TimerWheel::cancel(quint64 key)
+{
+    m_deadlines.remove(key);
+}
+
+QVector<quint64> TimerWheel::advance(qint64 nowMs)
+{
+    QVector<quint64> due;
+    const qint64 nowTick = tickOf(nowMs);
+    if (nowTick <= m_currentTick) {
+        return due;
+    }
+
+    // After a full revolution every bucket has been visited once
+    const qint64 lastTick = qMin(nowTick, m_currentTick + SLOTS);
+    for (qint64 tick = m_currentTick + 1; tick <= lastTick; ++tick) {
+        QVector<Entry>& slot = m_slots[int(tick % SLOTS)];
+        for (int i = 0; i < slot.size(); ) {
+            const Entry entry = slot[i];
+            auto live = m_deadlines.constFind(entry.key);
+            bool stale = live == m_deadlines.constEnd() || live.value() != entry.deadline;
+            if (!stale && entry.deadline > nowMs) {
+                ++i;  // A later revolution
+                continue;
+            }
+            if (!stale) {
+                due.append(entry.key);
+                m_deadlines.erase(live);
+            }
+            slot[i] = slot.last();
+            slot.removeLast();
+        }
+    }
+    m_currentTick = nowTick;
+    return due;
+}
+
+qint64 TimerWheel::nextWakeup() const
+{
+    if (m_deadlines.isEmpty()) {
+        return -1;
+    }
+    for (qint64 tick = m_currentTick + 1; tick <= m_currentTick + SLOTS; ++tick) {
+        if (!m_slots[int(tick % SLOTS)].isEmpty()) {
+            return tick * TICK_MS;
+        }
+    }
+    return (m_currentTick + SLOTS) * TICK_MS;
+}
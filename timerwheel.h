@@ -0,0 +1,57 @@
+#ifndef SIMPLECHAT_TIMERWHEEL_H
+#define SIMPLECHAT_TIMERWHEEL_H
+
+#include <QHash>
+#include <QVector>
+
+// Hashed timer wheel for retransmission deadlines.
+//
+// Deadlines (in milliseconds on any monotonic clock) are rounded up to a
+// whole tick and hash into one of SLOTS buckets of TICK_MS each, so a bucket
+// is only visited once everything in it from the current revolution is due.
+// A deadline further out than one revolution simply waits in its bucket
+// until a later pass. schedule() and cancel() are O(1) and advance() only
+// touches the buckets between the previous call and now, so the cost of a
+// tick is proportional to what is due, not to how much is pending.
+// Cancelling or rescheduling a key leaves a stale bucket entry behind that
+// advance() drops when it reaches it.
+class TimerWheel
+{
+public:
+    static const int TICK_MS = 50;
+    static const int SLOTS = 1024;  // ~51 s per revolution
+
+    explicit TimerWheel(qint64 nowMs = 0);
+
+    // (Re)arm key to expire at deadlineMs; replaces any earlier deadline
+    void schedule(quint64 key, qint64 deadlineMs);
+    void cancel(quint64 key);
+    bool isScheduled(quint64 key) const { return m_deadlines.contains(key); }
+
+    // Removes and returns every key whose deadline, rounded up to a whole
+    // tick, is <= nowMs
+    QVector<quint64> advance(qint64 nowMs);
+
+    // Earliest time worth calling advance() again, or -1 when empty. At most
+    // one tick after the first due deadline, but may be earlier (a bucket
+    // that only holds later revolutions).
+    qint64 nextWakeup() const;
+
+    int size() const { return m_deadlines.size(); }
+    bool isEmpty() const { return m_deadlines.isEmpty(); }
+
+private:
+    struct Entry {
+        quint64 key;
+        qint64 deadline;
+    };
+
+    static qint64 tickOf(qint64 ms) { return ms / TICK_MS; }
+    static qint64 deadlineTickOf(qint64 ms) { return (ms + TICK_MS - 1) / TICK_MS; }
+
+    QVector<QVector<Entry>> m_slots;
+    QHash<quint64, qint64> m_deadlines;  // live key -> deadline
+    qint64 m_currentTick;                // Last tick advance() processed
+};
+
+#endif // SIMPLECHAT_TIMERWHEEL_H
@@ -0,0 +1,772 @@
+#include "wireformat.h"
+#include <QDataStream>
+#include <cstring>
+#include <QHash>
+#include <QVarLengthArray>
+#include <QVector>
+#include <QtNetwork/QHostAddress>
+
+namespace {
+
+enum FieldKind {
+    NodeIdField,    // index into the packet's node-id table
+    IntField,       // zigzag varint, decoded as int
+    UIntField,      // varint, decoded as uint
+    Int64Field,     // zigzag varint, decoded as qlonglong
+    TextField,      // varint length + UTF-8
+    AddressField,   // tag byte + raw IPv4/IPv6 bytes (or text fallback)
+    ClockField,     // varint count + (node-id index, zigzag varint) pairs
+    RangesField,    // varint count + (node-id index, varint n, n zigzag varints)
+    SyncBatchField, // varint count + (origin index, zigzag seq, destination index, text)
+    RoutesField,    // varint count + (destination index, zigzag seq, varint hops)
+    Int64ListField, // varint count + zigzag varints, decoded as qlonglong
+    AckBatchField   // varint count + (origin index, zigzag cumulative, zigzag base, varint mask)
+};
+
+struct FieldSpec {
+    const char* key;
+    FieldKind kind;
+};
+
+// Wire order of the compact layout. Append only: the index of a field is its
+// bit in the presence mask, so reordering breaks interoperability.
+const FieldSpec FIELDS[] = {
+    { "Origin",          NodeIdField  },
+    { "Destination",     NodeIdField  },
+    { "Dest",            NodeIdField  },
+    { "Sequence",        IntField     },
+    { "ChatText",        TextField    },
+    { "Timestamp",       Int64Field   },
+    { "HopLimit",        UIntField    },
+    { "LastIP",          AddressField },
+    { "LastPort",        IntField     },
+    { "SeqNo",           IntField     },
+    { "AckOrigin",       NodeIdField  },
+    { "AckSequence",     IntField     },
+    { "Port",            IntField     },
+    { "Wire",            IntField     },
+    { "VectorClock",     ClockField   },
+    { "SyncOrigin",      NodeIdField  },
+    { "SyncSequence",    IntField     },
+    { "SyncDestination", NodeIdField  },
+    { "SyncText",        TextField    },
+    { "Digest",          Int64Field   },
+    { "Full",            IntField     },
+    { "Resync",          IntField     },
+    { "ClockRanges",     RangesField  },
+    { "SyncBatch",       SyncBatchField },
+    { "Routes",          RoutesField  },
+    { "Stats",           TextField    },
+    { "SyncTimestamp",   Int64Field   },
+    { "SyncTimestamps",  Int64ListField },
+    { "Acks",            AckBatchField },
+};
+constexpr int FIELD_COUNT = int(sizeof(FIELDS) / sizeof(FIELDS[0]));
+
+// Type byte values; 0 is reserved
+const char* const TYPES[] = {
+    "",
+    "message",
+    "private",
+    "route_rumor",
+    "ack",
+    "discovery",
+    "discovery_response",
+    "vector_clock",
+    "sync_message",
+    "clock_digest",
+    "sync_batch",
+    "route_update",
+    "stats",
+    "stats_response",
+    "ack_batch",
+};
+constexpr int TYPE_COUNT = int(sizeof(TYPES) / sizeof(TYPES[0]));
+
+const uchar COMPACT_MAGIC0 = 0xCA;
+const uchar COMPACT_MAGIC1 = 0xFE;
+const int COMPACT_HEADER_SIZE = 4;
+
+enum AddressTag : uchar {
+    AddressText = 0,
+    AddressIPv4 = 4,
+    AddressIPv6 = 6
+};
+
+// Keys and type names are built once so decoding shares them instead of
+// allocating a QString per field
+struct KeyTable {
+    QString typeKey = QStringLiteral("Type");
+    QVector<QString> fieldKeys;
+    QVector<QString> typeNames;
+    QHash<QString, int> fieldIndex;
+    QHash<QString, int> typeIndex;
+
+    KeyTable() {
+        for (int i = 0; i < FIELD_COUNT; ++i) {
+            fieldKeys.append(QString::fromLatin1(FIELDS[i].key));
+            fieldIndex.insert(fieldKeys.last(), i);
+        }
+        for (int i = 0; i < TYPE_COUNT; ++i) {
+            typeNames.append(QString::fromLatin1(TYPES[i]));
+            if (i > 0) {
+                typeIndex.insert(typeNames.last(), i);
+            }
+        }
+    }
+};
+
+const KeyTable& keys()
+{
+    static const KeyTable table;
+    return table;
+}
+
+void putVarint(QByteArray& out, quint64 value)
+{
+    while (value >= 0x80) {
+        out.append(char(value | 0x80));
+        value >>= 7;
+    }
+    out.append(char(value));
+}
+
+quint64 zigzag(qint64 value)
+{
+    return (quint64(value) << 1) ^ quint64(value >> 63);
+}
+
+qint64 unzigzag(quint64 value)
+{
+    return qint64(value >> 1) ^ -qint64(value & 1);
+}
+
+void putString(QByteArray& out, const QString& text)
+{
+    const QByteArray utf8 = text.toUtf8();
+    putVarint(out, quint64(utf8.size()));
+    out.append(utf8);
+}
+
+bool isInteger(const QVariant& value)
+{
+    switch (value.typeId()) {
+    case QMetaType::Int:
+    case QMetaType::UInt:
+    case QMetaType::LongLong:
+    case QMetaType::ULongLong:
+        return true;
+    default:
+        return false;
+    }
+}
+
+// Bounds-checked reader over a datagram
+struct Reader {
+    const uchar* p;
+    const uchar* end;
+
+    bool varint(quint64& value) {
+        value = 0;
+        for (int shift = 0; p < end && shift < 64; shift += 7) {
+            uchar byte = *p++;
+            if (shift == 63 && byte > 1) {
+                return false;  // More than 64 bits
+            }
+            value |= quint64(byte & 0x7F) << shift;
+            if (!(byte & 0x80)) {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    bool string(QString& text) {
+        quint64 length;
+        if (!varint(length) || length > quint64(end - p)) {
+            return false;
+        }
+        text = QString::fromUtf8(reinterpret_cast<const char*>(p), int(length));
+        p += length;
+        return true;
+    }
+
+    bool bytes(uchar* out, int count) {
+        if (end - p < count) {
+            return false;
+        }
+        memcpy(out, p, count);
+        p += count;
+        return true;
+    }
+};
+
+class NodeIdInterner
+{
+public:
+    int intern(const QString& nodeId) {
+        auto it = m_index.constFind(nodeId);
+        if (it != m_index.constEnd()) {
+            return it.value();
+        }
+        int index = m_ids.size();
+        m_ids.append(nodeId);
+        m_index.insert(nodeId, index);
+        return index;
+    }
+
+    const QVector<QString>& ids() const { return m_ids; }
+
+private:
+    QVector<QString> m_ids;
+    QHash<QString, int> m_index;
+};
+
+bool encodeField(QByteArray& body, NodeIdInterner& interner, FieldKind kind, const QVariant& value)
+{
+    switch (kind) {
+    case NodeIdField:
+        if (value.typeId() != QMetaType::QString) return false;
+        putVarint(body, quint64(interner.intern(value.toString())));
+        return true;
+    case IntField:
+    case Int64Field:
+        if (!isInteger(value)) return false;
+        putVarint(body, zigzag(value.toLongLong()));
+        return true;
+    case UIntField:
+        if (!isInteger(value)) return false;
+        putVarint(body, value.toULongLong());
+        return true;
+    case TextField:
+        if (value.typeId() != QMetaType::QString) return false;
+        putString(body, value.toString());
+        return true;
+    case AddressField: {
+        if (value.typeId() != QMetaType::QString) return false;
+        const QString text = value.toString();
+        QHostAddress addr(text);
+        // Only use the binary form when it round-trips to the same string
+        if (!addr.isNull() && addr.toString() == text) {
+            if (addr.protocol() == QAbstractSocket::IPv4Protocol) {
+                body.append(char(AddressIPv4));
+                quint32 ip = addr.toIPv4Address();
+                for (int shift = 24; shift >= 0; shift -= 8) {
+                    body.append(char((ip >> shift) & 0xFF));
+                }
+                return true;
+            }
+            if (addr.protocol() == QAbstractSocket::IPv6Protocol) {
+                body.append(char(AddressIPv6));
+                Q_IPV6ADDR ip = addr.toIPv6Address();
+                body.append(reinterpret_cast<const char*>(ip.c), 16);
+                return true;
+            }
+        }
+        body.append(char(AddressText));
+        putString(body, text);
+        return true;
+    }
+    case ClockField: {
+        if (value.typeId() != QMetaType::QVariantMap) return false;
+        const QVariantMap clock = value.toMap();
+        putVarint(body, quint64(clock.size()));
+        for (auto it = clock.constBegin(); it != clock.constEnd(); ++it) {
+            if (!isInteger(it.value())) return false;
+            putVarint(body, quint64(interner.intern(it.key())));
+            putVarint(body, zigzag(it.value().toLongLong()));
+        }
+        return true;
+    }
+    case RangesField: {
+        if (value.typeId() != QMetaType::QVariantMap) return false;
+        const QVariantMap rangesMap = value.toMap();
+        putVarint(body, quint64(rangesMap.size()));
+        for (auto it = rangesMap.constBegin(); it != rangesMap.constEnd(); ++it) {
+            if (it.value().typeId() != QMetaType::QVariantList) return false;
+            const QVariantList ranges = it.value().toList();
+            putVarint(body, quint64(interner.intern(it.key())));
+            putVarint(body, quint64(ranges.size()));
+            for (const QVariant& bound : ranges) {
+                if (!isInteger(bound)) return false;
+                putVarint(body, zigzag(bound.toLongLong()));
+            }
+        }
+        return true;
+    }
+    case SyncBatchField: {
+        if (value.typeId() != QMetaType::QVariantList) return false;
+        const QVariantList batch = value.toList();
+        putVarint(body, quint64(batch.size()));
+        for (const QVariant& entry : batch) {
+            const QVariantList fields = entry.toList();
+            if (fields.size() != 4 ||
+                fields[0].typeId() != QMetaType::QString || !isInteger(fields[1]) ||
+                fields[2].typeId() != QMetaType::QString || fields[3].typeId() != QMetaType::QString) {
+                return false;
+            }
+            putVarint(body, quint64(interner.intern(fields[0].toString())));
+            putVarint(body, zigzag(fields[1].toLongLong()));
+            putVarint(body, quint64(interner.intern(fields[2].toString())));
+            putString(body, fields[3].toString());
+        }
+        return true;
+    }
+    case RoutesField: {
+        if (value.typeId() != QMetaType::QVariantList) return false;
+        const QVariantList routes = value.toList();
+        putVarint(body, quint64(routes.size()));
+        for (const QVariant& entry : routes) {
+            const QVariantList fields = entry.toList();
+            if (fields.size() != 3 || fields[0].typeId() != QMetaType::QString ||
+                !isInteger(fields[1]) || !isInteger(fields[2]) || fields[2].toLongLong() < 0) {
+                return false;
+            }
+            putVarint(body, quint64(interner.intern(fields[0].toString())));
+            putVarint(body, zigzag(fields[1].toLongLong()));
+            putVarint(body, quint64(fields[2].toLongLong()));
+        }
+        return true;
+    }
+    case Int64ListField: {
+        if (value.typeId() != QMetaType::QVariantList) return false;
+        const QVariantList list = value.toList();
+        putVarint(body, quint64(list.size()));
+        for (const QVariant& item : list) {
+            if (!isInteger(item)) return false;
+            putVarint(body, zigzag(item.toLongLong()));
+        }
+        return true;
+    }
+    case AckBatchField: {
+        if (value.typeId() != QMetaType::QVariantList) return false;
+        const QVariantList acks = value.toList();
+        putVarint(body, quint64(acks.size()));
+        for (const QVariant& entry : acks) {
+            const QVariantList fields = entry.toList();
+            if (fields.size() != 4 || fields[0].typeId() != QMetaType::QString ||
+                !isInteger(fields[1]) || !isInteger(fields[2]) || !isInteger(fields[3])) {
+                return false;
+            }
+            putVarint(body, quint64(interner.intern(fields[0].toString())));
+            putVarint(body, zigzag(fields[1].toLongLong()));
+            putVarint(body, zigzag(fields[2].toLongLong()));
+            putVarint(body, fields[3].toULongLong());
+        }
+        return true;
+    }
+    }
+    return false;
+}
+
+bool decodeField(Reader& in, const QVector<QString>& nodeIds, FieldKind kind, QVariant& value)
+{
+    quint64 raw;
+    switch (kind) {
+    case NodeIdField:
+        if (!in.varint(raw) || raw >= quint64(nodeIds.size())) return false;
+        value = nodeIds.at(int(raw));
+        return true;
+    case IntField:
+        if (!in.varint(raw)) return false;
+        value = int(unzigzag(raw));
+        return true;
+    case Int64Field:
+        if (!in.varint(raw)) return false;
+        value = qlonglong(unzigzag(raw));
+        return true;
+    case UIntField:
+        if (!in.varint(raw)) return false;
+        value = uint(raw);
+        return true;
+    case TextField: {
+        QString text;
+        if (!in.string(text)) return false;
+        value = text;
+        return true;
+    }
+    case AddressField: {
+        uchar tag;
+        if (!in.bytes(&tag, 1)) return false;
+        if (tag == AddressIPv4) {
+            uchar ip[4];
+            if (!in.bytes(ip, 4)) return false;
+            quint32 ipv4 = (quint32(ip[0]) << 24) | (quint32(ip[1]) << 16) | (quint32(ip[2]) << 8) | ip[3];
+            value = QHostAddress(ipv4).toString();
+            return true;
+        }
+        if (tag == AddressIPv6) {
+            Q_IPV6ADDR ip;
+            if (!in.bytes(ip.c, 16)) return false;
+            value = QHostAddress(ip).toString();
+            return true;
+        }
+        QString text;
+        if (tag != AddressText || !in.string(text)) return false;
+        value = text;
+        return true;
+    }
+    case ClockField: {
+        quint64 count;
+        if (!in.varint(count)) return false;
+        QVariantMap clock;
+        for (quint64 i = 0; i < count; ++i) {
+            quint64 index, seq;
+            if (!in.varint(index) || index >= quint64(nodeIds.size()) || !in.varint(seq)) return false;
+            clock.insert(nodeIds.at(int(index)), int(unzigzag(seq)));
+        }
+        value = clock;
+        return true;
+    }
+    case RangesField: {
+        quint64 count;
+        if (!in.varint(count)) return false;
+        QVariantMap rangesMap;
+        for (quint64 i = 0; i < count; ++i) {
+            quint64 index, length;
+            if (!in.varint(index) || index >= quint64(nodeIds.size()) ||
+                !in.varint(length) || length > quint64(in.end - in.p)) return false;
+            QVariantList ranges;
+            ranges.reserve(int(length));
+            for (quint64 j = 0; j < length; ++j) {
+                quint64 bound;
+                if (!in.varint(bound)) return false;
+                ranges.append(int(unzigzag(bound)));
+            }
+            rangesMap.insert(nodeIds.at(int(index)), ranges);
+        }
+        value = rangesMap;
+        return true;
+    }
+    case SyncBatchField: {
+        quint64 count;
+        if (!in.varint(count) || count > quint64(in.end - in.p)) return false;
+        QVariantList batch;
+        batch.reserve(int(count));
+        for (quint64 i = 0; i < count; ++i) {
+            quint64 origin, seq, destination;
+            QString text;
+            if (!in.varint(origin) || origin >= quint64(nodeIds.size()) || !in.varint(seq) ||
+                !in.varint(destination) || destination >= quint64(nodeIds.size()) || !in.string(text)) {
+                return false;
+            }
+            batch.append(QVariant(QVariantList{nodeIds.at(int(origin)), int(unzigzag(seq)),
+                                               nodeIds.at(int(destination)), text}));
+        }
+        value = batch;
+        return true;
+    }
+    case RoutesField: {
+        quint64 count;
+        if (!in.varint(count) || count > quint64(in.end - in.p)) return false;
+        QVariantList routes;
+        routes.reserve(int(count));
+        for (quint64 i = 0; i < count; ++i) {
+            quint64 destination, seq, hops;
+            if (!in.varint(destination) || destination >= quint64(nodeIds.size()) ||
+                !in.varint(seq) || !in.varint(hops)) {
+                return false;
+            }
+            routes.append(QVariant(QVariantList{nodeIds.at(int(destination)), int(unzigzag(seq)), int(hops)}));
+        }
+        value = routes;
+        return true;
+    }
+    case Int64ListField: {
+        quint64 count;
+        if (!in.varint(count) || count > quint64(in.end - in.p)) return false;
+        QVariantList list;
+        list.reserve(int(count));
+        for (quint64 i = 0; i < count; ++i) {
+            if (!in.varint(raw)) return false;
+            list.append(qlonglong(unzigzag(raw)));
+        }
+        value = list;
+        return true;
+    }
+    case AckBatchField: {
+        quint64 count;
+        if (!in.varint(count) || count > quint64(in.end - in.p)) return false;
+        QVariantList acks;
+        acks.reserve(int(count));
+        for (quint64 i = 0; i < count; ++i) {
+            quint64 origin, cumulative, base, mask;
+            if (!in.varint(origin) || origin >= quint64(nodeIds.size()) || !in.varint(cumulative) ||
+                !in.varint(base) || !in.varint(mask)) {
+                return false;
+            }
+            acks.append(QVariant(QVariantList{nodeIds.at(int(origin)), int(unzigzag(cumulative)),
+                                              int(unzigzag(base)), qulonglong(mask)}));
+        }
+        value = acks;
+        return true;
+    }
+    }
+    return false;
+}
+
+QVariantMap decodeCompact(const uchar* data, int size)
+{
+    const KeyTable& table = keys();
+    Reader in{data + COMPACT_HEADER_SIZE, data + size};
+
+    int type = data[3];
+    if (type <= 0 || type >= TYPE_COUNT) {
+        return QVariantMap();
+    }
+
+    quint64 presence;
+    if (!in.varint(presence) || (FIELD_COUNT < 64 && (presence >> FIELD_COUNT) != 0)) {
+        return QVariantMap();
+    }
+
+    quint64 idCount;
+    if (!in.varint(idCount) || idCount > quint64(in.end - in.p)) {
+        return QVariantMap();
+    }
+    QVector<QString> nodeIds;
+    nodeIds.reserve(int(idCount));
+    for (quint64 i = 0; i < idCount; ++i) {
+        QString id;
+        if (!in.string(id)) {
+            return QVariantMap();
+        }
+        nodeIds.append(id);
+    }
+
+    QVariantMap message;
+    message.insert(table.typeKey, table.typeNames.at(type));
+    for (int i = 0; i < FIELD_COUNT; ++i) {
+        if (!(presence & (quint64(1) << i))) {
+            continue;
+        }
+        QVariant value;
+        if (!decodeField(in, nodeIds, FIELDS[i].kind, value)) {
+            return QVariantMap();
+        }
+        message.insert(table.fieldKeys.at(i), value);
+    }
+    return message;
+}
+
+QVariantMap decodeLegacy(const char* data, int size)
+{
+    QVariantMap message;
+    const QByteArray raw = QByteArray::fromRawData(data, size);
+    QDataStream stream(raw);
+    stream.setVersion(QDataStream::Qt_6_0);
+
+    quint32 messageSize;
+    stream >> messageSize;
+    if (stream.status() != QDataStream::Ok) {
+        return message;
+    }
+
+    quint32 magic;
+    stream >> magic;
+    if (stream.status() != QDataStream::Ok || magic != WireFormat::LEGACY_MAGIC) {
+        return message;
+    }
+
+    stream >> message;
+    if (stream.status() != QDataStream::Ok) {
+        return QVariantMap();
+    }
+
+    return message;
+}
+
+} // namespace
+
+QByteArray WireFormat::encodeLegacy(const QVariantMap& message)
+{
+    QByteArray data;
+    QDataStream stream(&data, QIODevice::WriteOnly);
+    stream.setVersion(QDataStream::Qt_6_0);
+
+    stream << quint32(0);          // Size placeholder, patched below
+    stream << quint32(LEGACY_MAGIC); // Magic number
+    stream << message;
+
+    // Patch the size prefix in place rather than copying into a second buffer
+    quint32 payloadSize = quint32(data.size() - 4);
+    for (int i = 0; i < 4; ++i) {
+        data[i] = char((payloadSize >> (24 - 8 * i)) & 0xFF);
+    }
+
+    return data;
+}
+
+QByteArray WireFormat::encodeCompact(const QVariantMap& message)
+{
+    const KeyTable& table = keys();
+
+    int type = table.typeIndex.value(message.value(table.typeKey).toString(), 0);
+    if (type == 0) {
+        return QByteArray();
+    }
+
+    // Resolve keys to field indexes first so values are written in wire order
+    QVariant values[FIELD_COUNT];
+    quint64 presence = 0;
+    for (auto it = message.constBegin(); it != message.constEnd(); ++it) {
+        if (it.key() == table.typeKey) {
+            continue;
+        }
+        auto field = table.fieldIndex.constFind(it.key());
+        if (field == table.fieldIndex.constEnd()) {
+            return QByteArray();  // Unknown field: caller falls back to legacy
+        }
+        presence |= quint64(1) << field.value();
+        values[field.value()] = it.value();
+    }
+
+    NodeIdInterner interner;
+    QByteArray body;
+    for (int i = 0; i < FIELD_COUNT; ++i) {
+        if ((presence & (quint64(1) << i)) &&
+            !encodeField(body, interner, FIELDS[i].kind, values[i])) {
+            return QByteArray();
+        }
+    }
+
+    QByteArray packet;
+    packet.reserve(COMPACT_HEADER_SIZE + 16 + body.size());
+    packet.append(char(COMPACT_MAGIC0));
+    packet.append(char(COMPACT_MAGIC1));
+    packet.append(char(COMPACT_VERSION));
+    packet.append(char(type));
+    putVarint(packet, presence);
+    putVarint(packet, quint64(interner.ids().size()));
+    for (const QString& id : interner.ids()) {
+        putString(packet, id);
+    }
+    packet.append(body);
+    return packet;
+}
+
+bool WireFormat::isCompact(const char* data, int size)
+{
+    const uchar* bytes = reinterpret_cast<const uchar*>(data);
+    return size >= COMPACT_HEADER_SIZE &&
+           bytes[0] == COMPACT_MAGIC0 &&
+           bytes[1] == COMPACT_MAGIC1 &&
+           bytes[2] == COMPACT_VERSION;
+}
+
+QVariantMap WireFormat::decode(const char* data, int size)
+{
+    if (isCompact(data, size)) {
+        return decodeCompact(reinterpret_cast<const uchar*>(data), size);
+    }
+    return decodeLegacy(data, size);
+}
+
+bool WireFormat::isKnownType(const QString& type)
+{
+    return keys().typeIndex.contains(type);
+}
+
+bool WireFormat::parseForwardHeader(const char* data, int size, ForwardHeader* header)
+{
+    static const int privateType = keys().typeIndex.value(QStringLiteral("private"), 0);
+    static const int destField = keys().fieldIndex.value(QStringLiteral("Dest"), -1);
+    static const int originField = keys().fieldIndex.value(QStringLiteral("Origin"), -1);
+    static const int sequenceField = keys().fieldIndex.value(QStringLiteral("Sequence"), -1);
+    static const int hopLimitField = keys().fieldIndex.value(QStringLiteral("HopLimit"), -1);
+
+    const uchar* bytes = reinterpret_cast<const uchar*>(data);
+    if (!isCompact(data, size) || bytes[3] != privateType) {
+        return false;
+    }
+    Reader in{bytes + COMPACT_HEADER_SIZE, bytes + size};
+
+    quint64 presence;
+    if (!in.varint(presence) || !(presence & (quint64(1) << destField)) ||
+        !(presence & (quint64(1) << hopLimitField))) {
+        return false;
+    }
+
+    // Node-id table: remember where each name is, decode only destination and origin
+    quint64 idCount;
+    if (!in.varint(idCount) || idCount > quint64(in.end - in.p)) {
+        return false;
+    }
+    QVarLengthArray<QPair<const uchar*, int>, 8> ids;
+    for (quint64 i = 0; i < idCount; ++i) {
+        quint64 length;
+        if (!in.varint(length) || length > quint64(in.end - in.p)) {
+            return false;
+        }
+        ids.append(qMakePair(in.p, int(length)));
+        in.p += length;
+    }
+
+    // Skip the fields that precede HopLimit in wire order
+    quint64 destIndex = quint64(-1);
+    quint64 originIndex = quint64(-1);
+    qint64 sequence = 0;
+    for (int i = 0; i < hopLimitField; ++i) {
+        if (!(presence & (quint64(1) << i))) {
+            continue;
+        }
+        quint64 value;
+        switch (FIELDS[i].kind) {
+        case NodeIdField:
+        case IntField:
+        case UIntField:
+        case Int64Field:
+            if (!in.varint(value)) return false;
+            if (i == destField) destIndex = value;
+            if (i == originField) originIndex = value;
+            if (i == sequenceField) sequence = unzigzag(value);
+            break;
+        case TextField:
+            if (!in.varint(value) || value > quint64(in.end - in.p)) return false;
+            in.p += value;
+            break;
+        default:
+            return false;
+        }
+    }
+    if (destIndex >= quint64(ids.size())) {
+        return false;
+    }
+
+    const uchar* hopLimitStart = in.p;
+    quint64 hopLimit;
+    if (!in.varint(hopLimit) || hopLimit > 0xFFFFFFFFu) {
+        return false;
+    }
+    header->destination = QString::fromUtf8(reinterpret_cast<const char*>(ids[int(destIndex)].first),
+                                            ids[int(destIndex)].second);
+    const bool hasSequence = presence & (quint64(1) << sequenceField);
+    header->origin = hasSequence && originIndex < quint64(ids.size())
+        ? QString::fromUtf8(reinterpret_cast<const char*>(ids[int(originIndex)].first), ids[int(originIndex)].second)
+        : QString();
+    header->sequence = int(sequence);
+    header->hopLimit = quint32(hopLimit);
+    header->hopLimitOffset = int(hopLimitStart - bytes);
+    header->hopLimitLength = int(in.p - hopLimitStart);
+    return true;
+}
+
+bool WireFormat::patchHopLimit(char* data, int size, const ForwardHeader& header, quint32 hopLimit)
+{
+    // Checked up front so a failed patch leaves the packet untouched
+    if (header.hopLimitOffset < 0 || header.hopLimitOffset + header.hopLimitLength > size ||
+        header.hopLimitLength < 1 || (header.hopLimitLength < 5 && hopLimit >> (7 * header.hopLimitLength))) {
+        return false;
+    }
+    quint64 value = hopLimit;
+    uchar* out = reinterpret_cast<uchar*>(data) + header.hopLimitOffset;
+    for (int i = 0; i < header.hopLimitLength; ++i) {
+        uchar byte = uchar(value & 0x7F);
+        value >>= 7;
+        if (i + 1 < header.hopLimitLength) {
+            byte |= 0x80;
+        }
+        out[i] = byte;
+    }
+    return value == 0;
+}
@@ -0,0 +1,72 @@
+#ifndef SIMPLECHAT_WIREFORMAT_H
+#define SIMPLECHAT_WIREFORMAT_H
+
+#include <QByteArray>
+#include <QVariantMap>
+
+// Packet codec shared by every node.
+//
+// Legacy (v1) packets are a QDataStream QVariantMap:
+//   [u32 size][u32 0xCAFEBABE][QVariantMap]
+//
+// Compact (v2) packets use a fixed field layout instead of string keys:
+//   [0xCA 0xFE][version][type]
+//   [varint presence bitmask over FIELDS]
+//   [varint node-id count][node ids: varint length + UTF-8]...
+//   [present field values, in FIELDS order]
+// Node ids (Origin, Dest, AckOrigin, ...) are interned into the per-packet
+// table and referenced by index, integers are (zigzag) varints.
+//
+// The first two bytes reuse the 0xCAFE prefix of the legacy magic; a legacy
+// packet always starts with its (small) big-endian size, so the two formats
+// can never be confused. Nodes advertise v2 through the "Wire" field of their
+// discovery packets and only send compact packets to peers that did so.
+//
+// "Wire" is really a feature level: 2 = compact packets, 3 = also accepts
+// ack_batch. Packets themselves stay at COMPACT_VERSION.
+class WireFormat
+{
+public:
+    // What a relay needs from a compact "private" packet: its destination, its
+    // (origin, sequence) identity for duplicate suppression, and where the
+    // HopLimit varint sits, so the packet can be forwarded as is
+    struct ForwardHeader {
+        QString destination;
+        QString origin;           // Empty unless the packet carries Origin and Sequence
+        int sequence = 0;
+        quint32 hopLimit = 0;
+        int hopLimitOffset = -1;  // Byte offset of the HopLimit varint
+        int hopLimitLength = 0;   // Its encoded length
+    };
+
+    static const quint32 LEGACY_MAGIC = 0xCAFEBABE;
+    static const quint8 COMPACT_VERSION = 2;
+    static const int ACK_BATCH_LEVEL = 3;
+    static const int WIRE_LEVEL = ACK_BATCH_LEVEL;  // What this build advertises in "Wire"
+
+    // Encode in the legacy QDataStream format (always succeeds)
+    static QByteArray encodeLegacy(const QVariantMap& message);
+
+    // Encode in the compact format; returns an empty array when the message
+    // carries a type or field the compact layout does not know about
+    static QByteArray encodeCompact(const QVariantMap& message);
+
+    // Decode either format; returns an empty map on malformed input
+    static QVariantMap decode(const char* data, int size);
+    static QVariantMap decode(const QByteArray& data) { return decode(data.constData(), data.size()); }
+
+    static bool isCompact(const char* data, int size);
+
+    // True for every message type this build speaks (the compact type table)
+    static bool isKnownType(const QString& type);
+
+    // Parses a compact private packet only as far as HopLimit (the fields in
+    // front of it are skipped, never decoded); false for any other packet
+    static bool parseForwardHeader(const char* data, int size, ForwardHeader* header);
+
+    // Rewrites HopLimit in place at its current encoded length (varints may be
+    // padded with 0x80 bytes); false, with data untouched, if the value needs more bytes
+    static bool patchHopLimit(char* data, int size, const ForwardHeader& header, quint32 hopLimit);
+};
+
+#endif // SIMPLECHAT_WIREFORMAT_H